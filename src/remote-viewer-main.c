@@ -40,6 +40,8 @@ main(int argc, char **argv)
     app = G_APPLICATION(remote_viewer_new());
 
     ret = g_application_run(app, argc, argv);
+    if (ret == 0)
+        ret = remote_viewer_get_exit_status(REMOTE_VIEWER(app));
     g_object_unref(app);
     return ret;
 }
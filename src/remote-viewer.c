@@ -50,8 +50,21 @@
 struct _RemoteViewerPrivate {
 #ifdef HAVE_OVIRT
     OvirtForeignMenu *ovirt_foreign_menu;
+
+    /* Authenticated oVirt session, kept for the process lifetime so that
+     * reconnecting to the same engine doesn't log in again */
+    OvirtProxy *ovirt_proxy;
+    gchar *ovirt_proxy_key;
+    OvirtApi *ovirt_api;
+    OvirtVm *ovirt_vm;
+    gchar *ovirt_vm_name;
 #endif
     gboolean open_recent_dialog;
+
+    /* --send-file */
+    gchar **send_files;
+    gboolean send_files_benchmark;
+    gint exit_status;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (RemoteViewer, remote_viewer, VIRT_VIEWER_TYPE_APP)
@@ -71,6 +84,10 @@ static OvirtVm * choose_vm(GtkWindow *main_window,
 #endif
 
 static gboolean remote_viewer_start(VirtViewerApp *self, GError **error);
+#ifdef HAVE_OVIRT
+static void remote_viewer_clear_ovirt_vm(RemoteViewer *self);
+static void remote_viewer_clear_ovirt_session(RemoteViewer *self);
+#endif
 
 static void
 remote_viewer_dispose (GObject *object)
@@ -85,7 +102,9 @@ remote_viewer_dispose (GObject *object)
         g_object_unref(priv->ovirt_foreign_menu);
         priv->ovirt_foreign_menu = NULL;
     }
+    remote_viewer_clear_ovirt_session(self);
 #endif
+    g_clear_pointer(&REMOTE_VIEWER(object)->priv->send_files, g_strfreev);
 
     G_OBJECT_CLASS(remote_viewer_parent_class)->dispose (object);
 }
@@ -96,6 +115,13 @@ remote_viewer_deactivated(VirtViewerApp *app, gboolean connect_error)
     RemoteViewer *self = REMOTE_VIEWER(app);
     RemoteViewerPrivate *priv = self->priv;
 
+#ifdef HAVE_OVIRT
+    /* The display may have moved (migration, restart), look the VM up again
+     * on the next attempt, but keep the authenticated session */
+    if (connect_error)
+        remote_viewer_clear_ovirt_vm(self);
+#endif
+
     if (connect_error && priv->open_recent_dialog) {
         if (virt_viewer_app_start(app, NULL)) {
             return;
@@ -107,6 +133,10 @@ remote_viewer_deactivated(VirtViewerApp *app, gboolean connect_error)
 
 static gchar **opt_args = NULL;
 static char *opt_title = NULL;
+#ifdef HAVE_SPICE_GTK
+static gchar **opt_send_files = NULL;
+static gboolean opt_send_files_benchmark = FALSE;
+#endif
 
 static void
 remote_viewer_add_option_entries(VirtViewerApp *self, GOptionContext *context, GOptionGroup *group)
@@ -114,6 +144,12 @@ remote_viewer_add_option_entries(VirtViewerApp *self, GOptionContext *context, G
     static const GOptionEntry options[] = {
         { "title", 't', 0, G_OPTION_ARG_STRING, &opt_title,
           N_("Set window title"), NULL },
+#ifdef HAVE_SPICE_GTK
+        { "send-file", '\0', 0, G_OPTION_ARG_FILENAME_ARRAY, &opt_send_files,
+          N_("Transfer a file or directory to the guest once its agent is connected, then quit"), N_("FILE") },
+        { "send-file-benchmark", '\0', 0, G_OPTION_ARG_NONE, &opt_send_files_benchmark,
+          N_("Print the file transfer throughput in a machine readable form"), NULL },
+#endif
         { G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_STRING_ARRAY, &opt_args,
           NULL, "URI|VV-FILE" },
         { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
@@ -157,6 +193,14 @@ remote_viewer_local_command_line (GApplication   *gapp,
     if (opt_title)
         g_object_set(app, "title", opt_title, NULL);
 
+#ifdef HAVE_SPICE_GTK
+    if (opt_send_files) {
+        self->priv->send_files = opt_send_files;
+        opt_send_files = NULL;
+    }
+    self->priv->send_files_benchmark = opt_send_files_benchmark;
+#endif
+
 end:
     if (ret && *status)
         g_printerr(_("Run '%s --help' to see a full list of available command line options\n"), g_get_prgname());
@@ -220,6 +264,16 @@ remote_viewer_init(RemoteViewer *self)
     self->priv = remote_viewer_get_instance_private(self);
 }
 
+/* Status to exit with once the application has run, non-zero when the
+ * files requested with --send-file couldn't all be transferred */
+gint
+remote_viewer_get_exit_status(RemoteViewer *self)
+{
+    g_return_val_if_fail(REMOTE_VIEWER_IS(self), 1);
+
+    return self->priv->exit_status;
+}
+
 RemoteViewer *
 remote_viewer_new(void)
 {
@@ -311,7 +365,7 @@ parse_ovirt_uri(const gchar *uri_str, char **rest_uri, char **name, char **usern
 
 static gboolean
 authenticate_cb(RestProxy *proxy, G_GNUC_UNUSED RestProxyAuth *auth,
-                G_GNUC_UNUSED gboolean retrying, gpointer user_data)
+                gboolean retrying, gpointer user_data)
 {
     gchar *username = NULL;
     gchar *password = NULL;
@@ -321,8 +375,19 @@ authenticate_cb(RestProxy *proxy, G_GNUC_UNUSED RestProxyAuth *auth,
 
     g_object_get(proxy,
                  "username", &username,
+                 "password", &password,
                  NULL);
 
+    if (!retrying && password != NULL && *password != '\0') {
+        /* Credentials were already entered for this (cached) proxy, the
+         * server session most likely expired: log in again silently */
+        g_debug("Reusing cached oVirt credentials for '%s'", username);
+        g_free(username);
+        g_free(password);
+        return TRUE;
+    }
+    g_clear_pointer(&password, g_free);
+
     g_object_get(G_OBJECT(user_data), "kiosk", &kiosk, NULL);
 
     if (username == NULL || *username == '\0')
@@ -395,15 +460,121 @@ virt_viewer_app_set_ovirt_foreign_menu(VirtViewerApp *app,
     ovirt_foreign_menu_updated(self);
 }
 
+static void
+remote_viewer_clear_ovirt_vm(RemoteViewer *self)
+{
+    RemoteViewerPrivate *priv = self->priv;
+
+    g_clear_object(&priv->ovirt_vm);
+    g_clear_pointer(&priv->ovirt_vm_name, g_free);
+}
+
+static void
+remote_viewer_clear_ovirt_session(RemoteViewer *self)
+{
+    RemoteViewerPrivate *priv = self->priv;
+
+    remote_viewer_clear_ovirt_vm(self);
+    g_clear_object(&priv->ovirt_api);
+    g_clear_object(&priv->ovirt_proxy);
+    g_clear_pointer(&priv->ovirt_proxy_key, g_free);
+}
+
+/* Returns the cached proxy for @rest_uri/@username, creating it if needed */
+static OvirtProxy *
+remote_viewer_get_ovirt_proxy(RemoteViewer *self,
+                              const char *rest_uri,
+                              const char *username)
+{
+    RemoteViewerPrivate *priv = self->priv;
+    gchar *key = g_strdup_printf("%s@%s", username ? username : "", rest_uri);
+
+    if (priv->ovirt_proxy != NULL && g_strcmp0(key, priv->ovirt_proxy_key) == 0) {
+        g_debug("Reusing oVirt session to %s", rest_uri);
+        g_free(key);
+        return priv->ovirt_proxy;
+    }
+
+    remote_viewer_clear_ovirt_session(self);
+    priv->ovirt_proxy_key = key;
+    priv->ovirt_proxy = ovirt_proxy_new(rest_uri);
+    g_object_set(priv->ovirt_proxy,
+                 "username", username,
+                 NULL);
+    ovirt_set_proxy_options(priv->ovirt_proxy);
+    g_signal_connect(G_OBJECT(priv->ovirt_proxy), "authenticate",
+                     G_CALLBACK(authenticate_cb), self);
+
+    return priv->ovirt_proxy;
+}
+
+/* Fetches the api root and VM collection to find @vm_name, asking the user
+ * to choose a VM if needed. On success, the VM and its name are cached. */
+static OvirtVm *
+remote_viewer_fetch_ovirt_vm(RemoteViewer *self,
+                             OvirtProxy *proxy,
+                             char **vm_name,
+                             GError **error)
+{
+    RemoteViewerPrivate *priv = self->priv;
+    OvirtCollection *vms;
+    OvirtVm *vm = NULL;
+    OvirtVmState state;
+
+    if (priv->ovirt_api == NULL) {
+        OvirtApi *api = ovirt_proxy_fetch_api(proxy, error);
+        if (api == NULL) {
+            g_debug("failed to get oVirt 'api' collection: %s", (*error)->message);
+            if (g_error_matches(*error, OVIRT_REST_CALL_ERROR, OVIRT_REST_CALL_ERROR_CANCELLED)) {
+                g_clear_error(error);
+                g_set_error_literal(error,
+                                    VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_CANCELLED,
+                                    _("Authentication was cancelled"));
+            }
+            return NULL;
+        }
+        priv->ovirt_api = g_object_ref(api);
+    }
+
+    vms = ovirt_api_get_vms(priv->ovirt_api);
+    if (!ovirt_collection_fetch(vms, proxy, error)) {
+        g_debug("failed to fetch oVirt 'vms' collection: %s", (*error)->message);
+        return NULL;
+    }
+    if (*vm_name == NULL ||
+        (vm = OVIRT_VM(ovirt_collection_lookup_resource(vms, *vm_name))) == NULL) {
+        VirtViewerWindow *main_window = virt_viewer_app_get_main_window(VIRT_VIEWER_APP(self));
+        vm = choose_vm(virt_viewer_window_get_window(main_window),
+                       vm_name,
+                       vms,
+                       error);
+        if (vm == NULL) {
+            return NULL;
+        }
+    }
+    g_object_get(G_OBJECT(vm), "state", &state, NULL);
+    if (state != OVIRT_VM_STATE_UP) {
+        g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                    _("oVirt VM %s is not running"), *vm_name);
+        g_debug("%s", (*error)->message);
+        g_object_unref(vm);
+        return NULL;
+    }
+
+    remote_viewer_clear_ovirt_vm(self);
+    priv->ovirt_vm = g_object_ref(vm);
+    priv->ovirt_vm_name = g_strdup(*vm_name);
+
+    return vm;
+}
+
 static gboolean
 create_ovirt_session(VirtViewerApp *app, const char *uri, GError **err)
 {
+    RemoteViewerPrivate *priv;
     OvirtProxy *proxy = NULL;
-    OvirtApi *api = NULL;
-    OvirtCollection *vms;
     OvirtVm *vm = NULL;
     OvirtVmDisplay *display = NULL;
-    OvirtVmState state;
     GError *error = NULL;
     char *rest_uri = NULL;
     char *vm_name = NULL;
@@ -422,7 +593,8 @@ create_ovirt_session(VirtViewerApp *app, const char *uri, GError **err)
     gchar *host_subject = NULL;
     gchar *guid = NULL;
 
-    g_return_val_if_fail(VIRT_VIEWER_IS_APP(app), FALSE);
+    g_return_val_if_fail(REMOTE_VIEWER_IS(app), FALSE);
+    priv = REMOTE_VIEWER(app)->priv;
 
     if (!parse_ovirt_uri(uri, &rest_uri, &vm_name, &username)) {
         g_set_error_literal(&error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
@@ -430,56 +602,39 @@ create_ovirt_session(VirtViewerApp *app, const char *uri, GError **err)
         goto error;
     }
 
-    proxy = ovirt_proxy_new(rest_uri);
-    g_object_set(proxy,
-                 "username", username,
-                 NULL);
-    ovirt_set_proxy_options(proxy);
-    g_signal_connect(G_OBJECT(proxy), "authenticate",
-                     G_CALLBACK(authenticate_cb), app);
-
-    api = ovirt_proxy_fetch_api(proxy, &error);
-    if (error != NULL) {
-        g_debug("failed to get oVirt 'api' collection: %s", error->message);
-        if (g_error_matches(error, OVIRT_REST_CALL_ERROR, OVIRT_REST_CALL_ERROR_CANCELLED)) {
+    proxy = g_object_ref(remote_viewer_get_ovirt_proxy(REMOTE_VIEWER(app), rest_uri, username));
+
+    if (priv->ovirt_vm != NULL &&
+        (vm_name == NULL || g_strcmp0(vm_name, priv->ovirt_vm_name) == 0)) {
+        /* Reconnecting to a VM we already looked up: the session is still
+         * authenticated, so only the VM itself is fetched again, its
+         * display may have moved (migration, restart), and a new ticket */
+        if (ovirt_resource_refresh(OVIRT_RESOURCE(priv->ovirt_vm), proxy, &error) &&
+            ovirt_vm_get_ticket(priv->ovirt_vm, proxy, &error)) {
+            vm = g_object_ref(priv->ovirt_vm);
+            g_free(vm_name);
+            vm_name = g_strdup(priv->ovirt_vm_name);
+        } else {
+            g_debug("failed to refresh cached VM %s, looking it up again: %s",
+                    priv->ovirt_vm_name, error->message);
             g_clear_error(&error);
-            g_set_error_literal(&error,
-                                VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_CANCELLED,
-                                _("Authentication was cancelled"));
+            remote_viewer_clear_ovirt_vm(REMOTE_VIEWER(app));
         }
-        goto error;
     }
-    vms = ovirt_api_get_vms(api);
-    ovirt_collection_fetch(vms, proxy, &error);
-    if (error != NULL) {
-        g_debug("failed to fetch oVirt 'vms' collection: %s", error->message);
-        goto error;
-    }
-    if (vm_name == NULL ||
-        (vm = OVIRT_VM(ovirt_collection_lookup_resource(vms, vm_name))) == NULL) {
-        VirtViewerWindow *main_window = virt_viewer_app_get_main_window(app);
-        vm = choose_vm(virt_viewer_window_get_window(main_window),
-                       &vm_name,
-                       vms,
-                       &error);
-        if (vm == NULL) {
+
+    if (vm == NULL) {
+        vm = remote_viewer_fetch_ovirt_vm(REMOTE_VIEWER(app), proxy, &vm_name, &error);
+        if (vm == NULL)
+            goto error;
+
+        if (!ovirt_vm_get_ticket(vm, proxy, &error)) {
+            g_debug("failed to get ticket for %s: %s", vm_name, error->message);
+            remote_viewer_clear_ovirt_vm(REMOTE_VIEWER(app));
             goto error;
         }
     }
-    g_object_get(G_OBJECT(vm), "state", &state, NULL);
-    if (state != OVIRT_VM_STATE_UP) {
-        g_set_error(&error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
-                    _("oVirt VM %s is not running"), vm_name);
-        g_debug("%s", error->message);
-        goto error;
-    }
     g_object_set(app, "guest-name", vm_name, NULL);
 
-    if (!ovirt_vm_get_ticket(vm, proxy, &error)) {
-        g_debug("failed to get ticket for %s: %s", vm_name, error->message);
-        goto error;
-    }
-
     g_object_get(G_OBJECT(vm), "display", &display, "guid", &guid, NULL);
     if (display == NULL) {
         g_set_error(&error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
@@ -527,7 +682,7 @@ create_ovirt_session(VirtViewerApp *app, const char *uri, GError **err)
 
     {
         OvirtForeignMenu *ovirt_menu = ovirt_foreign_menu_new(proxy);
-        g_object_set(G_OBJECT(ovirt_menu), "api", api, "vm", vm, NULL);
+        g_object_set(G_OBJECT(ovirt_menu), "api", priv->ovirt_api, "vm", vm, NULL);
         virt_viewer_app_set_ovirt_foreign_menu(app, ovirt_menu);
     }
 
@@ -674,6 +829,42 @@ read_all_stdin(gsize *len, GError **err)
     return content;
 }
 
+#ifdef HAVE_SPICE_GTK
+static void
+remote_viewer_send_files_finished(VirtViewerSessionSpice *session,
+                                  guint n_completed,
+                                  guint n_failed,
+                                  guint64 size,
+                                  gint64 duration,
+                                  RemoteViewer *self)
+{
+    gdouble seconds = (gdouble)MAX(duration, 1) / G_USEC_PER_SEC;
+    gdouble rate = size / seconds / (1000 * 1000);
+
+    if (self->priv->send_files_benchmark) {
+        g_print("files=%u failed=%u bytes=%" G_GUINT64_FORMAT " seconds=%.3f MB/s=%.2f\n",
+                n_completed, n_failed, size, seconds, rate);
+    } else {
+        gchar *size_str = g_format_size(size);
+
+        g_print(ngettext("Transferred %u file (%s) in %.1f seconds, %.2f MB/s\n",
+                         "Transferred %u files (%s) in %.1f seconds, %.2f MB/s\n",
+                         n_completed),
+                n_completed, size_str, seconds, rate);
+        if (n_failed > 0)
+            g_printerr(ngettext("%u file could not be transferred\n",
+                                "%u files could not be transferred\n",
+                                n_failed),
+                       n_failed);
+        g_free(size_str);
+    }
+
+    self->priv->exit_status = (n_failed == 0) ? 0 : 1;
+    g_object_set(self, "quit-on-disconnect", TRUE, NULL);
+    virt_viewer_session_close(VIRT_VIEWER_SESSION(session));
+}
+#endif
+
 static gboolean
 remote_viewer_initial_connect(RemoteViewer *self, const gchar *type, const gchar *guri,
                               VirtViewerFile *vvfile, GError **error)
@@ -697,6 +888,19 @@ remote_viewer_initial_connect(RemoteViewer *self, const gchar *type, const gchar
                      G_CALLBACK(remote_viewer_session_connected), g_strdup(guri));
 
     virt_viewer_session_set_file(virt_viewer_app_get_session(app), vvfile);
+#ifdef HAVE_SPICE_GTK
+    if (VIRT_VIEWER_IS_SESSION_SPICE(virt_viewer_app_get_session(app)) &&
+        self->priv->send_files != NULL) {
+        VirtViewerSessionSpice *session = VIRT_VIEWER_SESSION_SPICE(virt_viewer_app_get_session(app));
+
+        virt_viewer_session_spice_set_send_files(session,
+                                                 (const gchar * const *)self->priv->send_files);
+        /* failed until the transfers report otherwise */
+        self->priv->exit_status = 1;
+        g_signal_connect(session, "send-files-finished",
+                         G_CALLBACK(remote_viewer_send_files_finished), self);
+    }
+#endif
 #ifdef HAVE_OVIRT
     if (vvfile != NULL) {
         OvirtForeignMenu *ovirt_menu;
@@ -49,6 +49,7 @@ typedef struct {
 GType remote_viewer_get_type (void);
 
 RemoteViewer *remote_viewer_new (void);
+gint remote_viewer_get_exit_status(RemoteViewer *self);
 
 G_END_DECLS
 
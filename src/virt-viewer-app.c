@@ -49,12 +49,21 @@
 #include <windows.h>
 #endif
 
+#ifdef G_OS_UNIX
+#include <glib-unix.h>
+#endif
+
 #include "virt-viewer-app.h"
 #include "virt-viewer-resources.h"
 #include "virt-viewer-auth.h"
 #include "virt-viewer-window.h"
 #include "virt-viewer-session.h"
 #include "virt-viewer-util.h"
+#include "virt-viewer-dbus.h"
+#include "virt-viewer-typer.h"
+#include "virt-viewer-relay.h"
+#include "virt-viewer-capture.h"
+#include "virt-viewer-wan.h"
 #ifdef HAVE_GTK_VNC
 #include "virt-viewer-session-vnc.h"
 #endif
@@ -104,6 +113,8 @@ static void virt_viewer_app_channel_open(VirtViewerSession *session,
 static void virt_viewer_app_update_pretty_address(VirtViewerApp *self);
 static void virt_viewer_app_set_fullscreen(VirtViewerApp *self, gboolean fullscreen);
 static void virt_viewer_app_update_menu_displays(VirtViewerApp *self);
+static guint virt_viewer_app_get_config_uint(VirtViewerApp *self, const gchar *key, guint default_value);
+static void window_clear_display_submenu(VirtViewerWindow *window);
 static void virt_viewer_update_smartcard_accels(VirtViewerApp *self);
 static void virt_viewer_app_add_option_entries(VirtViewerApp *self, GOptionContext *context, GOptionGroup *group);
 
@@ -114,7 +125,11 @@ struct _VirtViewerAppPrivate {
     GList *windows;
     GHashTable *displays; /* !vte */
     GHashTable *initial_display_map;
+    /* last server cut text, ISO-8859-1, and its UTF-8 version once pasted */
     gchar *clipboard;
+    gsize clipboard_len;
+    gchar *clipboard_utf8;
+    gboolean clipboard_setting;
     GtkWidget *preferences;
     GtkFileChooser *preferences_shared_folder;
     GResource *resource;
@@ -158,8 +173,35 @@ struct _VirtViewerAppPrivate {
     GdkModifierType remove_smartcard_accel_mods;
     gboolean quit_on_disconnect;
     gboolean supports_share_clipboard;
+    gchar *console_log_dir;
+    gboolean trace_latency;
+    gboolean relay;
+    GList *relays; /* VirtViewerRelay of the current connection */
+    gchar *capture_file;
+    VirtViewerCapture *capture;
+    gboolean emulate_wan;
+    VirtViewerWanProfile wan_profile;
+    gboolean ssh_compression;
+    guint session_serial; /* counts the sessions created */
+    /* compression of the SSH tunnels of the latest session that reported */
+    guint ssh_stats_session;
+    guint64 ssh_raw_bytes;
+    guint64 ssh_compressed_bytes;
+
+    /* hidden windows kept for displays that come and go */
+    GQueue window_pool;
+    guint window_pool_fill_id; /* source id */
+    /* drops the kiosk windows the new session didn't take over */
+    guint detached_windows_id; /* source id */
+
+    VirtViewerDBus *dbus;
 };
 
+/* Number of unused windows kept around for reuse */
+#define WINDOW_POOL_SIZE 4
+/* Seconds after connecting for the displays of the session to come up */
+#define DETACHED_WINDOWS_TIMEOUT 5
+
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE(VirtViewerApp, virt_viewer_app, GTK_TYPE_APPLICATION)
 
@@ -533,6 +575,16 @@ virt_viewer_app_hide_all_windows(VirtViewerApp *app)
     g_list_foreach(app->priv->windows, hide_one_window, app);
 }
 
+static void
+stop_typing_one_window(gpointer value,
+                       gpointer user_data)
+{
+    VirtViewerDisplay *display = virt_viewer_window_get_display(VIRT_VIEWER_WINDOW(value));
+
+    if (display != NULL)
+        virt_viewer_app_stop_typing(VIRT_VIEWER_APP(user_data), display);
+}
+
 G_MODULE_EXPORT void
 virt_viewer_app_about_close(GtkWidget *dialog,
                             VirtViewerApp *self G_GNUC_UNUSED)
@@ -552,19 +604,30 @@ virt_viewer_app_about_delete(GtkWidget *dialog,
 
 #if defined(HAVE_SOCKETPAIR) && defined(HAVE_FORK)
 
+/* When @errfd isn't NULL, the stderr of the command is returned there */
 static int
-virt_viewer_app_open_tunnel(const char **cmd)
+virt_viewer_app_open_tunnel(const char **cmd, int *errfd)
 {
-    int fd[2];
+    int fd[2], err[2] = { -1, -1 };
     pid_t pid;
 
     if (socketpair(PF_UNIX, SOCK_STREAM, 0, fd) < 0)
         return -1;
 
+    if (errfd && !g_unix_open_pipe(err, FD_CLOEXEC, NULL)) {
+        close(fd[0]);
+        close(fd[1]);
+        return -1;
+    }
+
     pid = fork();
     if (pid == -1) {
         close(fd[0]);
         close(fd[1]);
+        if (errfd) {
+            close(err[0]);
+            close(err[1]);
+        }
         return -1;
     }
 
@@ -577,28 +640,120 @@ virt_viewer_app_open_tunnel(const char **cmd)
         if (dup(fd[1]) < 0)
             _exit(1);
         close(fd[1]);
+        if (errfd && dup2(err[1], 2) < 0)
+            _exit(1);
         execvp("ssh", (char *const*)cmd);
         _exit(1);
     }
     close(fd[1]);
+    if (errfd) {
+        close(err[1]);
+        *errfd = err[0];
+    }
     return fd[0];
 }
 
+typedef struct {
+    VirtViewerApp *app;
+    guint session; /* serial of the session the tunnel belongs to */
+} SshTunnelWatch;
+
+static void
+ssh_tunnel_watch_free(gpointer opaque)
+{
+    SshTunnelWatch *watch = opaque;
+
+    g_object_unref(watch->app);
+    g_free(watch);
+}
+
+/* ssh reports how well it compressed when it exits, at debug level, the
+ * other messages are passed through */
+static gboolean
+virt_viewer_app_ssh_stderr(GIOChannel *channel,
+                           GIOCondition condition G_GNUC_UNUSED,
+                           gpointer opaque)
+{
+    SshTunnelWatch *watch = opaque;
+    VirtViewerAppPrivate *priv = watch->app->priv;
+    gchar *line = NULL;
+    gchar direction[9];
+    guint64 raw, compressed;
+    GIOStatus status;
+
+    status = g_io_channel_read_line(channel, &line, NULL, NULL, NULL);
+    if (status == G_IO_STATUS_AGAIN)
+        return TRUE;
+    if (status != G_IO_STATUS_NORMAL)
+        return FALSE;
+
+    if (sscanf(line, "debug1: compress %8[a-z]: raw data %" G_GUINT64_FORMAT
+               ", compressed %" G_GUINT64_FORMAT, direction, &raw, &compressed) == 3) {
+        g_debug("SSH tunnel compressed %s data from %" G_GUINT64_FORMAT
+                " to %" G_GUINT64_FORMAT " bytes", direction, raw, compressed);
+        /* the first report of a session replaces those of the previous
+         * one, a late report of an older session is left out */
+        if (watch->session > priv->ssh_stats_session) {
+            priv->ssh_stats_session = watch->session;
+            priv->ssh_raw_bytes = 0;
+            priv->ssh_compressed_bytes = 0;
+        }
+        if (watch->session == priv->ssh_stats_session) {
+            priv->ssh_raw_bytes += raw;
+            priv->ssh_compressed_bytes += compressed;
+        }
+    } else if (!g_str_has_prefix(line, "debug")) {
+        g_printerr("%s", line);
+    }
+    g_free(line);
+
+    return TRUE;
+}
+
+static gboolean
+virt_viewer_app_get_ssh_compression(VirtViewerApp *self)
+{
+    GError *error = NULL;
+    gboolean compression;
+
+    if (self->priv->ssh_compression)
+        return TRUE;
+
+    compression = g_key_file_get_boolean(self->priv->config,
+                                         "virt-viewer", "ssh-compression", &error);
+    g_clear_error(&error);
+
+    return compression;
+}
+
 
 static int
-virt_viewer_app_open_tunnel_ssh(const char *sshhost,
+virt_viewer_app_open_tunnel_ssh(VirtViewerApp *self,
+                                const char *sshhost,
                                 int sshport,
                                 const char *sshuser,
                                 const char *host,
                                 const char *port,
                                 const char *unixsock)
 {
-    const char *cmd[10];
+    const char *cmd[16];
     char portstr[50];
-    int n = 0;
+    int n = 0, errfd = -1;
+    gboolean compression = virt_viewer_app_get_ssh_compression(self);
+    gchar *cipher;
     GString *cat;
 
     cmd[n++] = "ssh";
+    if (compression) {
+        /* -v for the compression report, only the summary is kept */
+        cmd[n++] = "-C";
+        cmd[n++] = "-v";
+    }
+    cipher = g_key_file_get_string(self->priv->config, "virt-viewer", "ssh-cipher", NULL);
+    if (cipher) {
+        cmd[n++] = "-c";
+        cmd[n++] = cipher;
+    }
     if (sshport) {
         cmd[n++] = "-p";
         sprintf(portstr, "%d", sshport);
@@ -629,8 +784,26 @@ virt_viewer_app_open_tunnel_ssh(const char *sshhost,
     cmd[n++] = cat->str;
     cmd[n++] = NULL;
 
-    n = virt_viewer_app_open_tunnel(cmd);
+    n = virt_viewer_app_open_tunnel(cmd, compression ? &errfd : NULL);
     g_string_free(cat, TRUE);
+    g_free(cipher);
+
+    if (errfd >= 0) {
+        GIOChannel *channel = g_io_channel_unix_new(errfd);
+        SshTunnelWatch *watch = g_new0(SshTunnelWatch, 1);
+
+        watch->app = g_object_ref(self);
+        watch->session = self->priv->session_serial;
+
+        g_io_channel_set_close_on_unref(channel, TRUE);
+        g_io_channel_set_encoding(channel, NULL, NULL);
+        g_io_channel_set_flags(channel, G_IO_FLAG_NONBLOCK, NULL);
+        /* holds the app until ssh exits, after the tunnel is closed */
+        g_io_add_watch_full(channel, G_PRIORITY_DEFAULT, G_IO_IN | G_IO_HUP,
+                            virt_viewer_app_ssh_stderr, watch,
+                            ssh_tunnel_watch_free);
+        g_io_channel_unref(channel);
+    }
 
     return n;
 }
@@ -830,6 +1003,49 @@ virt_viewer_app_has_usbredir(VirtViewerApp *self)
            virt_viewer_session_get_has_usbredir(virt_viewer_app_get_session(self));
 }
 
+/* Building a window parses the whole GtkBuilder UI, so this is the
+ * expensive part of virt_viewer_app_window_new() */
+static VirtViewerWindow*
+virt_viewer_app_window_build(VirtViewerApp *self)
+{
+    VirtViewerWindow* window;
+    GtkWindow *w;
+
+    window = g_object_new(VIRT_VIEWER_TYPE_WINDOW, "app", self, NULL);
+    w = virt_viewer_window_get_window(window);
+    g_object_set_data(G_OBJECT(w), "virt-viewer-window", window);
+    g_signal_connect(w, "hide", G_CALLBACK(viewer_window_visible_cb), self);
+    g_signal_connect(w, "show", G_CALLBACK(viewer_window_visible_cb), self);
+
+    return window;
+}
+
+static gboolean
+virt_viewer_app_window_pool_fill(gpointer user_data)
+{
+    VirtViewerApp *self = VIRT_VIEWER_APP(user_data);
+
+    self->priv->window_pool_fill_id = 0;
+    if (g_queue_is_empty(&self->priv->window_pool)) {
+        g_debug("Prebuilding a window for upcoming displays");
+        g_queue_push_tail(&self->priv->window_pool, virt_viewer_app_window_build(self));
+    }
+
+    return FALSE;
+}
+
+/* Builds a spare window when the main loop is idle, so that it is ready
+ * by the time a display gets enabled */
+static void
+virt_viewer_app_window_pool_queue_fill(VirtViewerApp *self)
+{
+    if (self->priv->window_pool_fill_id != 0 ||
+        !g_queue_is_empty(&self->priv->window_pool))
+        return;
+
+    self->priv->window_pool_fill_id = g_idle_add(virt_viewer_app_window_pool_fill, self);
+}
+
 static VirtViewerWindow*
 virt_viewer_app_window_new(VirtViewerApp *self, gint nth)
 {
@@ -840,7 +1056,11 @@ virt_viewer_app_window_new(VirtViewerApp *self, gint nth)
     if (window)
         return window;
 
-    window = g_object_new(VIRT_VIEWER_TYPE_WINDOW, "app", self, NULL);
+    window = g_queue_pop_head(&self->priv->window_pool);
+    if (window)
+        g_debug("Reusing pooled window %p for display #%d", window, nth);
+    else
+        window = virt_viewer_app_window_build(self);
     virt_viewer_window_set_kiosk(window, self->priv->kiosk);
     if (self->priv->main_window)
         virt_viewer_window_set_zoom_level(window, virt_viewer_window_get_zoom_level(self->priv->main_window));
@@ -851,14 +1071,11 @@ virt_viewer_app_window_new(VirtViewerApp *self, gint nth)
     virt_viewer_window_set_usb_options_sensitive(window, virt_viewer_app_has_usbredir(self));
 
     w = virt_viewer_window_get_window(window);
-    g_object_set_data(G_OBJECT(w), "virt-viewer-window", window);
     gtk_application_add_window(GTK_APPLICATION(self), w);
 
     if (self->priv->fullscreen)
         app_window_try_fullscreen(self, window, nth);
 
-    g_signal_connect(w, "hide", G_CALLBACK(viewer_window_visible_cb), self);
-    g_signal_connect(w, "show", G_CALLBACK(viewer_window_visible_cb), self);
     return window;
 }
 
@@ -870,6 +1087,22 @@ window_weak_notify(gpointer data, GObject *where_was G_GNUC_UNUSED)
     g_object_set_data(G_OBJECT(display), "virt-viewer-window", NULL);
 }
 
+static GList *
+virt_viewer_app_find_detached_window(VirtViewerApp *self, gint nth)
+{
+    GList *l;
+
+    for (l = self->priv->windows; l; l = l->next) {
+        gint detached = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(l->data),
+                                                          "virt-viewer-detached-nth"));
+        if (detached == nth + 1 &&
+            virt_viewer_window_get_display(VIRT_VIEWER_WINDOW(l->data)) == NULL)
+            return l;
+    }
+
+    return NULL;
+}
+
 static VirtViewerWindow *
 ensure_window_for_display(VirtViewerApp *self, VirtViewerDisplay *display)
 {
@@ -886,12 +1119,17 @@ ensure_window_for_display(VirtViewerApp *self, VirtViewerDisplay *display)
         /* There should always be at least a main window created at startup */
         g_return_val_if_fail(l != NULL, NULL);
         /* if there's a window that doesn't yet have an associated display, use
-         * that window */
-        for (; l; l = l->next) {
-            if (virt_viewer_window_get_display(VIRT_VIEWER_WINDOW(l->data)) == NULL)
-                break;
+         * that window, preferably the one that showed this display during the
+         * previous session */
+        l = virt_viewer_app_find_detached_window(self, nth);
+        if (l == NULL) {
+            for (l = self->priv->windows; l; l = l->next) {
+                if (virt_viewer_window_get_display(VIRT_VIEWER_WINDOW(l->data)) == NULL)
+                    break;
+            }
         }
         if (l && virt_viewer_window_get_display(VIRT_VIEWER_WINDOW(l->data)) == NULL) {
+            g_object_set_data(G_OBJECT(l->data), "virt-viewer-detached-nth", NULL);
             win = VIRT_VIEWER_WINDOW(l->data);
             g_debug("Found a window without a display, reusing for display #%d", nth);
             if (self->priv->fullscreen && !self->priv->kiosk)
@@ -958,6 +1196,8 @@ display_show_hint(VirtViewerDisplay *display,
         }
     }
     virt_viewer_app_update_menu_displays(self);
+    if (self->priv->dbus)
+        virt_viewer_dbus_emit_displays_changed(self->priv->dbus);
 }
 
 static void
@@ -978,18 +1218,18 @@ virt_viewer_app_display_added(VirtViewerSession *session G_GNUC_UNUSED,
     }
 
     g_hash_table_insert(self->priv->displays, GINT_TO_POINTER(nth), g_object_ref(display));
+    if (nth > 0 && virt_viewer_app_get_nth_window(self, nth) == NULL)
+        virt_viewer_app_window_pool_queue_fill(self);
 
     g_signal_connect(display, "notify::show-hint",
                      G_CALLBACK(display_show_hint), NULL);
     g_object_notify(G_OBJECT(display), "show-hint"); /* call display_show_hint */
 }
 
-static void virt_viewer_app_remove_nth_window(VirtViewerApp *self,
-                                              gint nth)
+static void virt_viewer_app_remove_window(VirtViewerApp *self,
+                                          VirtViewerWindow *win,
+                                          gint nth)
 {
-    VirtViewerWindow *win = virt_viewer_app_get_nth_window(self, nth);
-    if (!win)
-        return;
     virt_viewer_window_set_display(win, NULL);
     if (win == self->priv->main_window) {
         g_debug("Not removing main window %d %p", nth, win);
@@ -1000,20 +1240,94 @@ static void virt_viewer_app_remove_nth_window(VirtViewerApp *self,
     g_debug("Remove window %d %p", nth, win);
     self->priv->windows = g_list_remove(self->priv->windows, win);
 
-    g_object_unref(win);
+    if (g_queue_get_length(&self->priv->window_pool) < WINDOW_POOL_SIZE) {
+        virt_viewer_window_leave_fullscreen(win);
+        window_clear_display_submenu(win);
+        gtk_application_remove_window(GTK_APPLICATION(self), virt_viewer_window_get_window(win));
+        g_queue_push_tail(&self->priv->window_pool, win);
+    } else {
+        g_object_unref(win);
+    }
+}
+
+static void virt_viewer_app_remove_nth_window(VirtViewerApp *self,
+                                              gint nth)
+{
+    VirtViewerWindow *win = virt_viewer_app_get_nth_window(self, nth);
+    if (!win)
+        return;
+    virt_viewer_app_remove_window(self, win, nth);
+}
+
+/* Kiosk windows outlive the session: they keep the last frame of their
+ * display on screen and are handed the display of the same monitor when
+ * the next session brings it up */
+static void virt_viewer_app_detach_nth_window(VirtViewerApp *self,
+                                              VirtViewerDisplay *display,
+                                              gint nth)
+{
+    VirtViewerWindow *win = virt_viewer_app_get_nth_window(self, nth);
+    GdkPixbuf *frame;
+
+    if (!win)
+        return;
+
+    frame = virt_viewer_display_get_pixbuf(display);
+    virt_viewer_notebook_set_frame(virt_viewer_window_get_notebook(win), frame);
+    if (frame)
+        g_object_unref(frame);
+
+    g_debug("Detach window %d %p", nth, win);
+    g_object_set_data(G_OBJECT(win), "virt-viewer-detached-nth", GINT_TO_POINTER(nth + 1));
+    virt_viewer_window_set_display(win, NULL);
+}
+
+/* The monitors the new session didn't bring back are gone, and so is the
+ * last frame they kept on screen */
+static gboolean
+virt_viewer_app_remove_detached_windows(gpointer user_data)
+{
+    VirtViewerApp *self = user_data;
+    GList *l, *next;
+
+    self->priv->detached_windows_id = 0;
+
+    for (l = self->priv->windows; l; l = next) {
+        VirtViewerWindow *win = VIRT_VIEWER_WINDOW(l->data);
+        gint detached = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(win),
+                                                          "virt-viewer-detached-nth"));
+
+        next = l->next;
+        if (detached == 0 || virt_viewer_window_get_display(win) != NULL)
+            continue;
+
+        g_object_set_data(G_OBJECT(win), "virt-viewer-detached-nth", NULL);
+        virt_viewer_notebook_set_frame(virt_viewer_window_get_notebook(win), NULL);
+        virt_viewer_app_remove_window(self, win, detached - 1);
+    }
+
+    return G_SOURCE_REMOVE;
 }
 
 static void
-virt_viewer_app_display_removed(VirtViewerSession *session G_GNUC_UNUSED,
+virt_viewer_app_display_removed(VirtViewerSession *session,
                                 VirtViewerDisplay *display,
                                 VirtViewerApp *self)
 {
     gint nth;
 
     g_object_get(display, "nth-display", &nth, NULL);
-    virt_viewer_app_remove_nth_window(self, nth);
+    /* a monitor the guest stops using goes away at once */
+    if (self->priv->kiosk && !self->priv->quitting &&
+        virt_viewer_session_get_clearing_displays(session) &&
+        !VIRT_VIEWER_IS_DISPLAY_VTE(display))
+        virt_viewer_app_detach_nth_window(self, display, nth);
+    else
+        virt_viewer_app_remove_nth_window(self, nth);
     g_hash_table_remove(self->priv->displays, GINT_TO_POINTER(nth));
     virt_viewer_app_update_menu_displays(self);
+    if (self->priv->dbus)
+        virt_viewer_dbus_emit_displays_changed(self->priv->dbus);
 }
 
 static void
@@ -1021,6 +1335,8 @@ virt_viewer_app_display_updated(VirtViewerSession *session G_GNUC_UNUSED,
                                 VirtViewerApp *self)
 {
     virt_viewer_app_update_menu_displays(self);
+    if (self->priv->dbus)
+        virt_viewer_dbus_emit_displays_changed(self->priv->dbus);
 }
 
 static void
@@ -1047,6 +1363,8 @@ virt_viewer_app_create_session(VirtViewerApp *self, const gchar *type, GError **
     g_return_val_if_fail(priv->session == NULL, FALSE);
     g_return_val_if_fail(type != NULL, FALSE);
 
+    priv->session_serial++;
+
 #ifdef HAVE_GTK_VNC
     if (g_ascii_strcasecmp(type, "vnc") == 0) {
         GtkWindow *window = virt_viewer_window_get_window(priv->main_window);
@@ -1073,6 +1391,8 @@ virt_viewer_app_create_session(VirtViewerApp *self, const gchar *type, GError **
         return FALSE;
     }
 
+    virt_viewer_session_set_trace_latency(priv->session, priv->trace_latency);
+
     g_signal_connect(priv->session, "session-initialized",
                      G_CALLBACK(virt_viewer_app_initialized), self);
     g_signal_connect(priv->session, "session-connected",
@@ -1116,6 +1436,29 @@ virt_viewer_app_default_open_connection(VirtViewerApp *self G_GNUC_UNUSED, int *
 }
 
 
+/* The URI is that of a display by default */
+static gboolean
+virt_viewer_app_default_set_connect_uri(VirtViewerApp *self, const gchar *uri,
+                                        GError **error G_GNUC_UNUSED)
+{
+    g_object_set(self, "guri", uri, NULL);
+    return TRUE;
+}
+
+/* Makes the next start connect to @uri, as if it was given on the command
+ * line */
+gboolean
+virt_viewer_app_set_connect_uri(VirtViewerApp *self, const gchar *uri, GError **error)
+{
+    VirtViewerAppClass *klass;
+
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), FALSE);
+    g_return_val_if_fail(uri != NULL, FALSE);
+    klass = VIRT_VIEWER_APP_GET_CLASS(self);
+
+    return klass->set_connect_uri(self, uri, error);
+}
+
 static int
 virt_viewer_app_open_connection(VirtViewerApp *self, int *fd)
 {
@@ -1128,6 +1471,105 @@ virt_viewer_app_open_connection(VirtViewerApp *self, int *fd)
 }
 
 
+/* Large enough for a full screen update of an uncompressed 4K display in a
+ * few reads */
+#define LOCAL_SOCKET_BUFFER (4 * 1024 * 1024)
+
+static void
+virt_viewer_app_tune_local_socket(VirtViewerApp *self, int fd)
+{
+#ifdef G_OS_UNIX
+    int size = LOCAL_SOCKET_BUFFER;
+
+    if (!virt_viewer_app_get_config_local_fast_path(self))
+        return;
+
+    /* the kernel caps these to its limits, that's still better than the
+     * default */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0)
+        g_debug("Unable to enlarge the socket buffers: %s", g_strerror(errno));
+#endif
+}
+
+/* The display server runs on this host, the session can skip work only
+ * networks need, and @fd can buffer more */
+static void
+virt_viewer_app_set_local(VirtViewerApp *self, int fd, gboolean local)
+{
+    if (!local || !virt_viewer_app_get_config_local_fast_path(self))
+        return;
+
+    g_debug("Display server on this host, using the local fast path");
+    virt_viewer_session_set_local(self->priv->session, TRUE);
+    if (fd >= 0)
+        virt_viewer_app_tune_local_socket(self, fd);
+}
+
+/* Puts a relay between the transport @fd and the session when asked to,
+ * returns the fd the session should use */
+static int
+virt_viewer_app_relay_fd(VirtViewerApp *self, int fd)
+{
+    VirtViewerAppPrivate *priv = self->priv;
+    VirtViewerRelay *relay;
+    GError *error = NULL;
+    int session_fd;
+
+    if (!priv->relay && priv->capture_file == NULL && !priv->emulate_wan)
+        return fd;
+
+    /* one file for all the connections of the session, and reconnections */
+    if (priv->capture_file != NULL && priv->capture == NULL) {
+        priv->capture = virt_viewer_capture_new(priv->capture_file, &error);
+        if (priv->capture == NULL) {
+            g_warning("Not capturing the connection: %s", error->message);
+            g_clear_error(&error);
+            g_clear_pointer(&priv->capture_file, g_free);
+        }
+    }
+
+    relay = virt_viewer_relay_new();
+    /* the capture is what the server sent, before the emulated network */
+    if (priv->capture != NULL)
+        virt_viewer_capture_add_relay(priv->capture, relay);
+    if (priv->emulate_wan)
+        virt_viewer_wan_add_relay(&priv->wan_profile, relay);
+    session_fd = virt_viewer_relay_start(relay, fd, &error);
+    if (session_fd < 0) {
+        g_warning("Not relaying the connection: %s", error->message);
+        g_clear_error(&error);
+        virt_viewer_relay_free(relay);
+        return fd;
+    }
+
+    priv->relays = g_list_prepend(priv->relays, relay);
+
+    return session_fd;
+}
+
+/* Bytes relayed for the current connection, FALSE when it isn't relayed */
+gboolean
+virt_viewer_app_get_relay_stats(VirtViewerApp *self,
+                                guint64 *bytes_to_server,
+                                guint64 *bytes_from_server)
+{
+    GList *l;
+
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), FALSE);
+
+    *bytes_to_server = *bytes_from_server = 0;
+    for (l = self->priv->relays; l != NULL; l = l->next) {
+        guint64 to_server, from_server;
+
+        virt_viewer_relay_get_stats(l->data, &to_server, &from_server);
+        *bytes_to_server += to_server;
+        *bytes_from_server += from_server;
+    }
+
+    return self->priv->relays != NULL;
+}
+
 #if defined(HAVE_SOCKETPAIR) && defined(HAVE_FORK)
 static void
 virt_viewer_app_channel_open(VirtViewerSession *session,
@@ -1148,7 +1590,7 @@ virt_viewer_app_channel_open(VirtViewerSession *session,
     priv = self->priv;
     if (priv->transport && g_ascii_strcasecmp(priv->transport, "ssh") == 0 &&
         !priv->direct && fd == -1) {
-        if ((fd = virt_viewer_app_open_tunnel_ssh(priv->host, priv->port, priv->user,
+        if ((fd = virt_viewer_app_open_tunnel_ssh(self, priv->host, priv->port, priv->user,
                                                   priv->ghost, priv->gport, priv->unixsock)) < 0) {
             error_message = g_strdup(_("Connect to ssh failed."));
             g_debug("channel open ssh tunnel: %s", error_message);
@@ -1160,6 +1602,8 @@ virt_viewer_app_channel_open(VirtViewerSession *session,
             g_free(error_message);
             error_message = g_strdup(error->message);
             g_debug("channel open unix socket: %s", error_message);
+        } else {
+            virt_viewer_app_tune_local_socket(self, fd);
         }
         g_clear_error(&error);
     }
@@ -1172,7 +1616,7 @@ virt_viewer_app_channel_open(VirtViewerSession *session,
         return;
     }
 
-    virt_viewer_session_channel_open_fd(session, channel, fd);
+    virt_viewer_session_channel_open_fd(session, channel, virt_viewer_app_relay_fd(self, fd));
 }
 #else
 static void
@@ -1189,11 +1633,14 @@ virt_viewer_app_default_activate(VirtViewerApp *self, GError **error)
 {
     VirtViewerAppPrivate *priv = self->priv;
     int fd = -1;
+    gboolean local;
 
     if (!virt_viewer_app_open_connection(self, &fd))
         return FALSE;
 
     g_debug("After open connection callback fd=%d", fd);
+    /* libvirt only hands display sockets to clients on its host */
+    local = fd >= 0;
 
 #if defined(HAVE_SOCKETPAIR) && defined(HAVE_FORK)
     if (priv->transport &&
@@ -1218,7 +1665,7 @@ virt_viewer_app_default_activate(VirtViewerApp *self, GError **error)
                               priv->host, p ? p : "");
         g_free(p);
 
-        if ((fd = virt_viewer_app_open_tunnel_ssh(priv->host, priv->port,
+        if ((fd = virt_viewer_app_open_tunnel_ssh(self, priv->host, priv->port,
                                                   priv->user, priv->ghost,
                                                   priv->gport, priv->unixsock)) < 0)
             return FALSE;
@@ -1227,17 +1674,21 @@ virt_viewer_app_default_activate(VirtViewerApp *self, GError **error)
                               priv->unixsock);
         if ((fd = virt_viewer_app_open_unix_sock(priv->unixsock, error)) < 0)
             return FALSE;
+        local = TRUE;
     }
 #endif
 
     if (fd >= 0) {
-        return virt_viewer_session_open_fd(VIRT_VIEWER_SESSION(priv->session), fd);
+        virt_viewer_app_set_local(self, fd, local);
+        return virt_viewer_session_open_fd(VIRT_VIEWER_SESSION(priv->session),
+                                           virt_viewer_app_relay_fd(self, fd));
     } else if (priv->guri) {
         virt_viewer_app_trace(self, "Opening connection to display at %s", priv->guri);
         return virt_viewer_session_open_uri(VIRT_VIEWER_SESSION(priv->session), priv->guri, error);
     } else if (priv->ghost) {
         virt_viewer_app_trace(self, "Opening direct TCP connection to display at %s:%s:%s",
                               priv->ghost, priv->gport, priv->gtlsport ? priv->gtlsport : "-1");
+        virt_viewer_app_set_local(self, -1, virt_viewer_util_is_loopback(priv->ghost));
         return virt_viewer_session_open_host(VIRT_VIEWER_SESSION(priv->session),
                                              priv->ghost, priv->gport, priv->gtlsport);
     } else {
@@ -1278,6 +1729,18 @@ virt_viewer_app_activate(VirtViewerApp *self, GError **error)
     return ret;
 }
 
+static void
+virt_viewer_app_clipboard_free(VirtViewerApp *self)
+{
+    VirtViewerAppPrivate *priv = self->priv;
+
+    g_free(priv->clipboard);
+    priv->clipboard = NULL;
+    priv->clipboard_len = 0;
+    g_free(priv->clipboard_utf8);
+    priv->clipboard_utf8 = NULL;
+}
+
 /* text was actually requested */
 static void
 virt_viewer_app_clipboard_copy(GtkClipboard *clipboard G_GNUC_UNUSED,
@@ -1287,7 +1750,24 @@ virt_viewer_app_clipboard_copy(GtkClipboard *clipboard G_GNUC_UNUSED,
 {
     VirtViewerAppPrivate *priv = self->priv;
 
-    gtk_selection_data_set_text(data, priv->clipboard, -1);
+    if (priv->clipboard == NULL)
+        return;
+
+    /* Converted on the first request only, many cut texts are never pasted */
+    if (priv->clipboard_utf8 == NULL)
+        priv->clipboard_utf8 = virt_viewer_util_latin1_to_utf8(priv->clipboard,
+                                                               priv->clipboard_len);
+
+    gtk_selection_data_set_text(data, priv->clipboard_utf8, -1);
+}
+
+/* Another application took the clipboard over, the text isn't needed anymore */
+static void
+virt_viewer_app_clipboard_clear(GtkClipboard *clipboard G_GNUC_UNUSED,
+                                VirtViewerApp *self)
+{
+    if (!self->priv->clipboard_setting)
+        virt_viewer_app_clipboard_free(self);
 }
 
 static void
@@ -1295,32 +1775,47 @@ virt_viewer_app_server_cut_text(VirtViewerSession *session G_GNUC_UNUSED,
                                 const gchar *text,
                                 VirtViewerApp *self)
 {
-    GtkClipboard *cb;
-    gsize a, b;
-    VirtViewerAppPrivate *priv = self->priv;
-    GtkTargetEntry targets[] = {
-        {g_strdup("UTF8_STRING"), 0, 0},
-        {g_strdup("COMPOUND_TEXT"), 0, 0},
-        {g_strdup("TEXT"), 0, 0},
-        {g_strdup("STRING"), 0, 0},
+    static const GtkTargetEntry targets[] = {
+        {(gchar *)"UTF8_STRING", 0, 0},
+        {(gchar *)"COMPOUND_TEXT", 0, 0},
+        {(gchar *)"TEXT", 0, 0},
+        {(gchar *)"STRING", 0, 0},
     };
+    VirtViewerAppPrivate *priv = self->priv;
+    GtkClipboard *cb;
+    gsize len, max_size;
 
     if (!text)
         return;
 
-    g_free (priv->clipboard);
-    priv->clipboard = g_convert (text, -1, "utf-8", "iso8859-1", &a, &b, NULL);
+    cb = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
+    len = strlen(text);
+    max_size = (gsize)virt_viewer_app_get_config_uint(self, "clipboard-max-size", 16 * 1024) * 1024;
+    if (max_size > 0 && len > max_size) {
+        g_debug("Truncating %" G_GSIZE_FORMAT " bytes of cut text to %" G_GSIZE_FORMAT,
+                len, max_size);
+        len = max_size;
+    }
 
-    if (priv->clipboard) {
-        cb = gtk_clipboard_get (GDK_SELECTION_CLIPBOARD);
+    /* Guests tend to announce the same text again and again, there's nothing
+     * to do as long as it is still the one on our clipboard */
+    if (priv->clipboard != NULL && priv->clipboard_len == len &&
+        memcmp(priv->clipboard, text, len) == 0 &&
+        gtk_clipboard_get_owner(cb) == G_OBJECT(self))
+        return;
 
-        gtk_clipboard_set_with_owner (cb,
-                                      targets,
-                                      G_N_ELEMENTS(targets),
-                                      (GtkClipboardGetFunc)virt_viewer_app_clipboard_copy,
-                                      NULL,
-                                      G_OBJECT (self));
-    }
+    virt_viewer_app_clipboard_free(self);
+    priv->clipboard = g_strndup(text, len);
+    priv->clipboard_len = len;
+
+    priv->clipboard_setting = TRUE;
+    gtk_clipboard_set_with_owner(cb,
+                                 targets,
+                                 G_N_ELEMENTS(targets),
+                                 (GtkClipboardGetFunc)virt_viewer_app_clipboard_copy,
+                                 (GtkClipboardClearFunc)virt_viewer_app_clipboard_clear,
+                                 G_OBJECT(self));
+    priv->clipboard_setting = FALSE;
 }
 
 
@@ -1392,9 +1887,16 @@ virt_viewer_app_deactivate(VirtViewerApp *self, gboolean connect_error)
     if (!priv->active)
         return;
 
+    if (priv->detached_windows_id != 0) {
+        g_source_remove(priv->detached_windows_id);
+        priv->detached_windows_id = 0;
+    }
+
     if (priv->session) {
         virt_viewer_session_close(VIRT_VIEWER_SESSION(priv->session));
     }
+    g_list_free_full(priv->relays, (GDestroyNotify)virt_viewer_relay_free);
+    priv->relays = NULL;
 
     priv->connected = FALSE;
     priv->active = FALSE;
@@ -1424,10 +1926,18 @@ virt_viewer_app_connected(VirtViewerSession *session G_GNUC_UNUSED,
 
     priv->connected = TRUE;
 
+    if (priv->kiosk && priv->detached_windows_id == 0)
+        priv->detached_windows_id = g_timeout_add_seconds(DETACHED_WINDOWS_TIMEOUT,
+                                                          virt_viewer_app_remove_detached_windows,
+                                                          self);
+
     if (self->priv->kiosk)
         virt_viewer_app_show_status(self, "");
     else
         virt_viewer_app_show_status(self, _("Connected to graphic server"));
+
+    if (priv->dbus)
+        virt_viewer_dbus_emit_connected(priv->dbus);
 }
 
 
@@ -1446,6 +1956,13 @@ virt_viewer_app_disconnected(VirtViewerSession *session G_GNUC_UNUSED, const gch
     VirtViewerAppPrivate *priv = self->priv;
     gboolean connect_error = !priv->connected && !priv->cancelled;
 
+    if (priv->dbus)
+        virt_viewer_dbus_emit_disconnected(priv->dbus, msg);
+
+    /* the rest of the text must not go to whatever the next connection
+     * shows, a login prompt for instance */
+    g_list_foreach(priv->windows, stop_typing_one_window, self);
+
     if (!priv->kiosk)
         virt_viewer_app_hide_all_windows(self);
     else if (priv->cancelled)
@@ -1694,6 +2211,22 @@ virt_viewer_app_dispose (GObject *object)
         g_list_free_full(tmp, g_object_unref);
     }
 
+    if (priv->window_pool_fill_id != 0) {
+        g_source_remove(priv->window_pool_fill_id);
+        priv->window_pool_fill_id = 0;
+    }
+    if (priv->detached_windows_id != 0) {
+        g_source_remove(priv->detached_windows_id);
+        priv->detached_windows_id = 0;
+    }
+    g_queue_foreach(&priv->window_pool, (GFunc)g_object_unref, NULL);
+    g_queue_clear(&priv->window_pool);
+    g_clear_pointer(&priv->dbus, virt_viewer_dbus_free);
+    virt_viewer_app_clipboard_free(self);
+    g_list_free_full(priv->relays, (GDestroyNotify)virt_viewer_relay_free);
+    priv->relays = NULL;
+    g_clear_pointer(&priv->capture, virt_viewer_capture_unref);
+
     if (priv->displays) {
         GHashTable *tmp = priv->displays;
         /* null-ify before unrefing, because we need
@@ -1717,6 +2250,8 @@ virt_viewer_app_dispose (GObject *object)
     priv->title = NULL;
     g_free(priv->uuid);
     priv->uuid = NULL;
+    g_clear_pointer(&priv->console_log_dir, g_free);
+    g_clear_pointer(&priv->capture_file, g_free);
     g_free(priv->config_file);
     priv->config_file = NULL;
     g_clear_pointer(&priv->config, g_key_file_free);
@@ -1755,6 +2290,12 @@ static gboolean opt_debug = FALSE;
 static gboolean opt_fullscreen = FALSE;
 static gboolean opt_kiosk = FALSE;
 static gboolean opt_kiosk_quit = FALSE;
+static gchar *opt_console_log = NULL;
+static gboolean opt_trace_latency = FALSE;
+static gboolean opt_relay = FALSE;
+static gchar *opt_capture = NULL;
+static gboolean opt_emulate_wan = FALSE;
+static VirtViewerWanProfile opt_wan_profile;
 
 static void
 title_maybe_changed(VirtViewerApp *self, GParamSpec* pspec G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
@@ -1861,6 +2402,18 @@ virt_viewer_app_on_application_startup(GApplication *app)
 
     self->priv->verbose = opt_verbose;
     self->priv->quit_on_disconnect = opt_kiosk ? opt_kiosk_quit : TRUE;
+    self->priv->console_log_dir = g_strdup(opt_console_log);
+    self->priv->trace_latency = opt_trace_latency;
+    self->priv->relay = opt_relay;
+    self->priv->capture_file = g_strdup(opt_capture);
+    self->priv->emulate_wan = opt_emulate_wan;
+    self->priv->wan_profile = opt_wan_profile;
+    if (opt_emulate_wan) {
+        gchar *profile = virt_viewer_wan_profile_to_string(&opt_wan_profile);
+
+        g_debug("Emulating a network with %s", profile);
+        g_free(profile);
+    }
 
     self->priv->main_window = virt_viewer_app_window_new(self,
                                                          virt_viewer_app_get_first_monitor(self));
@@ -1884,6 +2437,7 @@ virt_viewer_app_on_application_startup(GApplication *app)
     gtk_accel_map_add_entry("<virt-viewer>/view/zoom-reset", GDK_KEY_0, GDK_CONTROL_MASK);
     gtk_accel_map_add_entry("<virt-viewer>/view/zoom-out", GDK_KEY_minus, GDK_CONTROL_MASK);
     gtk_accel_map_add_entry("<virt-viewer>/view/zoom-in", GDK_KEY_plus, GDK_CONTROL_MASK);
+    gtk_accel_map_add_entry("<virt-viewer>/view/find", GDK_KEY_f, GDK_CONTROL_MASK | GDK_SHIFT_MASK);
     gtk_accel_map_add_entry("<virt-viewer>/send/secure-attention", GDK_KEY_End, GDK_CONTROL_MASK | GDK_MOD1_MASK);
 
     // Restore initial state of config-share-clipboard property from config and notify about it
@@ -1949,6 +2503,36 @@ end:
     return ret;
 }
 
+static gboolean
+virt_viewer_app_dbus_register(GApplication *app,
+                              GDBusConnection *connection,
+                              const gchar *object_path,
+                              GError **error)
+{
+    VirtViewerApp *self = VIRT_VIEWER_APP(app);
+
+    if (!G_APPLICATION_CLASS(virt_viewer_app_parent_class)->dbus_register(app, connection,
+                                                                          object_path, error))
+        return FALSE;
+
+    self->priv->dbus = virt_viewer_dbus_new(self, connection, object_path, error);
+
+    return self->priv->dbus != NULL;
+}
+
+static void
+virt_viewer_app_dbus_unregister(GApplication *app,
+                                GDBusConnection *connection,
+                                const gchar *object_path)
+{
+    VirtViewerApp *self = VIRT_VIEWER_APP(app);
+
+    g_clear_pointer(&self->priv->dbus, virt_viewer_dbus_free);
+
+    G_APPLICATION_CLASS(virt_viewer_app_parent_class)->dbus_unregister(app, connection,
+                                                                       object_path);
+}
+
 static void
 virt_viewer_app_class_init (VirtViewerAppClass *klass)
 {
@@ -1961,6 +2545,8 @@ virt_viewer_app_class_init (VirtViewerAppClass *klass)
 
     g_app_class->local_command_line = virt_viewer_app_local_command_line;
     g_app_class->startup = virt_viewer_app_on_application_startup;
+    g_app_class->dbus_register = virt_viewer_app_dbus_register;
+    g_app_class->dbus_unregister = virt_viewer_app_dbus_unregister;
     g_app_class->command_line = NULL; /* inhibit GApplication default handler */
 
     klass->start = virt_viewer_app_default_start;
@@ -1969,6 +2555,7 @@ virt_viewer_app_class_init (VirtViewerAppClass *klass)
     klass->deactivated = virt_viewer_app_default_deactivated;
     klass->open_connection = virt_viewer_app_default_open_connection;
     klass->add_option_entries = virt_viewer_app_add_option_entries;
+    klass->set_connect_uri = virt_viewer_app_default_set_connect_uri;
 
     g_object_class_install_property(object_class,
                                     PROP_VERBOSE,
@@ -2111,6 +2698,29 @@ virt_viewer_app_set_direct(VirtViewerApp *self, gboolean direct)
     self->priv->direct = direct;
 }
 
+void
+virt_viewer_app_set_ssh_compression(VirtViewerApp *self, gboolean compression)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_APP(self));
+
+    self->priv->ssh_compression = compression;
+}
+
+/* Totals of the SSH tunnels of the latest session whose tunnels closed,
+ * ssh only reports them when it exits. FALSE when none was compressed. */
+gboolean
+virt_viewer_app_get_ssh_compression_stats(VirtViewerApp *self,
+                                          guint64 *raw_bytes,
+                                          guint64 *compressed_bytes)
+{
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), FALSE);
+
+    *raw_bytes = self->priv->ssh_raw_bytes;
+    *compressed_bytes = self->priv->ssh_compressed_bytes;
+
+    return self->priv->ssh_raw_bytes != 0;
+}
+
 gboolean virt_viewer_app_get_direct(VirtViewerApp *self)
 {
     g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), FALSE);
@@ -2335,8 +2945,92 @@ update_menu_displays_sort(gconstpointer a, gconstpointer b)
         return 0;
 }
 
+typedef struct {
+    VirtViewerDisplay *display;
+    gchar *label;
+    gboolean use_underline;
+    gboolean active;
+    gboolean sensitive;
+} DisplayMenuEntry;
+
+static void
+display_menu_entry_clear(gpointer data)
+{
+    DisplayMenuEntry *entry = data;
+
+    g_free(entry->label);
+}
+
+/* The state of the "Displays" submenu, which is the same for every window */
+static GArray *
+virt_viewer_app_get_display_menu_entries(VirtViewerApp *self)
+{
+    GArray *entries = g_array_new(FALSE, TRUE, sizeof(DisplayMenuEntry));
+    GHashTable *nth_windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GList *keys = g_hash_table_get_keys(self->priv->displays);
+    GList *tmp;
+
+    g_array_set_clear_func(entries, display_menu_entry_clear);
+
+    /* Same window as virt_viewer_app_get_nth_window() would find, without
+     * walking the window list for every display */
+    for (tmp = g_list_last(self->priv->windows); tmp; tmp = tmp->prev) {
+        VirtViewerDisplay *display = virt_viewer_window_get_display(tmp->data);
+
+        if (display && !VIRT_VIEWER_IS_DISPLAY_VTE(display))
+            g_hash_table_insert(nth_windows,
+                                GINT_TO_POINTER(virt_viewer_display_get_nth(display)),
+                                tmp->data);
+    }
+
+    keys = g_list_sort(keys, update_menu_displays_sort);
+    for (tmp = keys; tmp; tmp = tmp->next) {
+        int nth = GPOINTER_TO_INT(tmp->data);
+        VirtViewerWindow *vwin = g_hash_table_lookup(nth_windows, tmp->data);
+        DisplayMenuEntry entry = { NULL, };
+
+        entry.display = VIRT_VIEWER_DISPLAY(g_hash_table_lookup(self->priv->displays, tmp->data));
+        entry.label = g_strdup_printf(_("Display _%d"), nth + 1);
+        entry.use_underline = TRUE;
+        entry.active = vwin && gtk_widget_get_visible(GTK_WIDGET(virt_viewer_window_get_window(vwin)));
+
+        entry.sensitive = entry.active;
+        if (entry.display) {
+            guint hint = virt_viewer_display_get_show_hint(entry.display);
+
+            if (hint & VIRT_VIEWER_DISPLAY_SHOW_HINT_READY)
+                entry.sensitive = TRUE;
+
+            if (virt_viewer_display_get_selectable(entry.display))
+                entry.sensitive = TRUE;
+        }
+
+        g_array_append_val(entries, entry);
+    }
+
+    for (tmp = self->priv->windows; tmp; tmp = tmp->next) {
+        VirtViewerWindow *win = VIRT_VIEWER_WINDOW(tmp->data);
+        VirtViewerDisplay *display = virt_viewer_window_get_display(win);
+        DisplayMenuEntry entry = { NULL, };
+
+        if (!VIRT_VIEWER_IS_DISPLAY_VTE(display))
+            continue;
+
+        entry.display = display;
+        g_object_get(display, "name", &entry.label, NULL);
+        entry.active = gtk_widget_get_visible(GTK_WIDGET(virt_viewer_window_get_window(win)));
+        entry.sensitive = TRUE;
+        g_array_append_val(entries, entry);
+    }
+
+    g_list_free(keys);
+    g_hash_table_unref(nth_windows);
+
+    return entries;
+}
+
 static GtkMenuShell *
-window_empty_display_submenu(VirtViewerWindow *window)
+window_get_display_submenu(VirtViewerWindow *window)
 {
     /* Because of what apparently is a gtk+2 bug (rhbz#922712), we
      * cannot recreate the submenu every time we need to refresh it,
@@ -2349,102 +3043,133 @@ window_empty_display_submenu(VirtViewerWindow *window)
     GtkMenuShell *submenu;
 
     submenu = GTK_MENU_SHELL(gtk_menu_item_get_submenu(menu));
-    if (submenu) {
-        GList *subitems;
-        GList *it;
-        subitems = gtk_container_get_children(GTK_CONTAINER(submenu));
-        for (it = subitems; it != NULL; it = it->next) {
-            gtk_container_remove(GTK_CONTAINER(submenu), GTK_WIDGET(it->data));
-        }
-        g_list_free(subitems);
-    } else {
+    if (submenu == NULL) {
         submenu = GTK_MENU_SHELL(gtk_menu_new());
         gtk_menu_item_set_submenu(menu, GTK_WIDGET(submenu));
+        /* display -> its menu item, the display is referenced so that its
+         * address can't be reused by a new display while the item exists */
+        g_object_set_data_full(G_OBJECT(submenu), "virt-viewer-display-items",
+                               g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                     g_object_unref, NULL),
+                               (GDestroyNotify)g_hash_table_unref);
+        g_object_set_data_full(G_OBJECT(submenu), "virt-viewer-display-order",
+                               g_ptr_array_new(), (GDestroyNotify)g_ptr_array_unref);
     }
 
     return submenu;
 }
 
+/* Drops the items, and with them the references to the displays, of a
+ * window that is no longer in use */
 static void
-window_update_menu_displays_cb(gpointer value,
-                               gpointer user_data)
+window_clear_display_submenu(VirtViewerWindow *window)
 {
-    VirtViewerApp *self = VIRT_VIEWER_APP(user_data);
-    GtkMenuShell *submenu;
-    GList *keys = g_hash_table_get_keys(self->priv->displays);
-    GList *tmp;
-    gboolean sensitive;
-
-    keys = g_list_sort(keys, update_menu_displays_sort);
-    submenu = window_empty_display_submenu(VIRT_VIEWER_WINDOW(value));
+    GtkWidget *submenu = gtk_menu_item_get_submenu(virt_viewer_window_get_menu_displays(window));
+    GHashTable *items;
+    GHashTableIter iter;
+    gpointer item;
 
-    sensitive = (keys != NULL);
-    virt_viewer_window_set_menu_displays_sensitive(VIRT_VIEWER_WINDOW(value), sensitive);
+    if (submenu == NULL)
+        return;
 
-    tmp = keys;
-    while (tmp) {
-        int nth = GPOINTER_TO_INT(tmp->data);
-        VirtViewerWindow *vwin = virt_viewer_app_get_nth_window(self, nth);
-        VirtViewerDisplay *display = VIRT_VIEWER_DISPLAY(g_hash_table_lookup(self->priv->displays, tmp->data));
-        GtkWidget *item;
-        gboolean visible;
-        gchar *label;
+    items = g_object_get_data(G_OBJECT(submenu), "virt-viewer-display-items");
+    g_hash_table_iter_init(&iter, items);
+    while (g_hash_table_iter_next(&iter, NULL, &item)) {
+        gtk_widget_destroy(GTK_WIDGET(item));
+        g_hash_table_iter_remove(&iter);
+    }
+    g_ptr_array_set_size(g_object_get_data(G_OBJECT(submenu), "virt-viewer-display-order"), 0);
+}
 
-        label = g_strdup_printf(_("Display _%d"), nth + 1);
-        item = gtk_check_menu_item_new_with_mnemonic(label);
-        g_free(label);
+/* Patches the existing menu items rather than recreating them, only
+ * items of added or removed displays are created or destroyed */
+static void
+window_update_menu_displays(VirtViewerWindow *window,
+                            gboolean sensitive,
+                            GArray *entries,
+                            GHashTable *entry_displays)
+{
+    GtkMenuShell *submenu = window_get_display_submenu(window);
+    GHashTable *items = g_object_get_data(G_OBJECT(submenu), "virt-viewer-display-items");
+    GPtrArray *order = g_object_get_data(G_OBJECT(submenu), "virt-viewer-display-order");
+    gboolean reorder = order->len != entries->len;
+    GHashTableIter iter;
+    gpointer display, item;
+    guint i;
+
+    virt_viewer_window_set_menu_displays_sensitive(window, sensitive);
+
+    g_hash_table_iter_init(&iter, items);
+    while (g_hash_table_iter_next(&iter, &display, &item)) {
+        if (!g_hash_table_contains(entry_displays, display)) {
+            gtk_widget_destroy(GTK_WIDGET(item));
+            g_hash_table_iter_remove(&iter);
+        }
+    }
 
-        visible = vwin && gtk_widget_get_visible(GTK_WIDGET(virt_viewer_window_get_window(vwin)));
-        gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item), visible);
+    for (i = 0; i < entries->len; i++) {
+        DisplayMenuEntry *entry = &g_array_index(entries, DisplayMenuEntry, i);
 
-        sensitive = visible;
-        if (display) {
-            guint hint = virt_viewer_display_get_show_hint(display);
+        item = g_hash_table_lookup(items, entry->display);
+        if (item == NULL) {
+            item = gtk_check_menu_item_new();
+            gtk_menu_item_set_use_underline(GTK_MENU_ITEM(item), entry->use_underline);
+            virt_viewer_signal_connect_object(G_OBJECT(item), "toggled",
+                                              G_CALLBACK(menu_display_visible_toggled_cb),
+                                              entry->display, 0);
+            gtk_menu_shell_append(submenu, item);
+            gtk_widget_show(item);
+            g_hash_table_insert(items, g_object_ref(entry->display), item);
+        }
 
-            if (hint & VIRT_VIEWER_DISPLAY_SHOW_HINT_READY)
-                sensitive = TRUE;
+        if (g_strcmp0(gtk_menu_item_get_label(GTK_MENU_ITEM(item)), entry->label) != 0)
+            gtk_menu_item_set_label(GTK_MENU_ITEM(item), entry->label);
 
-            if (virt_viewer_display_get_selectable(display))
-                sensitive = TRUE;
-        }
-        gtk_widget_set_sensitive(item, sensitive);
+        g_signal_handlers_block_by_func(item, menu_display_visible_toggled_cb, entry->display);
+        gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item), entry->active);
+        g_signal_handlers_unblock_by_func(item, menu_display_visible_toggled_cb, entry->display);
+        gtk_widget_set_sensitive(item, entry->sensitive);
 
-        virt_viewer_signal_connect_object(G_OBJECT(item), "toggled",
-                                          G_CALLBACK(menu_display_visible_toggled_cb), display, 0);
-        gtk_menu_shell_append(submenu, item);
-        tmp = tmp->next;
+        if (!reorder && g_ptr_array_index(order, i) != entry->display)
+            reorder = TRUE;
     }
 
-    for (tmp = self->priv->windows; tmp; tmp = tmp->next) {
-        VirtViewerWindow *win = VIRT_VIEWER_WINDOW(tmp->data);
-        VirtViewerDisplay *display = virt_viewer_window_get_display(win);
-
-        if (VIRT_VIEWER_IS_DISPLAY_VTE(display)) {
-            gchar *name = NULL;
-            GtkWidget *item;
+    if (!reorder)
+        return;
 
-            g_object_get(display, "name", &name, NULL);
-            item = gtk_check_menu_item_new_with_label(name);
-            g_free(name);
+    g_ptr_array_set_size(order, 0);
+    for (i = 0; i < entries->len; i++) {
+        DisplayMenuEntry *entry = &g_array_index(entries, DisplayMenuEntry, i);
 
-            virt_viewer_signal_connect_object(G_OBJECT(item), "toggled",
-                G_CALLBACK(menu_display_visible_toggled_cb), display, 0);
-            gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item),
-                gtk_widget_get_visible(GTK_WIDGET(virt_viewer_window_get_window(win))));
-            gtk_menu_shell_append(submenu, item);
-        }
+        gtk_menu_reorder_child(GTK_MENU(submenu),
+                               g_hash_table_lookup(items, entry->display), i);
+        g_ptr_array_add(order, entry->display);
     }
-
-    gtk_widget_show_all(GTK_WIDGET(submenu));
-    g_list_free(keys);
 }
 
 static void
 virt_viewer_app_update_menu_displays(VirtViewerApp *self)
 {
-    if (!self->priv->windows)
+    GHashTable *entry_displays;
+    GArray *entries;
+    GList *l;
+    guint i;
+
+    if (!self->priv->windows || !self->priv->displays)
         return;
-    g_list_foreach(self->priv->windows, window_update_menu_displays_cb, self);
+
+    entries = virt_viewer_app_get_display_menu_entries(self);
+    entry_displays = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = 0; i < entries->len; i++)
+        g_hash_table_add(entry_displays, g_array_index(entries, DisplayMenuEntry, i).display);
+
+    for (l = self->priv->windows; l; l = l->next)
+        window_update_menu_displays(VIRT_VIEWER_WINDOW(l->data),
+                                    g_hash_table_size(self->priv->displays) > 0,
+                                    entries, entry_displays);
+
+    g_hash_table_unref(entry_displays);
+    g_array_unref(entries);
 }
 
 void
@@ -2569,6 +3294,30 @@ virt_viewer_app_get_windows(VirtViewerApp *self)
     return self->priv->windows;
 }
 
+static gint
+display_nth_cmp(gconstpointer a, gconstpointer b)
+{
+    return virt_viewer_display_get_nth(VIRT_VIEWER_DISPLAY(a)) -
+           virt_viewer_display_get_nth(VIRT_VIEWER_DISPLAY(b));
+}
+
+/**
+ * virt_viewer_app_get_displays:
+ *
+ * Returns: (transfer container): the graphical displays of the session,
+ * ordered by number. Free the list with g_list_free().
+ */
+GList*
+virt_viewer_app_get_displays(VirtViewerApp *self)
+{
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), NULL);
+
+    if (self->priv->displays == NULL)
+        return NULL;
+
+    return g_list_sort(g_hash_table_get_values(self->priv->displays), display_nth_cmp);
+}
+
 static void
 share_folder_changed(VirtViewerApp *self)
 {
@@ -2586,14 +3335,17 @@ static GtkWidget *
 virt_viewer_app_get_preferences(VirtViewerApp *self)
 {
     VirtViewerSession *session = virt_viewer_app_get_session(self);
-    GtkBuilder *builder = virt_viewer_util_load_ui("virt-viewer-preferences.ui");
-    gboolean can_share_folder = virt_viewer_session_can_share_folder(session);
+    GtkBuilder *builder;
+    gboolean can_share_folder;
     GtkWidget *preferences = self->priv->preferences;
     gchar *path;
 
+    /* Only built the first time the dialog is shown */
     if (preferences)
-        goto end;
+        return preferences;
 
+    builder = virt_viewer_util_load_ui("virt-viewer-preferences.ui");
+    can_share_folder = virt_viewer_session_can_share_folder(session);
     gtk_builder_connect_signals(builder, self);
 
     preferences = GTK_WIDGET(gtk_builder_get_object(builder, "preferences"));
@@ -2678,6 +3430,19 @@ option_kiosk_quit(G_GNUC_UNUSED const gchar *option_name,
     return FALSE;
 }
 
+static gboolean
+option_emulate_wan(G_GNUC_UNUSED const gchar *option_name,
+                   const gchar *value,
+                   G_GNUC_UNUSED gpointer data, GError **error)
+{
+    if (!virt_viewer_wan_profile_parse(value, &opt_wan_profile, error))
+        return FALSE;
+
+    opt_emulate_wan = TRUE;
+
+    return TRUE;
+}
+
 static void
 virt_viewer_app_add_option_entries(G_GNUC_UNUSED VirtViewerApp *self,
                                    G_GNUC_UNUSED GOptionContext *context,
@@ -2700,6 +3465,16 @@ virt_viewer_app_add_option_entries(G_GNUC_UNUSED VirtViewerApp *self,
           N_("Display verbose information"), NULL },
         { "debug", '\0', 0, G_OPTION_ARG_NONE, &opt_debug,
           N_("Display debugging information"), NULL },
+        { "console-log", '\0', 0, G_OPTION_ARG_FILENAME, &opt_console_log,
+          N_("Save the output of text consoles to files in DIRECTORY"), N_("DIRECTORY") },
+        { "trace-latency", '\0', 0, G_OPTION_ARG_NONE, &opt_trace_latency,
+          N_("Measure how long keyboard and mouse input takes to reach the guest"), NULL },
+        { "relay", '\0', 0, G_OPTION_ARG_NONE, &opt_relay,
+          N_("Forward the display connection through a relay"), NULL },
+        { "capture", '\0', 0, G_OPTION_ARG_FILENAME, &opt_capture,
+          N_("Record the display connection to FILE"), N_("FILE") },
+        { "emulate-wan", '\0', 0, G_OPTION_ARG_CALLBACK, option_emulate_wan,
+          N_("Slow the display connection down like a remote network"), N_("PROFILE") },
         { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
     };
 
@@ -2738,6 +3513,199 @@ void virt_viewer_app_set_config_share_clipboard(VirtViewerApp *self, gboolean en
     g_object_notify(G_OBJECT(self), "config-share-clipboard");
 }
 
+/* Whether same host connections get the local fast path */
+gboolean virt_viewer_app_get_config_local_fast_path(VirtViewerApp *self)
+{
+    VirtViewerAppPrivate *priv = self->priv;
+
+    GError *error = NULL;
+    gboolean local_fast_path;
+
+    local_fast_path = g_key_file_get_boolean(priv->config,
+                                             "virt-viewer", "local-fast-path", &error);
+
+    if (error) {
+        local_fast_path = TRUE;
+        g_clear_error(&error);
+    }
+
+    return local_fast_path;
+}
+
+/* Libvirt URIs can have the '=', '[' and ']' GKeyFile doesn't accept in
+ * key names, they are percent-encoded */
+static gchar *connection_paths_key(const gchar *uri)
+{
+    return g_uri_escape_string(uri, NULL, FALSE);
+}
+
+/* Connection paths of virt-viewer to the displays of the hypervisor at
+ * @uri, fastest first, NULL when they weren't measured */
+gchar **virt_viewer_app_get_config_connection_paths(VirtViewerApp *self, const gchar *uri)
+{
+    gchar *key;
+    gchar **paths;
+
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), NULL);
+    g_return_val_if_fail(uri != NULL, NULL);
+
+    key = connection_paths_key(uri);
+    paths = g_key_file_get_string_list(self->priv->config,
+                                       "connection-paths", key, NULL, NULL);
+    g_free(key);
+
+    return paths;
+}
+
+void virt_viewer_app_set_config_connection_paths(VirtViewerApp *self,
+                                                 const gchar *uri,
+                                                 const gchar * const *paths)
+{
+    gchar *key;
+
+    g_return_if_fail(VIRT_VIEWER_IS_APP(self));
+    g_return_if_fail(uri != NULL);
+    g_return_if_fail(paths != NULL);
+
+    key = connection_paths_key(uri);
+    g_key_file_set_string_list(self->priv->config, "connection-paths", key,
+                               paths, g_strv_length((gchar **)paths));
+    g_free(key);
+    /* measuring doesn't end with the usual quit */
+    virt_viewer_app_save_config(self);
+}
+
+/* Maximum number of file transfers the spice session runs at once */
+guint virt_viewer_app_get_config_max_file_transfers(VirtViewerApp *self)
+{
+    VirtViewerAppPrivate *priv = self->priv;
+
+    GError *error = NULL;
+    gint max_transfers;
+
+    max_transfers = g_key_file_get_integer(priv->config,
+                                           "virt-viewer", "max-file-transfers", &error);
+
+    if (error || max_transfers <= 0) {
+        max_transfers = 4;
+        g_clear_error(&error);
+    }
+
+    return max_transfers;
+}
+
+static guint
+virt_viewer_app_get_config_uint(VirtViewerApp *self, const gchar *key, guint default_value)
+{
+    GError *error = NULL;
+    gint value;
+
+    value = g_key_file_get_integer(self->priv->config, "virt-viewer", key, &error);
+    if (error || value < 0) {
+        value = default_value;
+        g_clear_error(&error);
+    }
+
+    return value;
+}
+
+/* Scrollback lines of text consoles, -1 when unlimited */
+glong virt_viewer_app_get_config_console_scrollback(VirtViewerApp *self)
+{
+    VirtViewerAppPrivate *priv = self->priv;
+    GError *error = NULL;
+    gint lines, size;
+    glong scrollback;
+
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), -1);
+
+    lines = g_key_file_get_integer(priv->config, "virt-viewer", "console-scrollback-lines", &error);
+    if (error) {
+        lines = 10000;
+        g_clear_error(&error);
+    }
+    scrollback = lines < 0 ? -1 : lines;
+
+    /* The size limit is converted assuming full 80 column lines */
+    size = g_key_file_get_integer(priv->config, "virt-viewer", "console-scrollback-size", &error);
+    if (error) {
+        g_clear_error(&error);
+    } else if (size > 0) {
+        glong size_lines = (glong)size * 1024 / 81;
+
+        if (scrollback < 0 || size_lines < scrollback)
+            scrollback = size_lines;
+    }
+
+    return scrollback;
+}
+
+/**
+ * virt_viewer_app_open_console_log:
+ * @self: the app
+ * @name: name of the console, such as the SPICE port name
+ *
+ * Returns: a log for the console output, or %NULL if console logging
+ * was not requested with --console-log
+ */
+VirtViewerConsoleLog *virt_viewer_app_open_console_log(VirtViewerApp *self, const gchar *name)
+{
+    VirtViewerAppPrivate *priv = self->priv;
+    VirtViewerConsoleLog *log;
+    gchar *basename, *path;
+    guint max_size;
+
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), NULL);
+    g_return_val_if_fail(name != NULL, NULL);
+
+    if (priv->console_log_dir == NULL)
+        return NULL;
+
+    if (g_mkdir_with_parents(priv->console_log_dir, 0700) < 0) {
+        g_warning("Unable to create console log directory %s: %s",
+                  priv->console_log_dir, g_strerror(errno));
+        return NULL;
+    }
+
+    basename = g_strdup_printf("%s-%s.log",
+                               priv->guest_name ? priv->guest_name :
+                               priv->uuid ? priv->uuid : "console", name);
+    g_strdelimit(basename, "/\\:*?\"<>| ", '_');
+    path = g_build_filename(priv->console_log_dir, basename, NULL);
+
+    /* size in MiB */
+    max_size = virt_viewer_app_get_config_uint(self, "console-log-max-size", 16);
+    log = virt_viewer_console_log_new(path, (gsize)max_size * 1024 * 1024,
+                                      virt_viewer_app_get_config_uint(self, "console-log-max-files", 4));
+
+    g_free(basename);
+    g_free(path);
+
+    return log;
+}
+
+/* Types @text into @display as key presses, returns how many characters
+ * can't be typed */
+guint virt_viewer_app_type_text(VirtViewerApp *self,
+                                VirtViewerDisplay *display,
+                                const gchar *text)
+{
+    g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), 0);
+
+    /* characters per second */
+    return virt_viewer_typer_start(display, text,
+                                   virt_viewer_app_get_config_uint(self, "type-rate", 50));
+}
+
+/* Drops what virt_viewer_app_type_text() didn't type into @display yet */
+void virt_viewer_app_stop_typing(VirtViewerApp *self,
+                                 VirtViewerDisplay *display)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_APP(self));
+
+    virt_viewer_typer_stop(display);
+}
+
 gboolean virt_viewer_app_get_supports_share_clipboard(VirtViewerApp *self)
 {
     g_return_val_if_fail(VIRT_VIEWER_IS_APP(self), FALSE);
@@ -25,6 +25,7 @@
 
 #include <glib-object.h>
 #include <gtk/gtk.h>
+#include "virt-viewer-console-log.h"
 #include "virt-viewer-window.h"
 
 G_BEGIN_DECLS
@@ -53,6 +54,7 @@ typedef struct {
     void (*deactivated) (VirtViewerApp *self, gboolean connect_error);
     gboolean (*open_connection)(VirtViewerApp *self, int *fd);
     void (*add_option_entries)(VirtViewerApp *self, GOptionContext *context, GOptionGroup *group);
+    gboolean (*set_connect_uri)(VirtViewerApp *self, const gchar *uri, GError **error);
 } VirtViewerAppClass;
 
 GType virt_viewer_app_get_type (void);
@@ -64,12 +66,14 @@ VirtViewerWindow* virt_viewer_app_get_main_window(VirtViewerApp *self);
 void virt_viewer_app_trace(VirtViewerApp *self, const char *fmt, ...);
 void virt_viewer_app_simple_message_dialog(VirtViewerApp *self, const char *fmt, ...);
 gboolean virt_viewer_app_is_active(VirtViewerApp *app);
+gboolean virt_viewer_app_set_connect_uri(VirtViewerApp *self, const gchar *uri, GError **error);
 void virt_viewer_app_free_connect_info(VirtViewerApp *self);
 gboolean virt_viewer_app_create_session(VirtViewerApp *self, const gchar *type, GError **error);
 gboolean virt_viewer_app_activate(VirtViewerApp *self, GError **error);
 gboolean virt_viewer_app_initial_connect(VirtViewerApp *self, GError **error);
 gboolean virt_viewer_app_get_direct(VirtViewerApp *self);
 void virt_viewer_app_set_direct(VirtViewerApp *self, gboolean direct);
+void virt_viewer_app_set_ssh_compression(VirtViewerApp *self, gboolean compression);
 void virt_viewer_app_set_hotkeys(VirtViewerApp *self, const gchar *hotkeys);
 void virt_viewer_app_set_attach(VirtViewerApp *self, gboolean attach);
 gboolean virt_viewer_app_get_attach(VirtViewerApp *self);
@@ -88,6 +92,7 @@ void virt_viewer_app_set_connect_info(VirtViewerApp *self,
 void virt_viewer_app_show_status(VirtViewerApp *self, const gchar *fmt, ...);
 void virt_viewer_app_show_display(VirtViewerApp *self);
 GList* virt_viewer_app_get_windows(VirtViewerApp *self);
+GList* virt_viewer_app_get_displays(VirtViewerApp *self);
 gboolean virt_viewer_app_get_enable_accel(VirtViewerApp *self);
 VirtViewerSession* virt_viewer_app_get_session(VirtViewerApp *self);
 gboolean virt_viewer_app_get_fullscreen(VirtViewerApp *app);
@@ -101,6 +106,22 @@ gboolean virt_viewer_app_get_session_cancelled(VirtViewerApp *self);
 
 gboolean virt_viewer_app_get_config_share_clipboard(VirtViewerApp *self);
 void virt_viewer_app_set_config_share_clipboard(VirtViewerApp *self, gboolean enable);
+guint virt_viewer_app_get_config_max_file_transfers(VirtViewerApp *self);
+gboolean virt_viewer_app_get_config_local_fast_path(VirtViewerApp *self);
+gchar **virt_viewer_app_get_config_connection_paths(VirtViewerApp *self, const gchar *uri);
+void virt_viewer_app_set_config_connection_paths(VirtViewerApp *self,
+                                                 const gchar *uri,
+                                                 const gchar * const *paths);
+glong virt_viewer_app_get_config_console_scrollback(VirtViewerApp *self);
+VirtViewerConsoleLog *virt_viewer_app_open_console_log(VirtViewerApp *self, const gchar *name);
+guint virt_viewer_app_type_text(VirtViewerApp *self, VirtViewerDisplay *display, const gchar *text);
+void virt_viewer_app_stop_typing(VirtViewerApp *self, VirtViewerDisplay *display);
+gboolean virt_viewer_app_get_relay_stats(VirtViewerApp *self,
+                                         guint64 *bytes_to_server,
+                                         guint64 *bytes_from_server);
+gboolean virt_viewer_app_get_ssh_compression_stats(VirtViewerApp *self,
+                                                   guint64 *raw_bytes,
+                                                   guint64 *compressed_bytes);
 
 gboolean virt_viewer_app_get_supports_share_clipboard(VirtViewerApp *self);
 void virt_viewer_app_set_supports_share_clipboard(VirtViewerApp *self, gboolean enable);
@@ -0,0 +1,281 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "virt-viewer-capture.h"
+#include "virt-viewer-util.h"
+
+/*
+ * The file starts with CAPTURE_MAGIC, then each chunk has a header of
+ * stream id (32 bits), direction (8 bits), time (64 bits) and length
+ * (32 bits), all big endian, followed by the data.
+ */
+#define CAPTURE_MAGIC "VVCAPT01"
+#define CAPTURE_MAGIC_LEN 8
+#define CAPTURE_HEADER_LEN 17
+/* Records are the chunks relays read, 64 KiB at most, longer ones come
+ * from a corrupt file */
+#define CAPTURE_MAX_RECORD_LEN (256 * 1024)
+
+struct _VirtViewerCapture {
+    gint refs;
+    GMutex lock;
+    FILE *file;
+    gchar *filename;
+    gint64 start;
+    guint32 n_streams;
+    gboolean failed;
+};
+
+typedef struct {
+    VirtViewerCapture *capture;
+    guint32 id;
+} CaptureStream;
+
+struct _VirtViewerCaptureReader {
+    FILE *file;
+    gchar *filename;
+};
+
+VirtViewerCapture *
+virt_viewer_capture_new(const gchar *filename, GError **error)
+{
+    VirtViewerCapture *capture;
+    FILE *file;
+
+    g_return_val_if_fail(filename != NULL, NULL);
+
+    file = g_fopen(filename, "wb");
+    if (file == NULL || fwrite(CAPTURE_MAGIC, CAPTURE_MAGIC_LEN, 1, file) != 1) {
+        g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                    _("Unable to write capture file %s: %s"), filename, g_strerror(errno));
+        if (file != NULL)
+            fclose(file);
+        return NULL;
+    }
+
+    capture = g_new0(VirtViewerCapture, 1);
+    capture->refs = 1;
+    g_mutex_init(&capture->lock);
+    capture->file = file;
+    capture->filename = g_strdup(filename);
+    capture->start = g_get_monotonic_time();
+
+    return capture;
+}
+
+VirtViewerCapture *
+virt_viewer_capture_ref(VirtViewerCapture *capture)
+{
+    g_return_val_if_fail(capture != NULL, NULL);
+
+    g_atomic_int_inc(&capture->refs);
+
+    return capture;
+}
+
+void
+virt_viewer_capture_unref(VirtViewerCapture *capture)
+{
+    if (capture == NULL || !g_atomic_int_dec_and_test(&capture->refs))
+        return;
+
+    if (fclose(capture->file) != 0 && !capture->failed)
+        g_warning("Unable to write capture file %s: %s",
+                  capture->filename, g_strerror(errno));
+    g_mutex_clear(&capture->lock);
+    g_free(capture->filename);
+    g_free(capture);
+}
+
+static gint64
+capture_forward(gpointer filter_data,
+                VirtViewerRelayDirection direction,
+                const guint8 *data,
+                gsize len)
+{
+    CaptureStream *stream = filter_data;
+    VirtViewerCapture *capture = stream->capture;
+    guint8 header[CAPTURE_HEADER_LEN];
+    guint32 id = GUINT32_TO_BE(stream->id);
+    guint64 time = GUINT64_TO_BE(g_get_monotonic_time() - capture->start);
+    guint32 length = GUINT32_TO_BE(len);
+
+    memcpy(header, &id, 4);
+    header[4] = direction;
+    memcpy(header + 5, &time, 8);
+    memcpy(header + 13, &length, 4);
+
+    g_mutex_lock(&capture->lock);
+    if (!capture->failed &&
+        (fwrite(header, sizeof(header), 1, capture->file) != 1 ||
+         fwrite(data, len, 1, capture->file) != 1)) {
+        /* a partial record would make the rest unreadable anyway */
+        g_warning("Unable to write capture file %s, stopping the capture: %s",
+                  capture->filename, g_strerror(errno));
+        capture->failed = TRUE;
+    }
+    g_mutex_unlock(&capture->lock);
+
+    return 0;
+}
+
+static void
+capture_stream_free(gpointer filter_data)
+{
+    CaptureStream *stream = filter_data;
+
+    /* the file is complete up to the end of this stream at least */
+    g_mutex_lock(&stream->capture->lock);
+    fflush(stream->capture->file);
+    g_mutex_unlock(&stream->capture->lock);
+
+    virt_viewer_capture_unref(stream->capture);
+    g_free(stream);
+}
+
+static const VirtViewerRelayFilter capture_filter = {
+    .needs_data = TRUE,
+    .forward = capture_forward,
+    .free = capture_stream_free,
+};
+
+void
+virt_viewer_capture_add_relay(VirtViewerCapture *capture, VirtViewerRelay *relay)
+{
+    CaptureStream *stream;
+
+    g_return_if_fail(capture != NULL);
+    g_return_if_fail(relay != NULL);
+
+    stream = g_new0(CaptureStream, 1);
+    stream->capture = virt_viewer_capture_ref(capture);
+    g_mutex_lock(&capture->lock);
+    stream->id = capture->n_streams++;
+    g_mutex_unlock(&capture->lock);
+
+    virt_viewer_relay_add_filter(relay, &capture_filter, stream);
+}
+
+VirtViewerCaptureReader *
+virt_viewer_capture_reader_new(const gchar *filename, GError **error)
+{
+    VirtViewerCaptureReader *reader;
+    gchar magic[CAPTURE_MAGIC_LEN];
+    FILE *file;
+
+    g_return_val_if_fail(filename != NULL, NULL);
+
+    file = g_fopen(filename, "rb");
+    if (file == NULL) {
+        g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                    _("Unable to open capture file %s: %s"), filename, g_strerror(errno));
+        return NULL;
+    }
+
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+        g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                    _("%s is not a capture file"), filename);
+        fclose(file);
+        return NULL;
+    }
+
+    reader = g_new0(VirtViewerCaptureReader, 1);
+    reader->file = file;
+    reader->filename = g_strdup(filename);
+
+    return reader;
+}
+
+void
+virt_viewer_capture_reader_free(VirtViewerCaptureReader *reader)
+{
+    if (reader == NULL)
+        return;
+
+    fclose(reader->file);
+    g_free(reader->filename);
+    g_free(reader);
+}
+
+gboolean
+virt_viewer_capture_reader_next(VirtViewerCaptureReader *reader,
+                                VirtViewerCaptureRecord *record,
+                                GError **error)
+{
+    guint8 header[CAPTURE_HEADER_LEN];
+    guint32 id, length;
+    guint64 time;
+    gpointer data;
+    size_t n;
+
+    g_return_val_if_fail(reader != NULL, FALSE);
+    g_return_val_if_fail(record != NULL, FALSE);
+
+    n = fread(header, 1, sizeof(header), reader->file);
+    if (n == 0 && feof(reader->file))
+        return FALSE;
+    if (n != sizeof(header))
+        goto truncated;
+
+    memcpy(&id, header, 4);
+    memcpy(&time, header + 5, 8);
+    memcpy(&length, header + 13, 4);
+    length = GUINT32_FROM_BE(length);
+    if (header[4] >= VIRT_VIEWER_RELAY_N_DIRECTIONS || length > CAPTURE_MAX_RECORD_LEN) {
+        g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                    _("Capture file %s is corrupt"), reader->filename);
+        return FALSE;
+    }
+
+    data = g_malloc(length);
+    if (fread(data, 1, length, reader->file) != length) {
+        g_free(data);
+        goto truncated;
+    }
+
+    record->stream = GUINT32_FROM_BE(id);
+    record->direction = header[4];
+    record->time = GUINT64_FROM_BE(time);
+    record->data = g_bytes_new_take(data, length);
+
+    return TRUE;
+
+truncated:
+    g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                _("Capture file %s is truncated"), reader->filename);
+    return FALSE;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,69 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_CAPTURE_H
+#define VIRT_VIEWER_CAPTURE_H
+
+#include <glib.h>
+
+#include "virt-viewer-relay.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Records the traffic of relays to a file, with timestamps, each relay as a
+ * stream of its own. Replaying the streams stands in for the server.
+ */
+typedef struct _VirtViewerCapture VirtViewerCapture;
+
+VirtViewerCapture *virt_viewer_capture_new(const gchar *filename, GError **error);
+VirtViewerCapture *virt_viewer_capture_ref(VirtViewerCapture *capture);
+void virt_viewer_capture_unref(VirtViewerCapture *capture);
+/* Records @relay as a new stream, before it is started */
+void virt_viewer_capture_add_relay(VirtViewerCapture *capture, VirtViewerRelay *relay);
+
+typedef struct {
+    guint32 stream;
+    VirtViewerRelayDirection direction;
+    gint64 time; /* microseconds since the capture started */
+    GBytes *data;
+} VirtViewerCaptureRecord;
+
+typedef struct _VirtViewerCaptureReader VirtViewerCaptureReader;
+
+VirtViewerCaptureReader *virt_viewer_capture_reader_new(const gchar *filename, GError **error);
+void virt_viewer_capture_reader_free(VirtViewerCaptureReader *reader);
+/* Fills @record, its data must be released with g_bytes_unref(). Returns
+ * FALSE at the end of the capture, with @error set when it is cut short or
+ * isn't a capture */
+gboolean virt_viewer_capture_reader_next(VirtViewerCaptureReader *reader,
+                                         VirtViewerCaptureRecord *record,
+                                         GError **error);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_CAPTURE_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,309 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "virt-viewer-console-log.h"
+
+/* Data waiting for the writer thread beyond this is dropped */
+#define MAX_QUEUED_BYTES (4 * 1024 * 1024)
+
+/* Output, or a record of the output dropped at that point when dropped
+ * isn't 0 */
+typedef struct {
+    gint64 time;
+    gsize dropped;
+    gsize len;
+    guint8 data[];
+} ConsoleLogChunk;
+
+struct _VirtViewerConsoleLog {
+    gchar *path;
+    gsize max_size;
+    guint max_files;
+    GThread *thread;
+
+    GMutex lock;
+    GCond cond;
+    GQueue chunks;
+    gsize queued;
+    gboolean stopping;
+
+    /* only used by the writer thread */
+    FILE *file;
+    gsize file_size;
+    gboolean at_line_start;
+    gboolean failed;
+};
+
+static void
+console_log_open(VirtViewerConsoleLog *log)
+{
+    long size;
+
+    log->file = g_fopen(log->path, "ab");
+    if (log->file == NULL) {
+        g_warning("Unable to open console log %s: %s", log->path, g_strerror(errno));
+        log->failed = TRUE;
+        return;
+    }
+
+    fseek(log->file, 0, SEEK_END);
+    size = ftell(log->file);
+    log->file_size = size > 0 ? size : 0;
+    log->at_line_start = TRUE;
+}
+
+static gchar *
+console_log_get_rotated_path(VirtViewerConsoleLog *log, guint n)
+{
+    return n == 0 ? g_strdup(log->path) : g_strdup_printf("%s.%u", log->path, n);
+}
+
+/* log -> log.1 -> log.2 ... the oldest one is removed */
+static void
+console_log_rotate(VirtViewerConsoleLog *log)
+{
+    guint i;
+
+    g_debug("Rotating console log %s", log->path);
+    fclose(log->file);
+    log->file = NULL;
+
+    for (i = log->max_files; i > 0; i--) {
+        gchar *from = console_log_get_rotated_path(log, i - 1);
+        gchar *to = console_log_get_rotated_path(log, i);
+
+        g_remove(to);
+        g_rename(from, to);
+        g_free(from);
+        g_free(to);
+    }
+    if (log->max_files == 0)
+        g_remove(log->path);
+
+    console_log_open(log);
+}
+
+static void
+console_log_put(VirtViewerConsoleLog *log, const void *data, gsize len)
+{
+    if (log->file == NULL)
+        return;
+
+    if (fwrite(data, 1, len, log->file) != len) {
+        g_warning("Unable to write console log %s: %s", log->path, g_strerror(errno));
+        fclose(log->file);
+        log->file = NULL;
+        log->failed = TRUE;
+        return;
+    }
+    log->file_size += len;
+}
+
+static gchar *
+console_log_format_time(gint64 time)
+{
+    GDateTime *dt = g_date_time_new_from_unix_local(time / G_USEC_PER_SEC);
+    gchar *date = g_date_time_format(dt, "%Y-%m-%d %H:%M:%S");
+    gchar *stamp = g_strdup_printf("[%s.%03d] ", date,
+                                   (int)(time % G_USEC_PER_SEC / 1000));
+
+    g_free(date);
+    g_date_time_unref(dt);
+
+    return stamp;
+}
+
+static void
+console_log_write_chunk(VirtViewerConsoleLog *log, ConsoleLogChunk *chunk)
+{
+    gchar *stamp = console_log_format_time(chunk->time);
+    gsize pos = 0;
+
+    if (log->file == NULL && !log->failed)
+        console_log_open(log);
+
+    if (chunk->dropped > 0) {
+        gchar *msg = g_strdup_printf("%s%s[%" G_GSIZE_FORMAT " bytes of console output dropped]\n",
+                                     log->at_line_start ? "" : "\n", stamp, chunk->dropped);
+        console_log_put(log, msg, strlen(msg));
+        log->at_line_start = TRUE;
+        g_free(msg);
+    }
+
+    while (pos < chunk->len && log->file != NULL) {
+        const guint8 *eol;
+        gsize n;
+
+        /* Only rotate between lines so that none is split across files */
+        if (log->at_line_start) {
+            if (log->max_size > 0 && log->file_size >= log->max_size)
+                console_log_rotate(log);
+            console_log_put(log, stamp, strlen(stamp));
+        }
+
+        eol = memchr(chunk->data + pos, '\n', chunk->len - pos);
+        n = eol ? (gsize)(eol - (chunk->data + pos)) + 1 : chunk->len - pos;
+        console_log_put(log, chunk->data + pos, n);
+        log->at_line_start = eol != NULL;
+        pos += n;
+    }
+
+    g_free(stamp);
+}
+
+static gpointer
+console_log_thread(gpointer data)
+{
+    VirtViewerConsoleLog *log = data;
+    gboolean dirty = FALSE;
+
+    g_mutex_lock(&log->lock);
+    for (;;) {
+        ConsoleLogChunk *chunk;
+
+        if (g_queue_is_empty(&log->chunks)) {
+            /* Flush once the backlog has been written, not after every chunk */
+            if (dirty && log->file != NULL) {
+                g_mutex_unlock(&log->lock);
+                fflush(log->file);
+                g_mutex_lock(&log->lock);
+                dirty = FALSE;
+                continue;
+            }
+            if (log->stopping)
+                break;
+            g_cond_wait(&log->cond, &log->lock);
+            continue;
+        }
+
+        chunk = g_queue_pop_head(&log->chunks);
+        log->queued -= chunk->len;
+        g_mutex_unlock(&log->lock);
+
+        console_log_write_chunk(log, chunk);
+        g_free(chunk);
+        dirty = TRUE;
+
+        g_mutex_lock(&log->lock);
+    }
+    g_mutex_unlock(&log->lock);
+
+    if (log->file != NULL) {
+        fclose(log->file);
+        log->file = NULL;
+    }
+
+    return NULL;
+}
+
+VirtViewerConsoleLog *
+virt_viewer_console_log_new(const gchar *path, gsize max_size, guint max_files)
+{
+    VirtViewerConsoleLog *log;
+
+    g_return_val_if_fail(path != NULL, NULL);
+
+    log = g_new0(VirtViewerConsoleLog, 1);
+    log->path = g_strdup(path);
+    log->max_size = max_size;
+    log->max_files = max_files;
+    g_mutex_init(&log->lock);
+    g_cond_init(&log->cond);
+    g_queue_init(&log->chunks);
+    log->thread = g_thread_new("console-log", console_log_thread, log);
+
+    g_debug("Logging console to %s", path);
+
+    return log;
+}
+
+void
+virt_viewer_console_log_free(VirtViewerConsoleLog *log)
+{
+    if (log == NULL)
+        return;
+
+    g_mutex_lock(&log->lock);
+    log->stopping = TRUE;
+    g_cond_signal(&log->cond);
+    g_mutex_unlock(&log->lock);
+    g_thread_join(log->thread);
+
+    g_queue_foreach(&log->chunks, (GFunc)g_free, NULL);
+    g_queue_clear(&log->chunks);
+    g_cond_clear(&log->cond);
+    g_mutex_clear(&log->lock);
+    g_free(log->path);
+    g_free(log);
+}
+
+void
+virt_viewer_console_log_append(VirtViewerConsoleLog *log,
+                               const guint8 *data, gsize len)
+{
+    ConsoleLogChunk *chunk, *last;
+
+    g_return_if_fail(log != NULL);
+
+    if (len == 0)
+        return;
+
+    chunk = g_malloc(sizeof(ConsoleLogChunk) + len);
+    chunk->time = g_get_real_time();
+    chunk->dropped = 0;
+    chunk->len = len;
+    memcpy(chunk->data, data, len);
+
+    g_mutex_lock(&log->lock);
+    if (log->queued + len > MAX_QUEUED_BYTES) {
+        /* recorded where the output went missing, consecutive drops are
+         * counted together */
+        last = g_queue_peek_tail(&log->chunks);
+        if (last != NULL && last->dropped > 0) {
+            last->dropped += len;
+            g_free(chunk);
+        } else {
+            chunk = g_realloc(chunk, sizeof(ConsoleLogChunk));
+            chunk->dropped = len;
+            chunk->len = 0;
+            g_queue_push_tail(&log->chunks, chunk);
+            g_cond_signal(&log->cond);
+        }
+    } else {
+        log->queued += len;
+        g_queue_push_tail(&log->chunks, chunk);
+        g_cond_signal(&log->cond);
+    }
+    g_mutex_unlock(&log->lock);
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,55 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_CONSOLE_LOG_H
+#define VIRT_VIEWER_CONSOLE_LOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Copies console output to a file. Appending only queues the data, the
+ * file is opened, written and rotated by a background thread so a slow
+ * disk never stalls the console. Each line is prefixed with the time the
+ * data was received, and if more than a few megabytes are waiting to be
+ * written, new data is dropped and the gap is marked in the log.
+ */
+typedef struct _VirtViewerConsoleLog VirtViewerConsoleLog;
+
+VirtViewerConsoleLog *virt_viewer_console_log_new(const gchar *path,
+                                                  gsize max_size,
+                                                  guint max_files);
+/* Flushes whatever is still queued and closes the file */
+void virt_viewer_console_log_free(VirtViewerConsoleLog *log);
+
+void virt_viewer_console_log_append(VirtViewerConsoleLog *log,
+                                    const guint8 *data, gsize len);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_CONSOLE_LOG_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,525 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <gtk/gtk.h>
+#ifdef G_OS_UNIX
+#include <gio/gunixfdlist.h>
+#include <gio/gunixoutputstream.h>
+#endif
+
+#include "virt-viewer-dbus.h"
+#include "virt-viewer-session.h"
+#include "virt-viewer-util.h"
+
+#define VIRT_VIEWER_DBUS_INTERFACE "org.virt_manager.Viewer"
+
+static const gchar introspection_xml[] =
+    "<node>"
+    "  <interface name='" VIRT_VIEWER_DBUS_INTERFACE "'>"
+    "    <method name='Connect'>"
+    "      <arg type='s' name='uri' direction='in'/>"
+    "    </method>"
+    "    <method name='Disconnect'/>"
+    "    <method name='SendKeys'>"
+    "      <arg type='i' name='display' direction='in'/>"
+    "      <arg type='as' name='keys' direction='in'/>"
+    "    </method>"
+    "    <method name='TypeText'>"
+    "      <arg type='i' name='display' direction='in'/>"
+    "      <arg type='s' name='text' direction='in'/>"
+    "      <arg type='u' name='skipped' direction='out'/>"
+    "    </method>"
+    "    <method name='StopTyping'>"
+    "      <arg type='i' name='display' direction='in'/>"
+    "    </method>"
+#ifdef G_OS_UNIX
+    "    <method name='Screenshot'>"
+    "      <arg type='i' name='display' direction='in'/>"
+    "      <arg type='h' name='fd' direction='in'/>"
+    "    </method>"
+#endif
+    "    <method name='SetZoom'>"
+    "      <arg type='i' name='percent' direction='in'/>"
+    "    </method>"
+    "    <method name='ToggleFullscreen'/>"
+    "    <method name='ListDisplays'>"
+    "      <arg type='a(ibbii)' name='displays' direction='out'/>"
+    "    </method>"
+    "    <method name='GetStatistics'>"
+    "      <arg type='a{sv}' name='statistics' direction='out'/>"
+    "    </method>"
+    "    <signal name='Connected'/>"
+    "    <signal name='Disconnected'>"
+    "      <arg type='s' name='message'/>"
+    "    </signal>"
+    "    <signal name='DisplaysChanged'/>"
+    "  </interface>"
+    "</node>";
+
+struct _VirtViewerDBus {
+    VirtViewerApp *app; /* weak reference, the app owns us */
+    GDBusConnection *connection;
+    gchar *object_path;
+    guint registration_id;
+    guint name_id;
+    gint64 connected_time;
+};
+
+static VirtViewerDisplay *
+lookup_display(VirtViewerDBus *self, gint nth, GDBusMethodInvocation *invocation)
+{
+    GList *l, *displays = virt_viewer_app_get_displays(self->app);
+    VirtViewerDisplay *display = NULL;
+
+    for (l = displays; l != NULL; l = l->next) {
+        if (virt_viewer_display_get_nth(l->data) == nth) {
+            display = l->data;
+            break;
+        }
+    }
+    g_list_free(displays);
+
+    if (display == NULL)
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_INVALID_ARGS,
+                                              "No display %d", nth);
+
+    return display;
+}
+
+static void
+handle_connect(VirtViewerDBus *self, GVariant *parameters,
+               GDBusMethodInvocation *invocation)
+{
+    const gchar *uri;
+    GError *error = NULL;
+
+    if (virt_viewer_app_is_active(self->app)) {
+        g_dbus_method_invocation_return_error_literal(invocation, G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_FAILED,
+                                                      "Already connected");
+        return;
+    }
+
+    g_variant_get(parameters, "(&s)", &uri);
+    if (*uri != '\0' && !virt_viewer_app_set_connect_uri(self->app, uri, &error)) {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+        return;
+    }
+
+    if (!virt_viewer_app_start(self->app, &error)) {
+        if (error == NULL)
+            g_set_error_literal(&error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                                "Unable to connect");
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+        return;
+    }
+
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void
+handle_send_keys(VirtViewerDBus *self, GVariant *parameters,
+                 GDBusMethodInvocation *invocation)
+{
+    VirtViewerDisplay *display;
+    GVariantIter *iter;
+    const gchar *name;
+    GArray *keyvals;
+    gint nth;
+
+    g_variant_get(parameters, "(ias)", &nth, &iter);
+    keyvals = g_array_new(FALSE, FALSE, sizeof(guint));
+    while (g_variant_iter_next(iter, "&s", &name)) {
+        guint keyval = gdk_keyval_from_name(name);
+
+        if (keyval == GDK_KEY_VoidSymbol) {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                                  G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Unknown key '%s'", name);
+            goto end;
+        }
+        g_array_append_val(keyvals, keyval);
+    }
+
+    display = lookup_display(self, nth, invocation);
+    if (display == NULL)
+        goto end;
+
+    virt_viewer_display_send_keys(display, (const guint *)keyvals->data, keyvals->len);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+
+end:
+    g_array_unref(keyvals);
+    g_variant_iter_free(iter);
+}
+
+static void
+handle_type_text(VirtViewerDBus *self, GVariant *parameters,
+                 GDBusMethodInvocation *invocation)
+{
+    VirtViewerDisplay *display;
+    const gchar *text;
+    guint skipped;
+    gint nth;
+
+    g_variant_get(parameters, "(i&s)", &nth, &text);
+    display = lookup_display(self, nth, invocation);
+    if (display == NULL)
+        return;
+
+    if (!VIRT_VIEWER_DISPLAY_CAN_SEND_KEYS(display)) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_NOT_SUPPORTED,
+                                              "Display %d doesn't take keys", nth);
+        return;
+    }
+
+    skipped = virt_viewer_app_type_text(self->app, display, text);
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(u)", skipped));
+}
+
+static void
+handle_stop_typing(VirtViewerDBus *self, GVariant *parameters,
+                   GDBusMethodInvocation *invocation)
+{
+    VirtViewerDisplay *display;
+    gint nth;
+
+    g_variant_get(parameters, "(i)", &nth);
+    display = lookup_display(self, nth, invocation);
+    if (display == NULL)
+        return;
+
+    virt_viewer_app_stop_typing(self->app, display);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+#ifdef G_OS_UNIX
+static void
+handle_screenshot(VirtViewerDBus *self, GVariant *parameters,
+                  GDBusMethodInvocation *invocation)
+{
+    GUnixFDList *fd_list = g_dbus_message_get_unix_fd_list(g_dbus_method_invocation_get_message(invocation));
+    VirtViewerDisplay *display;
+    GOutputStream *stream;
+    GdkPixbuf *pixbuf;
+    GError *error = NULL;
+    gint nth, handle, fd;
+
+    g_variant_get(parameters, "(ih)", &nth, &handle);
+    if (fd_list == NULL || handle < 0 || handle >= g_unix_fd_list_get_length(fd_list)) {
+        g_dbus_method_invocation_return_error_literal(invocation, G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_INVALID_ARGS,
+                                                      "No file descriptor was passed");
+        return;
+    }
+
+    display = lookup_display(self, nth, invocation);
+    if (display == NULL)
+        return;
+
+    pixbuf = virt_viewer_display_get_pixbuf(display);
+    if (pixbuf == NULL) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_FAILED,
+                                              "Display %d has nothing to show", nth);
+        return;
+    }
+
+    fd = g_unix_fd_list_get(fd_list, handle, &error);
+    if (fd < 0) {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+        g_object_unref(pixbuf);
+        return;
+    }
+
+    stream = g_unix_output_stream_new(fd, TRUE);
+    if (gdk_pixbuf_save_to_stream(pixbuf, stream, "png", NULL, &error, NULL) &&
+        g_output_stream_close(stream, NULL, &error)) {
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } else {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+    }
+
+    g_object_unref(stream);
+    g_object_unref(pixbuf);
+}
+#endif
+
+static void
+handle_set_zoom(VirtViewerDBus *self, GVariant *parameters,
+                GDBusMethodInvocation *invocation)
+{
+    GList *l;
+    gint zoom;
+
+    g_variant_get(parameters, "(i)", &zoom);
+    if (zoom < MIN_ZOOM_LEVEL || zoom > MAX_ZOOM_LEVEL) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_INVALID_ARGS,
+                                              "Zoom level must be within %d-%d",
+                                              MIN_ZOOM_LEVEL, MAX_ZOOM_LEVEL);
+        return;
+    }
+
+    for (l = virt_viewer_app_get_windows(self->app); l != NULL; l = l->next)
+        virt_viewer_window_set_zoom_level(VIRT_VIEWER_WINDOW(l->data), zoom);
+
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static GVariant *
+list_displays(VirtViewerDBus *self)
+{
+    GList *l, *displays = virt_viewer_app_get_displays(self->app);
+    GVariantBuilder builder;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(ibbii)"));
+    for (l = displays; l != NULL; l = l->next) {
+        VirtViewerDisplay *display = l->data;
+        guint width = 0, height = 0;
+
+        virt_viewer_display_get_desktop_size(display, &width, &height);
+        g_variant_builder_add(&builder, "(ibbii)",
+                              virt_viewer_display_get_nth(display),
+                              virt_viewer_display_get_enabled(display),
+                              (virt_viewer_display_get_show_hint(display) &
+                               VIRT_VIEWER_DISPLAY_SHOW_HINT_READY) != 0,
+                              (gint)width, (gint)height);
+    }
+    g_list_free(displays);
+
+    return g_variant_new("(a(ibbii))", &builder);
+}
+
+static GVariant *
+get_statistics(VirtViewerDBus *self)
+{
+    VirtViewerSession *session = virt_viewer_app_get_session(self->app);
+    GList *displays = virt_viewer_app_get_displays(self->app);
+    GVariantBuilder builder;
+    gchar *guest_name = NULL;
+    guint64 bytes_to_server, bytes_from_server;
+    guint64 bytes_raw, bytes_compressed;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder, "{sv}", "connected",
+                          g_variant_new_boolean(self->connected_time != 0));
+    if (self->connected_time != 0)
+        g_variant_builder_add(&builder, "{sv}", "connected-seconds",
+                              g_variant_new_double((g_get_monotonic_time() - self->connected_time) /
+                                                   (gdouble)G_USEC_PER_SEC));
+    g_variant_builder_add(&builder, "{sv}", "displays",
+                          g_variant_new_uint32(g_list_length(displays)));
+    g_list_free(displays);
+
+    if (virt_viewer_app_get_relay_stats(self->app, &bytes_to_server, &bytes_from_server)) {
+        g_variant_builder_add(&builder, "{sv}", "relay-bytes-sent",
+                              g_variant_new_uint64(bytes_to_server));
+        g_variant_builder_add(&builder, "{sv}", "relay-bytes-received",
+                              g_variant_new_uint64(bytes_from_server));
+    }
+
+    if (virt_viewer_app_get_ssh_compression_stats(self->app, &bytes_raw, &bytes_compressed)) {
+        g_variant_builder_add(&builder, "{sv}", "ssh-bytes-raw",
+                              g_variant_new_uint64(bytes_raw));
+        g_variant_builder_add(&builder, "{sv}", "ssh-bytes-compressed",
+                              g_variant_new_uint64(bytes_compressed));
+    }
+
+    g_object_get(self->app, "guest-name", &guest_name, NULL);
+    if (guest_name != NULL)
+        g_variant_builder_add(&builder, "{sv}", "guest-name",
+                              g_variant_new_take_string(guest_name));
+
+    if (session != NULL) {
+        gchar *uri = virt_viewer_session_get_uri(session);
+
+        if (uri != NULL)
+            g_variant_builder_add(&builder, "{sv}", "uri", g_variant_new_take_string(uri));
+        virt_viewer_session_get_stats(session, &builder);
+    }
+
+    return g_variant_new("(a{sv})", &builder);
+}
+
+static void
+method_call(GDBusConnection *connection G_GNUC_UNUSED,
+            const gchar *sender G_GNUC_UNUSED,
+            const gchar *object_path G_GNUC_UNUSED,
+            const gchar *interface_name G_GNUC_UNUSED,
+            const gchar *method_name,
+            GVariant *parameters,
+            GDBusMethodInvocation *invocation,
+            gpointer user_data)
+{
+    VirtViewerDBus *self = user_data;
+
+    g_debug("D-Bus call %s", method_name);
+
+    if (g_str_equal(method_name, "Connect")) {
+        handle_connect(self, parameters, invocation);
+    } else if (g_str_equal(method_name, "Disconnect")) {
+        VirtViewerSession *session = virt_viewer_app_get_session(self->app);
+
+        if (session != NULL)
+            virt_viewer_session_close(session);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } else if (g_str_equal(method_name, "SendKeys")) {
+        handle_send_keys(self, parameters, invocation);
+    } else if (g_str_equal(method_name, "TypeText")) {
+        handle_type_text(self, parameters, invocation);
+    } else if (g_str_equal(method_name, "StopTyping")) {
+        handle_stop_typing(self, parameters, invocation);
+#ifdef G_OS_UNIX
+    } else if (g_str_equal(method_name, "Screenshot")) {
+        handle_screenshot(self, parameters, invocation);
+#endif
+    } else if (g_str_equal(method_name, "SetZoom")) {
+        handle_set_zoom(self, parameters, invocation);
+    } else if (g_str_equal(method_name, "ToggleFullscreen")) {
+        g_object_set(self->app, "fullscreen",
+                     !virt_viewer_app_get_fullscreen(self->app), NULL);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } else if (g_str_equal(method_name, "ListDisplays")) {
+        g_dbus_method_invocation_return_value(invocation, list_displays(self));
+    } else if (g_str_equal(method_name, "GetStatistics")) {
+        g_dbus_method_invocation_return_value(invocation, get_statistics(self));
+    } else {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "Unknown method %s", method_name);
+    }
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+    method_call,
+    NULL,
+    NULL,
+    { NULL, }
+};
+
+static void
+emit_signal(VirtViewerDBus *self, const gchar *name, GVariant *parameters)
+{
+    GError *error = NULL;
+
+    if (!g_dbus_connection_emit_signal(self->connection, NULL, self->object_path,
+                                       VIRT_VIEWER_DBUS_INTERFACE, name,
+                                       parameters, &error)) {
+        g_debug("Unable to emit D-Bus signal %s: %s", name, error->message);
+        g_error_free(error);
+    }
+}
+
+void
+virt_viewer_dbus_emit_connected(VirtViewerDBus *self)
+{
+    self->connected_time = g_get_monotonic_time();
+    emit_signal(self, "Connected", NULL);
+}
+
+void
+virt_viewer_dbus_emit_disconnected(VirtViewerDBus *self, const gchar *message)
+{
+    self->connected_time = 0;
+    emit_signal(self, "Disconnected", g_variant_new("(s)", message ? message : ""));
+}
+
+void
+virt_viewer_dbus_emit_displays_changed(VirtViewerDBus *self)
+{
+    emit_signal(self, "DisplaysChanged", NULL);
+}
+
+VirtViewerDBus *
+virt_viewer_dbus_new(VirtViewerApp *app,
+                     GDBusConnection *connection,
+                     const gchar *object_path,
+                     GError **error)
+{
+    GDBusNodeInfo *info;
+    VirtViewerDBus *self;
+    const gchar *app_id;
+
+    info = g_dbus_node_info_new_for_xml(introspection_xml, error);
+    if (info == NULL)
+        return NULL;
+
+    self = g_new0(VirtViewerDBus, 1);
+    self->app = app;
+    self->connection = g_object_ref(connection);
+    self->object_path = g_strdup(object_path);
+    self->registration_id = g_dbus_connection_register_object(connection, object_path,
+                                                              info->interfaces[0],
+                                                              &interface_vtable,
+                                                              self, NULL, error);
+    g_dbus_node_info_unref(info);
+    if (self->registration_id == 0) {
+        virt_viewer_dbus_free(self);
+        return NULL;
+    }
+
+    /* The applications are not unique, so the application id isn't owned
+     * on the bus. Give the first instance a well-known name to be reached at,
+     * the following ones take over when it exits. */
+    app_id = g_application_get_application_id(G_APPLICATION(app));
+    if (app_id != NULL) {
+        gchar *name = g_strdup_printf("%s.Control", app_id);
+
+        self->name_id = g_bus_own_name_on_connection(connection, name,
+                                                     G_BUS_NAME_OWNER_FLAGS_NONE,
+                                                     NULL, NULL, NULL, NULL);
+        g_debug("Exported %s on %s, requested name %s",
+                VIRT_VIEWER_DBUS_INTERFACE, object_path, name);
+        g_free(name);
+    }
+
+    return self;
+}
+
+void
+virt_viewer_dbus_free(VirtViewerDBus *self)
+{
+    if (self == NULL)
+        return;
+
+    if (self->name_id != 0)
+        g_bus_unown_name(self->name_id);
+    if (self->registration_id != 0)
+        g_dbus_connection_unregister_object(self->connection, self->registration_id);
+    g_object_unref(self->connection);
+    g_free(self->object_path);
+    g_free(self);
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,56 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_DBUS_H
+#define VIRT_VIEWER_DBUS_H
+
+#include <gio/gio.h>
+
+#include "virt-viewer-app.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Exports the org.virt_manager.Viewer interface next to the GApplication
+ * object, so that a running viewer can be driven without spawning a new
+ * process for every action.
+ */
+typedef struct _VirtViewerDBus VirtViewerDBus;
+
+VirtViewerDBus *virt_viewer_dbus_new(VirtViewerApp *app,
+                                     GDBusConnection *connection,
+                                     const gchar *object_path,
+                                     GError **error);
+void virt_viewer_dbus_free(VirtViewerDBus *self);
+
+void virt_viewer_dbus_emit_connected(VirtViewerDBus *self);
+void virt_viewer_dbus_emit_disconnected(VirtViewerDBus *self, const gchar *message);
+void virt_viewer_dbus_emit_displays_changed(VirtViewerDBus *self);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_DBUS_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
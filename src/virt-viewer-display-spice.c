@@ -45,6 +45,8 @@ struct _VirtViewerDisplaySpicePrivate {
     AutoResizeState auto_resize;
     guint x;
     guint y;
+    /* copy of the screen taken before the primary surface goes away */
+    GdkPixbuf *last_frame;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (VirtViewerDisplaySpice, virt_viewer_display_spice, VIRT_VIEWER_TYPE_DISPLAY)
@@ -57,18 +59,36 @@ static void virt_viewer_display_spice_release_cursor(VirtViewerDisplay *display)
 static gboolean virt_viewer_display_spice_selectable(VirtViewerDisplay *display);
 static void virt_viewer_display_spice_enable(VirtViewerDisplay *display);
 static void virt_viewer_display_spice_disable(VirtViewerDisplay *display);
+static void virt_viewer_display_spice_flush_input_async(VirtViewerDisplay *display,
+                                                        GCancellable *cancellable,
+                                                        GAsyncReadyCallback callback,
+                                                        gpointer user_data);
+
+static void
+virt_viewer_display_spice_dispose(GObject *obj)
+{
+    VirtViewerDisplaySpice *self = VIRT_VIEWER_DISPLAY_SPICE(obj);
+
+    g_clear_object(&self->priv->last_frame);
+
+    G_OBJECT_CLASS(virt_viewer_display_spice_parent_class)->dispose(obj);
+}
 
 static void
 virt_viewer_display_spice_class_init(VirtViewerDisplaySpiceClass *klass)
 {
+    GObjectClass *oclass = G_OBJECT_CLASS(klass);
     VirtViewerDisplayClass *dclass = VIRT_VIEWER_DISPLAY_CLASS(klass);
 
+    oclass->dispose = virt_viewer_display_spice_dispose;
+
     dclass->send_keys = virt_viewer_display_spice_send_keys;
     dclass->get_pixbuf = virt_viewer_display_spice_get_pixbuf;
     dclass->release_cursor = virt_viewer_display_spice_release_cursor;
     dclass->selectable = virt_viewer_display_spice_selectable;
     dclass->enable = virt_viewer_display_spice_enable;
     dclass->disable = virt_viewer_display_spice_disable;
+    dclass->flush_input_async = virt_viewer_display_spice_flush_input_async;
 }
 
 static SpiceMainChannel*
@@ -146,18 +166,106 @@ virt_viewer_display_spice_get_pixbuf(VirtViewerDisplay *display)
 {
     VirtViewerDisplaySpice *self = VIRT_VIEWER_DISPLAY_SPICE(display);
 
+    gboolean ready;
+
     g_return_val_if_fail(self != NULL, NULL);
     g_return_val_if_fail(self->priv->display != NULL, NULL);
 
+    /* There is nothing left to copy once the primary surface is destroyed */
+    g_object_get(self->priv->display, "ready", &ready, NULL);
+    if (!ready)
+        return self->priv->last_frame ? g_object_ref(self->priv->last_frame) : NULL;
+
     return spice_display_get_pixbuf(self->priv->display);
 }
 
+/* Runs before SpiceDisplay releases its copy of the surface. Only kiosk
+ * mode puts the last frame on screen while reconnecting, so don't pay for
+ * the copy otherwise. */
+static void
+primary_destroy(VirtViewerDisplaySpice *self)
+{
+    VirtViewerApp *app = virt_viewer_session_get_app(virt_viewer_display_get_session(VIRT_VIEWER_DISPLAY(self)));
+    gboolean ready, kiosk;
+
+    g_object_get(app, "kiosk", &kiosk, NULL);
+    if (!kiosk || self->priv->display == NULL)
+        return;
+
+    g_object_get(self->priv->display, "ready", &ready, NULL);
+    if (!ready)
+        return;
+
+    g_clear_object(&self->priv->last_frame);
+    self->priv->last_frame = spice_display_get_pixbuf(self->priv->display);
+}
+
+/* Updates are reported on the surface of the channel, which monitors can
+ * share, the pointer is traced relative to this monitor */
+static void
+display_invalidate(SpiceChannel *channel G_GNUC_UNUSED,
+                   gint x, gint y, gint width, gint height,
+                   VirtViewerDisplaySpice *self)
+{
+    virt_viewer_display_trace_update(VIRT_VIEWER_DISPLAY(self),
+                                     x - (gint)self->priv->x, y - (gint)self->priv->y,
+                                     width, height);
+}
+
+static void
+flush_input_done(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    GTask *task = user_data;
+    GError *error = NULL;
+
+    if (spice_channel_flush_finish(SPICE_CHANNEL(source), result, &error))
+        g_task_return_boolean(task, TRUE);
+    else
+        g_task_return_error(task, error);
+    g_object_unref(task);
+}
+
+/* The inputs channel tells when its queue has been written out */
+static void
+virt_viewer_display_spice_flush_input_async(VirtViewerDisplay *display,
+                                            GCancellable *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data)
+{
+    GTask *task = g_task_new(display, cancellable, callback, user_data);
+    SpiceChannel *inputs = NULL;
+    GList *l, *channels;
+    SpiceSession *s;
+
+    g_object_get(virt_viewer_display_get_session(display), "spice-session", &s, NULL);
+    channels = spice_session_get_channels(s);
+    for (l = channels; l != NULL; l = l->next) {
+        if (SPICE_IS_INPUTS_CHANNEL(l->data)) {
+            inputs = l->data;
+            break;
+        }
+    }
+
+    if (inputs != NULL) {
+        spice_channel_flush_async(inputs, cancellable, flush_input_done, task);
+    } else {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+                                "No inputs channel");
+        g_object_unref(task);
+    }
+
+    g_list_free(channels);
+    g_object_unref(s);
+}
+
 static void
 update_display_ready(VirtViewerDisplaySpice *self)
 {
     gboolean ready;
 
     g_object_get(self->priv->display, "ready", &ready, NULL);
+    if (ready)
+        g_clear_object(&self->priv->last_frame);
 
     virt_viewer_display_set_show_hint(VIRT_VIEWER_DISPLAY(self),
                                       VIRT_VIEWER_DISPLAY_SHOW_HINT_READY, ready);
@@ -267,6 +375,43 @@ fullscreen_changed(VirtViewerDisplaySpice *self,
         self->priv->auto_resize = AUTO_RESIZE_ALWAYS;
 }
 
+static void
+drag_data_received(GtkWidget *widget,
+                   GdkDragContext *context,
+                   gint x G_GNUC_UNUSED,
+                   gint y G_GNUC_UNUSED,
+                   GtkSelectionData *data,
+                   guint info G_GNUC_UNUSED,
+                   guint time,
+                   gpointer user_data G_GNUC_UNUSED)
+{
+    VirtViewerDisplay *display = VIRT_VIEWER_DISPLAY(widget);
+    VirtViewerSession *session = virt_viewer_display_get_session(display);
+    gchar **uris = gtk_selection_data_get_uris(data);
+    GFile **files;
+    guint i, n_uris;
+
+    if (uris == NULL) {
+        g_warning("Drag data received without valid uri list");
+        gtk_drag_finish(context, FALSE, FALSE, time);
+        return;
+    }
+
+    n_uris = g_strv_length(uris);
+    files = g_new0(GFile *, n_uris + 1);
+    for (i = 0; i < n_uris; i++)
+        files[i] = g_file_new_for_uri(uris[i]);
+
+    virt_viewer_session_spice_transfer_files(VIRT_VIEWER_SESSION_SPICE(session), files);
+
+    for (i = 0; i < n_uris; i++)
+        g_object_unref(files[i]);
+    g_free(files);
+    g_strfreev(uris);
+
+    gtk_drag_finish(context, TRUE, FALSE, time);
+}
+
 GtkWidget *
 virt_viewer_display_spice_new(VirtViewerSessionSpice *session,
                               SpiceChannel *channel,
@@ -295,10 +440,20 @@ virt_viewer_display_spice_new(VirtViewerSessionSpice *session,
                         NULL);
     self->priv->channel = channel;
 
+    /* connected before SpiceDisplay connects its own handler */
+    virt_viewer_signal_connect_object(channel, "display-primary-destroy",
+                                      G_CALLBACK(primary_destroy), self,
+                                      G_CONNECT_SWAPPED);
+
     g_object_get(session, "spice-session", &s, NULL);
     self->priv->display = spice_display_new_with_monitor(s, channelid, monitorid);
     g_object_unref(s);
 
+    virt_viewer_display_trace_input(VIRT_VIEWER_DISPLAY(self), GTK_WIDGET(self->priv->display));
+    if (virt_viewer_session_get_trace_latency(VIRT_VIEWER_SESSION(session)))
+        virt_viewer_signal_connect_object(channel, "display-invalidate",
+                                          G_CALLBACK(display_invalidate), self, 0);
+
     virt_viewer_signal_connect_object(self->priv->display, "notify::ready",
                                       G_CALLBACK(update_display_ready), self,
                                       G_CONNECT_SWAPPED);
@@ -320,6 +475,13 @@ virt_viewer_display_spice_new(VirtViewerSessionSpice *session,
     virt_viewer_signal_connect_object(self, "size-allocate",
                                       G_CALLBACK(virt_viewer_display_spice_size_allocate), self, 0);
 
+    /* SpiceDisplay only knows how to transfer plain files, handle drops
+     * here so that directories get queued as well */
+    gtk_drag_dest_unset(GTK_WIDGET(self->priv->display));
+    gtk_drag_dest_set(GTK_WIDGET(self), GTK_DEST_DEFAULT_ALL, NULL, 0, GDK_ACTION_COPY);
+    gtk_drag_dest_add_uri_targets(GTK_WIDGET(self));
+    g_signal_connect(self, "drag-data-received", G_CALLBACK(drag_data_received), NULL);
+
 
     app = virt_viewer_session_get_app(VIRT_VIEWER_SESSION(session));
     virt_viewer_signal_connect_object(app, "notify::enable-accel",
@@ -215,6 +215,9 @@ virt_viewer_display_vnc_new(VirtViewerSessionVnc *session,
     display->priv->vnc = vnc;
 
     gtk_container_add(GTK_CONTAINER(display), GTK_WIDGET(display->priv->vnc));
+    /* VncDisplay doesn't tell about framebuffer updates, only the time
+     * until events are handled is traced */
+    virt_viewer_display_trace_input(VIRT_VIEWER_DISPLAY(display), GTK_WIDGET(vnc));
     vnc_display_set_keyboard_grab(display->priv->vnc, TRUE);
     vnc_display_set_pointer_grab(display->priv->vnc, TRUE);
 
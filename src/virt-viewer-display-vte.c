@@ -25,15 +25,25 @@
 
 #ifdef HAVE_VTE
 #include <vte/vte.h>
+#if VTE_CHECK_VERSION(0, 46, 0)
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+#endif
 #endif
 
 #include "virt-viewer-auth.h"
 #include "virt-viewer-display-vte.h"
+#include "virt-viewer-session.h"
 #include "virt-viewer-util.h"
 
 struct _VirtViewerDisplayVtePrivate {
 #ifdef HAVE_VTE
     VteTerminal *vte;
+    GtkWidget *find_bar;
+    GtkWidget *find_entry;
+    GtkWidget *usage_label;
+    guint usage_update_id; /* source id */
+    guint64 received;
 #endif
     GtkWidget *scroll;
     gchar *name;
@@ -47,6 +57,21 @@ enum {
     PROP_NAME,
 };
 
+static void
+virt_viewer_display_vte_dispose(GObject *obj)
+{
+#ifdef HAVE_VTE
+    VirtViewerDisplayVte *self = VIRT_VIEWER_DISPLAY_VTE(obj);
+
+    if (self->priv->usage_update_id) {
+        g_source_remove(self->priv->usage_update_id);
+        self->priv->usage_update_id = 0;
+    }
+#endif
+
+    G_OBJECT_CLASS(virt_viewer_display_vte_parent_class)->dispose(obj);
+}
+
 static void
 virt_viewer_display_vte_finalize(GObject *obj)
 {
@@ -108,6 +133,7 @@ virt_viewer_display_vte_class_init(VirtViewerDisplayVteClass *klass)
 
     oclass->set_property = virt_viewer_display_vte_set_property;
     oclass->get_property = virt_viewer_display_vte_get_property;
+    oclass->dispose = virt_viewer_display_vte_dispose;
     oclass->finalize = virt_viewer_display_vte_finalize;
     /* override display desktop aspect-ratio behaviour */
     widget_class->size_allocate = virt_viewer_display_vte_size_allocate;
@@ -147,6 +173,169 @@ virt_viewer_display_vte_commit(VirtViewerDisplayVte *self,
 {
     g_signal_emit_by_name(self, "commit", text, size);
 }
+
+static gboolean
+virt_viewer_display_vte_update_usage(gpointer user_data)
+{
+    VirtViewerDisplayVte *self = user_data;
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(self->priv->vte));
+    glong lines = gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_page_size(adjustment);
+    glong limit = vte_terminal_get_scrollback_lines(self->priv->vte);
+    gchar *received = g_format_size(self->priv->received);
+    gchar *text;
+
+    self->priv->usage_update_id = 0;
+
+    if (limit < 0)
+        text = g_strdup_printf(_("%ld scrollback lines, %s received"),
+                               MAX(lines, 0), received);
+    else
+        text = g_strdup_printf(_("%ld of %ld scrollback lines, %s received"),
+                               MAX(lines, 0), limit, received);
+    gtk_label_set_text(GTK_LABEL(self->priv->usage_label), text);
+
+    g_free(text);
+    g_free(received);
+
+    return FALSE;
+}
+
+/* The readout is only refreshed while the find bar shows it, and at most
+ * twice per second however fast the console scrolls */
+static void
+virt_viewer_display_vte_queue_usage_update(VirtViewerDisplayVte *self)
+{
+    if (self->priv->usage_update_id != 0 ||
+        !gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(self->priv->find_bar)))
+        return;
+
+    self->priv->usage_update_id = g_timeout_add(500, virt_viewer_display_vte_update_usage, self);
+}
+
+static void
+virt_viewer_display_vte_find(VirtViewerDisplayVte *self, gboolean backward)
+{
+    if (backward)
+        vte_terminal_search_find_previous(self->priv->vte);
+    else
+        vte_terminal_search_find_next(self->priv->vte);
+}
+
+static void
+virt_viewer_display_vte_find_changed(VirtViewerDisplayVte *self,
+                                     GtkEntry *entry)
+{
+    const gchar *text = gtk_entry_get_text(entry);
+    gchar *pattern = NULL;
+    GError *error = NULL;
+
+    if (*text != '\0')
+        pattern = g_regex_escape_string(text, -1);
+
+#if VTE_CHECK_VERSION(0, 46, 0)
+    {
+        VteRegex *regex = NULL;
+
+        if (pattern)
+            regex = vte_regex_new_for_search(pattern, -1,
+                                             PCRE2_UTF | PCRE2_CASELESS | PCRE2_MULTILINE,
+                                             &error);
+        vte_terminal_search_set_regex(self->priv->vte, regex, 0);
+        if (regex)
+            vte_regex_unref(regex);
+    }
+#else
+    {
+        GRegex *regex = NULL;
+
+        if (pattern)
+            regex = g_regex_new(pattern, G_REGEX_CASELESS | G_REGEX_OPTIMIZE, 0, &error);
+        vte_terminal_search_set_gregex(self->priv->vte, regex, 0);
+        if (regex)
+            g_regex_unref(regex);
+    }
+#endif
+
+    if (error) {
+        g_warning("Invalid console search pattern: %s", error->message);
+        g_clear_error(&error);
+    }
+    g_free(pattern);
+
+    /* Searching starts from the most recent output */
+    if (*text != '\0') {
+        vte_terminal_unselect_all(self->priv->vte);
+        virt_viewer_display_vte_find(self, TRUE);
+    }
+}
+
+static void
+virt_viewer_display_vte_find_previous(VirtViewerDisplayVte *self)
+{
+    virt_viewer_display_vte_find(self, TRUE);
+}
+
+static void
+virt_viewer_display_vte_find_next(VirtViewerDisplayVte *self)
+{
+    virt_viewer_display_vte_find(self, FALSE);
+}
+
+static void
+virt_viewer_display_vte_find_mode_changed(VirtViewerDisplayVte *self)
+{
+    if (gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(self->priv->find_bar))) {
+        virt_viewer_display_vte_update_usage(self);
+    } else {
+        gtk_widget_grab_focus(GTK_WIDGET(self->priv->vte));
+    }
+}
+
+static GtkWidget *
+virt_viewer_display_vte_find_bar_new(VirtViewerDisplayVte *self)
+{
+    GtkWidget *bar, *box, *button;
+
+    bar = gtk_search_bar_new();
+    gtk_search_bar_set_show_close_button(GTK_SEARCH_BAR(bar), TRUE);
+    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+
+    self->priv->find_entry = gtk_search_entry_new();
+    gtk_box_pack_start(GTK_BOX(box), self->priv->find_entry, FALSE, FALSE, 0);
+    gtk_search_bar_connect_entry(GTK_SEARCH_BAR(bar), GTK_ENTRY(self->priv->find_entry));
+    virt_viewer_signal_connect_object(self->priv->find_entry, "search-changed",
+                                      G_CALLBACK(virt_viewer_display_vte_find_changed),
+                                      self, G_CONNECT_SWAPPED);
+    virt_viewer_signal_connect_object(self->priv->find_entry, "activate",
+                                      G_CALLBACK(virt_viewer_display_vte_find_previous),
+                                      self, G_CONNECT_SWAPPED);
+
+    button = gtk_button_new_from_icon_name("go-up-symbolic", GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text(button, _("Find previous occurrence"));
+    gtk_box_pack_start(GTK_BOX(box), button, FALSE, FALSE, 0);
+    virt_viewer_signal_connect_object(button, "clicked",
+                                      G_CALLBACK(virt_viewer_display_vte_find_previous),
+                                      self, G_CONNECT_SWAPPED);
+
+    button = gtk_button_new_from_icon_name("go-down-symbolic", GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text(button, _("Find next occurrence"));
+    gtk_box_pack_start(GTK_BOX(box), button, FALSE, FALSE, 0);
+    virt_viewer_signal_connect_object(button, "clicked",
+                                      G_CALLBACK(virt_viewer_display_vte_find_next),
+                                      self, G_CONNECT_SWAPPED);
+
+    self->priv->usage_label = gtk_label_new(NULL);
+    gtk_style_context_add_class(gtk_widget_get_style_context(self->priv->usage_label),
+                                GTK_STYLE_CLASS_DIM_LABEL);
+    gtk_box_pack_start(GTK_BOX(box), self->priv->usage_label, FALSE, FALSE, 12);
+
+    gtk_container_add(GTK_CONTAINER(bar), box);
+    virt_viewer_signal_connect_object(bar, "notify::search-mode-enabled",
+                                      G_CALLBACK(virt_viewer_display_vte_find_mode_changed),
+                                      self, G_CONNECT_SWAPPED);
+
+    return bar;
+}
 #endif
 
 static void
@@ -155,6 +344,9 @@ virt_viewer_display_vte_adj_changed(VirtViewerDisplayVte *self,
 {
     gtk_widget_set_visible(self->priv->scroll,
         gtk_adjustment_get_upper(adjustment) > gtk_adjustment_get_page_size(adjustment));
+#ifdef HAVE_VTE
+    virt_viewer_display_vte_queue_usage_update(self);
+#endif
 }
 
 GtkWidget *
@@ -162,6 +354,9 @@ virt_viewer_display_vte_new(VirtViewerSession *session, const char *name)
 {
     VirtViewerDisplayVte *self;
     GtkWidget *grid, *scroll = NULL, *vte;
+#ifdef HAVE_VTE
+    VirtViewerApp *app = virt_viewer_session_get_app(session);
+#endif
 
     self = g_object_new(VIRT_VIEWER_TYPE_DISPLAY_VTE,
                         "session", session,
@@ -171,6 +366,10 @@ virt_viewer_display_vte_new(VirtViewerSession *session, const char *name)
 #ifdef HAVE_VTE
     vte = vte_terminal_new();
     self->priv->vte = VTE_TERMINAL(g_object_ref(vte));
+    if (app)
+        vte_terminal_set_scrollback_lines(self->priv->vte,
+                                          virt_viewer_app_get_config_console_scrollback(app));
+    vte_terminal_search_set_wrap_around(self->priv->vte, TRUE);
     virt_viewer_signal_connect_object(vte, "commit",
                                       G_CALLBACK(virt_viewer_display_vte_commit),
                                       self, G_CONNECT_SWAPPED);
@@ -193,7 +392,18 @@ virt_viewer_display_vte_new(VirtViewerSession *session, const char *name)
                                           self, G_CONNECT_SWAPPED);
     }
 
+#ifdef HAVE_VTE
+    {
+        GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+
+        self->priv->find_bar = virt_viewer_display_vte_find_bar_new(self);
+        gtk_box_pack_start(GTK_BOX(box), grid, TRUE, TRUE, 0);
+        gtk_box_pack_start(GTK_BOX(box), self->priv->find_bar, FALSE, FALSE, 0);
+        gtk_container_add(GTK_CONTAINER(self), box);
+    }
+#else
     gtk_container_add(GTK_CONTAINER(self), grid);
+#endif
 
     return GTK_WIDGET(self);
 }
@@ -271,6 +481,7 @@ find_smaller_zoom_factor (double *zoom)
 
 void virt_viewer_display_vte_feed(VirtViewerDisplayVte *display, gpointer data, int size)
 {
+    display->priv->received += size;
     vte_terminal_feed(display->priv->vte, data, size);
 }
 
@@ -298,6 +509,17 @@ void virt_viewer_display_vte_zoom_reset(VirtViewerDisplayVte *self)
 {
     vte_terminal_set_font_scale(self->priv->vte, PANGO_SCALE_MEDIUM);
 }
+
+void virt_viewer_display_vte_set_input_enabled(VirtViewerDisplayVte *self, gboolean enabled)
+{
+    vte_terminal_set_input_enabled(self->priv->vte, enabled);
+}
+
+void virt_viewer_display_vte_show_find_bar(VirtViewerDisplayVte *self)
+{
+    gtk_search_bar_set_search_mode(GTK_SEARCH_BAR(self->priv->find_bar), TRUE);
+    gtk_widget_grab_focus(self->priv->find_entry);
+}
 #else
 void virt_viewer_display_vte_feed(VirtViewerDisplayVte *self G_GNUC_UNUSED,
                                   gpointer data G_GNUC_UNUSED, int size G_GNUC_UNUSED)
@@ -312,4 +534,11 @@ void virt_viewer_display_vte_zoom_out(VirtViewerDisplayVte *self G_GNUC_UNUSED)
 void virt_viewer_display_vte_zoom_reset(VirtViewerDisplayVte *self G_GNUC_UNUSED)
 {
 }
+void virt_viewer_display_vte_set_input_enabled(VirtViewerDisplayVte *self G_GNUC_UNUSED,
+                                               gboolean enabled G_GNUC_UNUSED)
+{
+}
+void virt_viewer_display_vte_show_find_bar(VirtViewerDisplayVte *self G_GNUC_UNUSED)
+{
+}
 #endif
@@ -69,6 +69,9 @@ void virt_viewer_display_vte_zoom_reset(VirtViewerDisplayVte *vte);
 void virt_viewer_display_vte_zoom_in(VirtViewerDisplayVte *vte);
 void virt_viewer_display_vte_zoom_out(VirtViewerDisplayVte *vte);
 
+void virt_viewer_display_vte_set_input_enabled(VirtViewerDisplayVte *vte, gboolean enabled);
+void virt_viewer_display_vte_show_find_bar(VirtViewerDisplayVte *vte);
+
 G_END_DECLS
 
 #endif /* _VIRT_VIEWER_DISPLAY_VTE_H */
@@ -41,8 +41,26 @@ struct _VirtViewerDisplayPrivate
     guint show_hint;
     VirtViewerSession *session;
     gboolean fullscreen;
+
+    /* input latency tracing, see virt_viewer_display_trace_input() */
+    GArray *trace_pending; /* TracedEvent handled but not sent yet */
+    guint trace_flush_id;
+    gint64 trace_key_time; /* oldest key press not followed by an update */
+    gint64 trace_motion_time;
+    gint trace_motion_x;
+    gint trace_motion_y;
 };
 
+typedef struct {
+    VirtViewerLatencyKind kind;
+    gint64 time;
+} TracedEvent;
+
+/* an update after this long isn't considered caused by the input anymore */
+#define TRACE_MAX_WAIT G_TIME_SPAN_SECOND
+/* how far from the pointer, in guest pixels, an update counts as its own */
+#define TRACE_POINTER_AREA 32
+
 static void virt_viewer_display_get_preferred_width(GtkWidget *widget,
                                                     int *minwidth,
                                                     int *defwidth);
@@ -78,12 +96,27 @@ enum {
     PROP_MONITOR,
 };
 
+static void
+virt_viewer_display_dispose(GObject *object)
+{
+    VirtViewerDisplayPrivate *priv = VIRT_VIEWER_DISPLAY(object)->priv;
+
+    if (priv->trace_flush_id != 0) {
+        g_source_remove(priv->trace_flush_id);
+        priv->trace_flush_id = 0;
+    }
+    g_clear_pointer(&priv->trace_pending, g_array_unref);
+
+    G_OBJECT_CLASS(virt_viewer_display_parent_class)->dispose(object);
+}
+
 static void
 virt_viewer_display_class_init(VirtViewerDisplayClass *class)
 {
     GObjectClass *object_class = G_OBJECT_CLASS(class);
     GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(class);
 
+    object_class->dispose = virt_viewer_display_dispose;
     object_class->set_property = virt_viewer_display_set_property;
     object_class->get_property = virt_viewer_display_get_property;
 
@@ -729,6 +762,158 @@ virt_viewer_display_get_nth(VirtViewerDisplay *self)
     return self->priv->nth_display;
 }
 
+static void
+trace_record_sent(VirtViewerDisplay *self, GArray *events)
+{
+    gint64 now = g_get_monotonic_time();
+    guint i;
+
+    for (i = 0; i < events->len; i++) {
+        TracedEvent *event = &g_array_index(events, TracedEvent, i);
+
+        virt_viewer_session_add_latency(self->priv->session, event->kind, now - event->time);
+    }
+}
+
+static void
+trace_flushed(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    VirtViewerDisplay *self = VIRT_VIEWER_DISPLAY(source);
+    GArray *events = user_data;
+    GError *error = NULL;
+
+    if (g_task_propagate_boolean(G_TASK(result), &error))
+        trace_record_sent(self, events);
+    else
+        g_debug("Not tracing input latency: %s", error->message);
+
+    g_clear_error(&error);
+    g_array_unref(events);
+}
+
+/* Runs once the main loop iteration which handled the events is over, by
+ * then the protocol widget has queued its messages */
+static gboolean
+trace_flush(gpointer user_data)
+{
+    VirtViewerDisplay *self = user_data;
+    VirtViewerDisplayClass *klass = VIRT_VIEWER_DISPLAY_GET_CLASS(self);
+    VirtViewerDisplayPrivate *priv = self->priv;
+    GArray *events = priv->trace_pending;
+
+    priv->trace_flush_id = 0;
+    priv->trace_pending = g_array_new(FALSE, FALSE, sizeof(TracedEvent));
+
+    if (klass->flush_input_async != NULL) {
+        klass->flush_input_async(self, NULL, trace_flushed, events);
+    } else {
+        trace_record_sent(self, events);
+        g_array_unref(events);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+trace_event(GtkWidget *widget, GdkEvent *event, VirtViewerDisplay *self)
+{
+    VirtViewerDisplayPrivate *priv = self->priv;
+    TracedEvent traced = { .time = g_get_monotonic_time() };
+
+    switch (event->type) {
+    case GDK_KEY_PRESS:
+        /* modifiers alone don't change anything on screen */
+        if (event->key.is_modifier)
+            return FALSE;
+        traced.kind = VIRT_VIEWER_LATENCY_KEY_SENT;
+        if (priv->trace_key_time == 0)
+            priv->trace_key_time = traced.time;
+        break;
+
+    case GDK_MOTION_NOTIFY:
+        traced.kind = VIRT_VIEWER_LATENCY_MOTION_SENT;
+        if (priv->trace_motion_time == 0) {
+            GtkAllocation alloc;
+            gdouble scale;
+
+            /* the protocol widgets scale the desktop to fit and center it */
+            gtk_widget_get_allocation(widget, &alloc);
+            scale = MIN((gdouble)alloc.width / priv->desktopWidth,
+                        (gdouble)alloc.height / priv->desktopHeight);
+            if (scale <= 0)
+                break;
+
+            priv->trace_motion_time = traced.time;
+            priv->trace_motion_x = (event->motion.x - (alloc.width - priv->desktopWidth * scale) / 2) / scale;
+            priv->trace_motion_y = (event->motion.y - (alloc.height - priv->desktopHeight * scale) / 2) / scale;
+        }
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    g_array_append_val(priv->trace_pending, traced);
+    if (priv->trace_flush_id == 0)
+        priv->trace_flush_id = g_idle_add_full(G_PRIORITY_HIGH, trace_flush, self, NULL);
+
+    return FALSE;
+}
+
+/*
+ * When the session traces input latency, times the keyboard and pointer
+ * events reaching @widget, the protocol widget of the display, until they
+ * are sent, and until the next display update reported with
+ * virt_viewer_display_trace_update().
+ */
+void
+virt_viewer_display_trace_input(VirtViewerDisplay *self, GtkWidget *widget)
+{
+    VirtViewerDisplayPrivate *priv = self->priv;
+
+    g_return_if_fail(VIRT_VIEWER_IS_DISPLAY(self));
+
+    if (priv->session == NULL || !virt_viewer_session_get_trace_latency(priv->session))
+        return;
+
+    if (priv->trace_pending == NULL)
+        priv->trace_pending = g_array_new(FALSE, FALSE, sizeof(TracedEvent));
+    virt_viewer_signal_connect_object(widget, "event",
+                                      G_CALLBACK(trace_event), self, 0);
+}
+
+/* The guest updated this area of the display */
+void
+virt_viewer_display_trace_update(VirtViewerDisplay *self,
+                                 gint x, gint y, gint width, gint height)
+{
+    VirtViewerDisplayPrivate *priv = self->priv;
+    gint64 now = g_get_monotonic_time();
+
+    g_return_if_fail(VIRT_VIEWER_IS_DISPLAY(self));
+
+    /* the text cursor position isn't known, any update is the echo */
+    if (priv->trace_key_time != 0) {
+        if (now - priv->trace_key_time < TRACE_MAX_WAIT)
+            virt_viewer_session_add_latency(priv->session, VIRT_VIEWER_LATENCY_KEY_UPDATE,
+                                            now - priv->trace_key_time);
+        priv->trace_key_time = 0;
+    }
+
+    if (priv->trace_motion_time != 0) {
+        if (now - priv->trace_motion_time >= TRACE_MAX_WAIT) {
+            priv->trace_motion_time = 0;
+        } else if (x < priv->trace_motion_x + TRACE_POINTER_AREA &&
+                   x + width > priv->trace_motion_x - TRACE_POINTER_AREA &&
+                   y < priv->trace_motion_y + TRACE_POINTER_AREA &&
+                   y + height > priv->trace_motion_y - TRACE_POINTER_AREA) {
+            virt_viewer_session_add_latency(priv->session, VIRT_VIEWER_LATENCY_MOTION_UPDATE,
+                                            now - priv->trace_motion_time);
+            priv->trace_motion_time = 0;
+        }
+    }
+}
+
 /*
  * Local variables:
  *  c-indent-level: 4
@@ -84,6 +84,11 @@ struct _VirtViewerDisplayClass {
     gboolean (*selectable)(VirtViewerDisplay *display);
     void (*enable)(VirtViewerDisplay *display);
     void (*disable)(VirtViewerDisplay *display);
+    /* completes a GTask once the input events handled so far are sent */
+    void (*flush_input_async)(VirtViewerDisplay *display,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data);
 };
 
 #define VIRT_VIEWER_DISPLAY_CAN_SCREENSHOT(display) \
@@ -133,6 +138,10 @@ void virt_viewer_display_queue_resize(VirtViewerDisplay *display);
 void virt_viewer_display_get_preferred_monitor_geometry(VirtViewerDisplay *self, GdkRectangle* preferred);
 gint virt_viewer_display_get_nth(VirtViewerDisplay *self);
 
+void virt_viewer_display_trace_input(VirtViewerDisplay *self, GtkWidget *widget);
+void virt_viewer_display_trace_update(VirtViewerDisplay *self,
+                                      gint x, gint y, gint width, gint height);
+
 G_END_DECLS
 
 #endif /* _VIRT_VIEWER_DISPLAY_H */
@@ -20,35 +20,113 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include "virt-viewer-file-transfer-dialog.h"
 #include "virt-viewer-util.h"
 #include <glib/gi18n.h>
 
+/* Minimum delay between two repaints of the progress bar, in ms */
+#define PROGRESS_UPDATE_INTERVAL 100
+
+/* Number of progress samples used to compute the current throughput, at
+ * PROGRESS_UPDATE_INTERVAL this covers the last 3 seconds at least */
+#define THROUGHPUT_WINDOW_SAMPLES 30
+
+/* Number of slowest files listed in the details */
+#define SLOWEST_FILES_MAX 3
+
+typedef struct {
+    /* bytes already accounted for in transferred_size */
+    guint64 transferred;
+    gint64 start_time;
+} TransferTaskInfo;
+
+typedef struct {
+    gint64 time;
+    guint64 bytes;
+} TransferSample;
+
+typedef struct {
+    gchar *name;
+    gdouble rate;
+} TransferSlowFile;
+
+/* Statistics about the current batch of transfers, reset when a task is
+ * added while no other transfer is in progress */
+typedef struct {
+    gint64 start_time;
+    guint n_completed;
+    guint n_failed;
+    guint n_cancelled;
+    /* slowest first */
+    TransferSlowFile slowest[SLOWEST_FILES_MAX];
+    guint n_slowest;
+    TransferSample samples[THROUGHPUT_WINDOW_SAMPLES];
+    guint n_samples;
+    guint next_sample;
+} TransferStats;
+
 struct _VirtViewerFileTransferDialogPrivate
 {
-    GSList *file_transfers;
+    /* SpiceFileTransferTask -> TransferTaskInfo */
+    GHashTable *file_transfers;
+    /* "filename: error" of the failed transfers, until they are reported */
     GSList *failed;
     guint timer_show_src;
     guint timer_hide_src;
+    guint timer_update_src;
     guint num_files;
     guint64 total_transfer_size;
-    guint64 completed_transfer_size;
+    /* running total over active and completed tasks */
+    guint64 transferred_size;
+    /* files waiting in a transfer queue, not started yet */
+    guint num_queued_files;
+    guint64 queued_size;
+    gboolean queue_busy;
+    gboolean batch_active;
+    TransferStats stats;
     GtkWidget *transfer_summary;
     GtkWidget *progressbar;
+    GtkWidget *transfer_stats;
+    GtkWidget *details_expander;
+    GtkWidget *transfer_details;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE(VirtViewerFileTransferDialog, virt_viewer_file_transfer_dialog, GTK_TYPE_DIALOG)
 
+static void transfer_stats_clear(TransferStats *stats)
+{
+    guint i;
+
+    for (i = 0; i < stats->n_slowest; i++)
+        g_free(stats->slowest[i].name);
+    memset(stats, 0, sizeof(*stats));
+}
+
 static void
 virt_viewer_file_transfer_dialog_dispose(GObject *object)
 {
     VirtViewerFileTransferDialog *self = VIRT_VIEWER_FILE_TRANSFER_DIALOG(object);
 
     if (self->priv->file_transfers) {
-        g_slist_free_full(self->priv->file_transfers, g_object_unref);
-        self->priv->file_transfers = NULL;
+        GHashTableIter iter;
+        gpointer task;
+
+        g_hash_table_iter_init(&iter, self->priv->file_transfers);
+        while (g_hash_table_iter_next(&iter, &task, NULL))
+            g_signal_handlers_disconnect_by_data(task, self);
+        g_clear_pointer(&self->priv->file_transfers, g_hash_table_unref);
     }
 
+    if (self->priv->timer_update_src) {
+        g_source_remove(self->priv->timer_update_src);
+        self->priv->timer_update_src = 0;
+    }
+    transfer_stats_clear(&self->priv->stats);
+    g_slist_free_full(self->priv->failed, g_free);
+    self->priv->failed = NULL;
+
     G_OBJECT_CLASS(virt_viewer_file_transfer_dialog_parent_class)->dispose(object);
 }
 
@@ -66,6 +144,15 @@ virt_viewer_file_transfer_dialog_class_init(VirtViewerFileTransferDialogClass *k
     gtk_widget_class_bind_template_child_private(widget_class,
                                                  VirtViewerFileTransferDialog,
                                                  progressbar);
+    gtk_widget_class_bind_template_child_private(widget_class,
+                                                 VirtViewerFileTransferDialog,
+                                                 transfer_stats);
+    gtk_widget_class_bind_template_child_private(widget_class,
+                                                 VirtViewerFileTransferDialog,
+                                                 details_expander);
+    gtk_widget_class_bind_template_child_private(widget_class,
+                                                 VirtViewerFileTransferDialog,
+                                                 transfer_details);
 
     object_class->dispose = virt_viewer_file_transfer_dialog_dispose;
 }
@@ -76,17 +163,17 @@ dialog_response(GtkDialog *dialog,
                 gpointer user_data G_GNUC_UNUSED)
 {
     VirtViewerFileTransferDialog *self = VIRT_VIEWER_FILE_TRANSFER_DIALOG(dialog);
-    GSList *slist;
+    GList *tasks, *l;
 
     switch (response_id) {
         case GTK_RESPONSE_CANCEL:
-            /* cancel all current tasks */
-            for (slist = self->priv->file_transfers; slist != NULL; slist = g_slist_next(slist)) {
-                spice_file_transfer_task_cancel(SPICE_FILE_TRANSFER_TASK(slist->data));
+            /* cancel all current tasks, the totals are reset once the
+             * last one reports it has finished */
+            tasks = g_hash_table_get_keys(self->priv->file_transfers);
+            for (l = tasks; l != NULL; l = l->next) {
+                spice_file_transfer_task_cancel(SPICE_FILE_TRANSFER_TASK(l->data));
             }
-            self->priv->num_files = 0;
-            self->priv->total_transfer_size = 0;
-            self->priv->completed_transfer_size = 0;
+            g_list_free(tasks);
             break;
         case GTK_RESPONSE_DELETE_EVENT:
             /* silently ignore */
@@ -106,12 +193,21 @@ static gboolean delete_event(GtkWidget *widget,
     return TRUE;
 }
 
+static void
+transfer_task_info_free(gpointer data)
+{
+    g_slice_free(TransferTaskInfo, data);
+}
+
 static void
 virt_viewer_file_transfer_dialog_init(VirtViewerFileTransferDialog *self)
 {
     gtk_widget_init_template(GTK_WIDGET(self));
 
     self->priv = virt_viewer_file_transfer_dialog_get_instance_private(self);
+    self->priv->file_transfers = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                       g_object_unref,
+                                                       transfer_task_info_free);
 
     g_signal_connect(self, "response", G_CALLBACK(dialog_response), NULL);
     g_signal_connect(self, "delete-event", G_CALLBACK(delete_event), NULL);
@@ -127,44 +223,271 @@ virt_viewer_file_transfer_dialog_new(GtkWindow *parent)
                         NULL);
 }
 
+static void transfer_stats_reset(TransferStats *stats)
+{
+    transfer_stats_clear(stats);
+    stats->start_time = g_get_monotonic_time();
+}
+
+static void transfer_stats_add_slow_file(TransferStats *stats,
+                                         const gchar *name,
+                                         gdouble rate)
+{
+    guint i;
+
+    if (stats->n_slowest == SLOWEST_FILES_MAX) {
+        if (rate >= stats->slowest[SLOWEST_FILES_MAX - 1].rate)
+            return;
+        g_free(stats->slowest[--stats->n_slowest].name);
+    }
+
+    for (i = stats->n_slowest; i > 0 && stats->slowest[i - 1].rate > rate; i--)
+        stats->slowest[i] = stats->slowest[i - 1];
+    stats->slowest[i].name = g_strdup(name);
+    stats->slowest[i].rate = rate;
+    stats->n_slowest++;
+}
+
+/* Records the current progress and returns the throughput in bytes/s over
+ * the last THROUGHPUT_WINDOW_SAMPLES samples */
+static gdouble transfer_stats_add_sample(TransferStats *stats, guint64 bytes)
+{
+    TransferSample oldest;
+    gint64 now = g_get_monotonic_time();
+
+    if (stats->n_samples == 0) {
+        /* the first sample is taken when the batch starts */
+        stats->samples[0].time = stats->start_time;
+        stats->samples[0].bytes = 0;
+        stats->n_samples = stats->next_sample = 1;
+    }
+    /* once the ring is full, the next slot holds the oldest sample */
+    oldest = (stats->n_samples < THROUGHPUT_WINDOW_SAMPLES) ?
+        stats->samples[0] : stats->samples[stats->next_sample];
+
+    stats->samples[stats->next_sample].time = now;
+    stats->samples[stats->next_sample].bytes = bytes;
+    stats->next_sample = (stats->next_sample + 1) % THROUGHPUT_WINDOW_SAMPLES;
+    stats->n_samples = MIN(stats->n_samples + 1, THROUGHPUT_WINDOW_SAMPLES);
+
+    if (now <= oldest.time || bytes < oldest.bytes)
+        return 0.0;
+
+    return (gdouble)(bytes - oldest.bytes) * G_USEC_PER_SEC / (now - oldest.time);
+}
+
+static gchar *format_remaining_time(guint64 seconds)
+{
+    if (seconds < 60)
+        return g_strdup_printf(ngettext("%u second remaining",
+                                        "%u seconds remaining", (guint)seconds),
+                               (guint)seconds);
+    if (seconds < 60 * 60) {
+        guint minutes = (seconds + 30) / 60;
+        return g_strdup_printf(ngettext("about %u minute remaining",
+                                        "about %u minutes remaining", minutes),
+                               minutes);
+    }
+
+    return g_strdup_printf(_("about %u:%02u hours remaining"),
+                           (guint)(seconds / 3600), (guint)((seconds / 60) % 60));
+}
+
+static void update_transfer_stats(VirtViewerFileTransferDialog *self)
+{
+    VirtViewerFileTransferDialogPrivate *priv = self->priv;
+    guint64 total_size = priv->total_transfer_size + priv->queued_size;
+    guint64 transferred = MIN(priv->transferred_size, total_size);
+    gdouble rate = transfer_stats_add_sample(&priv->stats, transferred);
+    gchar *done = g_format_size(transferred);
+    gchar *total = g_format_size(total_size);
+    gchar *speed = g_format_size((guint64)rate);
+    GString *text = g_string_new(NULL);
+
+    /* Translators: "1.2 MB of 4.5 GB (800 kB/s)" */
+    g_string_printf(text, _("%s of %s (%s/s)"), done, total, speed);
+    if (rate >= 1.0 && total_size > transferred) {
+        gchar *remaining = format_remaining_time((total_size - transferred) / rate);
+        g_string_append_printf(text, ", %s", remaining);
+        g_free(remaining);
+    }
+    if (priv->stats.n_failed > 0) {
+        g_string_append_printf(text, ngettext(", %u failed", ", %u failed",
+                                              priv->stats.n_failed),
+                               priv->stats.n_failed);
+    }
+
+    gtk_label_set_text(GTK_LABEL(priv->transfer_stats), text->str);
+    g_string_free(text, TRUE);
+    g_free(done);
+    g_free(total);
+    g_free(speed);
+}
+
+/* Lists the slowest and the failed files of the batch below the progress */
+static void update_transfer_details(VirtViewerFileTransferDialog *self)
+{
+    TransferStats *stats = &self->priv->stats;
+    GString *text = g_string_new(NULL);
+    GSList *sl;
+    guint i;
+
+    if (stats->n_slowest > 0)
+        g_string_append(text, _("Slowest files:"));
+    for (i = 0; i < stats->n_slowest; i++) {
+        gchar *speed = g_format_size((guint64)stats->slowest[i].rate);
+
+        g_string_append_printf(text, "\n    %s (%s/s)", stats->slowest[i].name, speed);
+        g_free(speed);
+    }
+    if (self->priv->failed != NULL) {
+        if (text->len > 0)
+            g_string_append_c(text, '\n');
+        g_string_append(text, _("Failed files:"));
+    }
+    for (sl = self->priv->failed; sl != NULL; sl = g_slist_next(sl))
+        g_string_append_printf(text, "\n    %s", (const gchar *)sl->data);
+
+    gtk_label_set_text(GTK_LABEL(self->priv->transfer_details), text->str);
+    gtk_widget_set_visible(self->priv->details_expander, text->len > 0);
+    g_string_free(text, TRUE);
+}
+
+/* Per-file statistics, logged and listed in the details as each transfer
+ * finishes */
+static void transfer_stats_task_finished(VirtViewerFileTransferDialog *self,
+                                         SpiceFileTransferTask *task,
+                                         TransferTaskInfo *info,
+                                         GError *error)
+{
+    TransferStats *stats = &self->priv->stats;
+    gchar *filename = spice_file_transfer_task_get_filename(task);
+    guint64 bytes = spice_file_transfer_task_get_total_bytes(task);
+    gint64 duration = g_get_monotonic_time() - info->start_time;
+    guint64 sent = (error == NULL) ? bytes : info->transferred;
+    gdouble rate = (duration > 0) ? (gdouble)sent * G_USEC_PER_SEC / duration : 0.0;
+    gchar *size = g_format_size(bytes);
+    gchar *speed = g_format_size((guint64)rate);
+
+    if (filename == NULL) {
+        guint id;
+
+        g_object_get(task, "id", &id, NULL);
+        filename = g_strdup_printf("(task #%u)", id);
+    }
+
+    if (error == NULL) {
+        stats->n_completed++;
+        /* Ignore tiny files, their throughput is dominated by the per-file
+         * overhead and would always make them the "slowest" */
+        if (bytes >= 64 * 1024)
+            transfer_stats_add_slow_file(stats, filename, rate);
+        g_debug("File transfer of %s done: %s in %.2fs (%s/s)",
+                filename, size, (gdouble)duration / G_USEC_PER_SEC, speed);
+    } else if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        stats->n_cancelled++;
+        g_debug("File transfer of %s cancelled after %.2fs", filename,
+                (gdouble)duration / G_USEC_PER_SEC);
+    } else {
+        stats->n_failed++;
+        self->priv->failed = g_slist_append(self->priv->failed,
+                                            g_strdup_printf("%s: %s", filename,
+                                                            error->message));
+        g_debug("File transfer of %s failed after %.2fs (%s/s): %s", filename,
+                (gdouble)duration / G_USEC_PER_SEC, speed, error->message);
+    }
+    update_transfer_details(self);
+
+    g_free(filename);
+    g_free(size);
+    g_free(speed);
+}
+
+static void transfer_stats_log_summary(VirtViewerFileTransferDialog *self)
+{
+    TransferStats *stats = &self->priv->stats;
+    gint64 duration = g_get_monotonic_time() - stats->start_time;
+    guint64 bytes = MIN(self->priv->transferred_size, self->priv->total_transfer_size);
+    gdouble rate = (duration > 0) ? (gdouble)bytes * G_USEC_PER_SEC / duration : 0.0;
+    gchar *size = g_format_size(bytes);
+    gchar *speed = g_format_size((guint64)rate);
+    gchar *slowest_speed = g_format_size(stats->n_slowest > 0 ? (guint64)stats->slowest[0].rate : 0);
+
+    g_debug("File transfers finished: %u completed, %u failed, %u cancelled, "
+            "%s in %.2fs (average %s/s), slowest file: %s (%s/s)",
+            stats->n_completed, stats->n_failed, stats->n_cancelled,
+            size, (gdouble)duration / G_USEC_PER_SEC, speed,
+            stats->n_slowest > 0 ? stats->slowest[0].name : "none", slowest_speed);
+
+    g_free(size);
+    g_free(speed);
+    g_free(slowest_speed);
+}
+
 static void update_global_progress(VirtViewerFileTransferDialog *self)
 {
-    GSList *slist;
-    guint64 transferred = 0;
     gchar *message = NULL;
-    guint n_files = 0;
+    guint n_files = g_hash_table_size(self->priv->file_transfers);
+    guint total_files = self->priv->num_files + self->priv->num_queued_files;
+    guint64 total_size = self->priv->total_transfer_size + self->priv->queued_size;
     gdouble fraction = 1.0;
 
-    for (slist = self->priv->file_transfers; slist != NULL; slist = g_slist_next(slist)) {
-        SpiceFileTransferTask *task = slist->data;
-        transferred += spice_file_transfer_task_get_transferred_bytes(task);
-        n_files++;
+    if ((n_files > 0 || self->priv->queue_busy) && total_size > 0) {
+        fraction = (gdouble)self->priv->transferred_size / total_size;
+        fraction = CLAMP(fraction, 0.0, 1.0);
     }
 
-    if (n_files > 0) {
-        transferred += self->priv->completed_transfer_size;
-        fraction = (gdouble)transferred / self->priv->total_transfer_size;
-    }
-
-    if (self->priv->num_files == 1) {
+    if (total_files == 1) {
         message = g_strdup(_("Transferring 1 file..."));
     } else {
         message = g_strdup_printf(ngettext("Transferring %u file of %u...",
                                            "Transferring %u files of %u...", n_files),
-                                  n_files, self->priv->num_files);
+                                  n_files, total_files);
     }
     gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(self->priv->progressbar), fraction);
     gtk_label_set_text(GTK_LABEL(self->priv->transfer_summary), message);
     g_free(message);
+
+    update_transfer_stats(self);
 }
 
-static void task_progress_notify(GObject *object G_GNUC_UNUSED,
+static gboolean update_global_progress_cb(gpointer user_data)
+{
+    VirtViewerFileTransferDialog *self = user_data;
+
+    self->priv->timer_update_src = 0;
+    update_global_progress(self);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Coalesce progress updates from all tasks into at most one repaint every
+ * PROGRESS_UPDATE_INTERVAL ms */
+static void schedule_global_progress_update(VirtViewerFileTransferDialog *self)
+{
+    if (self->priv->timer_update_src == 0)
+        self->priv->timer_update_src = g_timeout_add(PROGRESS_UPDATE_INTERVAL,
+                                                     update_global_progress_cb,
+                                                     self);
+}
+
+static void task_progress_notify(GObject *object,
                                  GParamSpec *pspec G_GNUC_UNUSED,
                                  gpointer user_data)
 {
     VirtViewerFileTransferDialog *self = VIRT_VIEWER_FILE_TRANSFER_DIALOG(user_data);
+    SpiceFileTransferTask *task = SPICE_FILE_TRANSFER_TASK(object);
+    TransferTaskInfo *info = g_hash_table_lookup(self->priv->file_transfers, task);
+    guint64 transferred;
 
-    update_global_progress(self);
+    if (info == NULL)
+        return;
+
+    transferred = spice_file_transfer_task_get_transferred_bytes(task);
+    self->priv->transferred_size += transferred - info->transferred;
+    info->transferred = transferred;
+
+    schedule_global_progress_update(self);
 }
 
 static void task_total_bytes_notify(GObject *object,
@@ -176,7 +499,7 @@ static void task_total_bytes_notify(GObject *object,
 
     self->priv->total_transfer_size += spice_file_transfer_task_get_total_bytes(task);
     self->priv->num_files++;
-    update_global_progress(self);
+    schedule_global_progress_update(self);
 }
 
 
@@ -203,21 +526,9 @@ static gboolean hide_transfer_dialog(gpointer data)
         GtkWidget *dialog, *files_label, *scrolled_window, *area;
         GtkRequisition files_label_sz;
 
-        for (sl = self->priv->failed; sl != NULL; sl = g_slist_next(sl)) {
-            SpiceFileTransferTask *failed_task = sl->data;
-            gchar *filename = spice_file_transfer_task_get_filename(failed_task);
-            if (filename == NULL) {
-                guint id;
-
-                g_object_get(failed_task, "id", &id, NULL);
-                g_warning("Unable to get filename of failed transfer");
-                filename = g_strdup_printf("(task #%u)", id);
-            }
-
-            g_string_append_printf(msg, "\n%s", filename);
-            g_free(filename);
-        }
-        g_slist_free_full(self->priv->failed, g_object_unref);
+        for (sl = self->priv->failed; sl != NULL; sl = g_slist_next(sl))
+            g_string_append_printf(msg, "\n%s", (const gchar *)sl->data);
+        g_slist_free_full(self->priv->failed, g_free);
         self->priv->failed = NULL;
 
         dialog = gtk_message_dialog_new(GTK_WINDOW(self), 0, GTK_MESSAGE_ERROR,
@@ -249,36 +560,52 @@ static gboolean hide_transfer_dialog(gpointer data)
     return G_SOURCE_REMOVE;
 }
 
+static void transfer_batch_finished(VirtViewerFileTransferDialog *self)
+{
+    if (self->priv->timer_update_src) {
+        g_source_remove(self->priv->timer_update_src);
+        self->priv->timer_update_src = 0;
+    }
+    update_global_progress(self);
+    transfer_stats_log_summary(self);
+    self->priv->num_files = 0;
+    self->priv->total_transfer_size = 0;
+    self->priv->transferred_size = 0;
+    self->priv->batch_active = FALSE;
+    /* cancel any pending 'show' operations if all tasks complete before
+     * the dialog can be shown */
+    if (self->priv->timer_show_src) {
+        g_source_remove(self->priv->timer_show_src);
+        self->priv->timer_show_src = 0;
+    }
+    self->priv->timer_hide_src = g_timeout_add(500, hide_transfer_dialog,
+                                               self);
+}
+
 static void task_finished(SpiceFileTransferTask *task,
                           GError *error,
                           gpointer user_data)
 {
     VirtViewerFileTransferDialog *self = VIRT_VIEWER_FILE_TRANSFER_DIALOG(user_data);
+    TransferTaskInfo *info = g_hash_table_lookup(self->priv->file_transfers, task);
 
-    if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-        self->priv->failed = g_slist_prepend(self->priv->failed, g_object_ref(task));
+    if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
         g_warning("File transfer task %p failed: %s", task, error->message);
-    }
 
-    self->priv->file_transfers = g_slist_remove(self->priv->file_transfers, task);
-    self->priv->completed_transfer_size += spice_file_transfer_task_get_total_bytes(task);
-    g_object_unref(task);
-    update_global_progress(self);
+    if (info != NULL)
+        transfer_stats_task_finished(self, task, info, error);
+
+    /* account for the whole file, whether it completed or not */
+    if (info != NULL)
+        self->priv->transferred_size += spice_file_transfer_task_get_total_bytes(task) -
+                                        info->transferred;
+    g_signal_handlers_disconnect_by_data(task, self);
+    g_hash_table_remove(self->priv->file_transfers, task);
+    schedule_global_progress_update(self);
 
     /* if this is the last transfer, close the dialog */
-    if (self->priv->file_transfers == NULL) {
-        self->priv->num_files = 0;
-        self->priv->total_transfer_size = 0;
-        self->priv->completed_transfer_size = 0;
-        /* cancel any pending 'show' operations if all tasks complete before
-         * the dialog can be shown */
-        if (self->priv->timer_show_src) {
-            g_source_remove(self->priv->timer_show_src);
-            self->priv->timer_show_src = 0;
-        }
-        self->priv->timer_hide_src = g_timeout_add(500, hide_transfer_dialog,
-                                                   self);
-    }
+    if (g_hash_table_size(self->priv->file_transfers) == 0 && !self->priv->queue_busy)
+        transfer_batch_finished(self);
 }
 
 static gboolean show_transfer_dialog_delayed(gpointer user_data)
@@ -315,10 +642,48 @@ static void show_transfer_dialog(VirtViewerFileTransferDialog *self)
 void virt_viewer_file_transfer_dialog_add_task(VirtViewerFileTransferDialog *self,
                                                SpiceFileTransferTask *task)
 {
-    self->priv->file_transfers = g_slist_prepend(self->priv->file_transfers, g_object_ref(task));
+    TransferTaskInfo *info = g_slice_new0(TransferTaskInfo);
+
+    if (!self->priv->batch_active) {
+        transfer_stats_reset(&self->priv->stats);
+        update_transfer_details(self);
+        self->priv->batch_active = TRUE;
+    }
+
+    info->start_time = g_get_monotonic_time();
+    g_hash_table_insert(self->priv->file_transfers, g_object_ref(task), info);
     g_signal_connect(task, "notify::progress", G_CALLBACK(task_progress_notify), self);
     g_signal_connect(task, "notify::total-bytes", G_CALLBACK(task_total_bytes_notify), self);
     g_signal_connect(task, "finished", G_CALLBACK(task_finished), self);
 
     show_transfer_dialog(self);
 }
+
+/**
+ * virt_viewer_file_transfer_dialog_set_queued:
+ * @self: the dialog
+ * @n_files: number of files waiting to be transferred
+ * @size: total size of these files
+ * @busy: whether more transfers are going to be started
+ *
+ * Lets the dialog account for files waiting in a transfer queue, so that
+ * a batch of queued transfers is reported as a whole rather than closing
+ * the dialog whenever no transfer happens to be in flight.
+ */
+void virt_viewer_file_transfer_dialog_set_queued(VirtViewerFileTransferDialog *self,
+                                                 guint n_files,
+                                                 guint64 size,
+                                                 gboolean busy)
+{
+    self->priv->num_queued_files = n_files;
+    self->priv->queued_size = size;
+    self->priv->queue_busy = busy;
+
+    if (!self->priv->batch_active)
+        return;
+
+    if (!busy && g_hash_table_size(self->priv->file_transfers) == 0)
+        transfer_batch_finished(self);
+    else
+        schedule_global_progress_update(self);
+}
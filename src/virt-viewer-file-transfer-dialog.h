@@ -55,6 +55,10 @@ GType virt_viewer_file_transfer_dialog_get_type(void) G_GNUC_CONST;
 VirtViewerFileTransferDialog *virt_viewer_file_transfer_dialog_new(GtkWindow *parent);
 void virt_viewer_file_transfer_dialog_add_task(VirtViewerFileTransferDialog *self,
                                                SpiceFileTransferTask *task);
+void virt_viewer_file_transfer_dialog_set_queued(VirtViewerFileTransferDialog *self,
+                                                 guint n_files,
+                                                 guint64 size,
+                                                 gboolean busy);
 
 G_END_DECLS
 
@@ -0,0 +1,657 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <spice-client.h>
+
+#include "virt-viewer-file-transfer-queue.h"
+
+/*
+ * Files and directories handed to the queue are walked by a worker thread
+ * which feeds regular files into a small window sorted by size. The main
+ * thread starts transfers from the head of that window (smallest first),
+ * with at most max-concurrent transfers in flight. The walker blocks while
+ * the window is full, so memory use depends on the depth of the dropped
+ * trees, not on the number of files they contain.
+ */
+
+/* Size of the look-ahead window small-files-first ordering is applied to */
+#define MAX_QUEUED_FILES 64
+
+#define WALKER_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+    G_FILE_ATTRIBUTE_STANDARD_SIZE
+
+typedef struct {
+    GFile *file;
+    goffset size;
+} QueuedFile;
+
+typedef struct {
+    VirtViewerFileTransferQueue *queue;
+    goffset size;
+} ActiveTransfer;
+
+struct _VirtViewerFileTransferQueuePrivate
+{
+    VirtViewerSessionSpice *session; /* weak reference */
+    guint max_concurrent;
+
+    GMutex lock;
+    GCond cond;
+    /* the following fields are protected by lock */
+    GThread *walker;
+    gboolean stopping;
+    gboolean walking;
+    GQueue roots;
+    GSequence *queued;
+    guint64 queued_size;
+    guint dispatch_src;
+    /* replaced on cancel, anything started with an older one is dropped */
+    GCancellable *cancellable;
+    /* outcome of the transfers since the last reset */
+    guint n_completed;
+    guint n_failed;
+    guint64 completed_size;
+
+    /* main thread only */
+    guint n_active;
+};
+
+enum {
+    PROP_0,
+    PROP_MAX_CONCURRENT,
+};
+
+enum {
+    SIGNAL_CHANGED,
+    SIGNAL_LAST,
+};
+
+static guint signals[SIGNAL_LAST];
+
+G_DEFINE_TYPE_WITH_PRIVATE(VirtViewerFileTransferQueue, virt_viewer_file_transfer_queue, G_TYPE_OBJECT)
+
+static void
+queued_file_free(gpointer data)
+{
+    QueuedFile *queued = data;
+
+    g_object_unref(queued->file);
+    g_slice_free(QueuedFile, queued);
+}
+
+static gint
+queued_file_compare(gconstpointer a, gconstpointer b, gpointer user_data G_GNUC_UNUSED)
+{
+    const QueuedFile *qa = a;
+    const QueuedFile *qb = b;
+
+    return (qa->size > qb->size) - (qa->size < qb->size);
+}
+
+static gboolean queue_dispatch_cb(gpointer user_data);
+
+/* Must be called with priv->lock held */
+static void
+queue_schedule_dispatch(VirtViewerFileTransferQueue *self)
+{
+    if (self->priv->dispatch_src == 0)
+        self->priv->dispatch_src = g_idle_add(queue_dispatch_cb, self);
+}
+
+/* Must be called with priv->lock held */
+static void
+queue_clear(VirtViewerFileTransferQueue *self)
+{
+    VirtViewerFileTransferQueuePrivate *priv = self->priv;
+
+    g_queue_foreach(&priv->roots, (GFunc)g_object_unref, NULL);
+    g_queue_clear(&priv->roots);
+    g_sequence_remove_range(g_sequence_get_begin_iter(priv->queued),
+                            g_sequence_get_end_iter(priv->queued));
+    priv->queued_size = 0;
+}
+
+static void
+virt_viewer_file_transfer_queue_get_property(GObject *object, guint property_id,
+                                             GValue *value, GParamSpec *pspec)
+{
+    VirtViewerFileTransferQueue *self = VIRT_VIEWER_FILE_TRANSFER_QUEUE(object);
+
+    switch (property_id) {
+    case PROP_MAX_CONCURRENT:
+        g_value_set_uint(value, self->priv->max_concurrent);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+virt_viewer_file_transfer_queue_set_property(GObject *object, guint property_id,
+                                             const GValue *value, GParamSpec *pspec)
+{
+    VirtViewerFileTransferQueue *self = VIRT_VIEWER_FILE_TRANSFER_QUEUE(object);
+
+    switch (property_id) {
+    case PROP_MAX_CONCURRENT:
+        self->priv->max_concurrent = g_value_get_uint(value);
+        g_mutex_lock(&self->priv->lock);
+        if (g_sequence_get_length(self->priv->queued) > 0)
+            queue_schedule_dispatch(self);
+        g_mutex_unlock(&self->priv->lock);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+virt_viewer_file_transfer_queue_dispose(GObject *object)
+{
+    VirtViewerFileTransferQueue *self = VIRT_VIEWER_FILE_TRANSFER_QUEUE(object);
+    VirtViewerFileTransferQueuePrivate *priv = self->priv;
+
+    g_mutex_lock(&priv->lock);
+    priv->stopping = TRUE;
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->lock);
+    g_cancellable_cancel(priv->cancellable);
+
+    if (priv->walker) {
+        g_thread_join(priv->walker);
+        priv->walker = NULL;
+    }
+
+    g_mutex_lock(&priv->lock);
+    if (priv->dispatch_src) {
+        g_source_remove(priv->dispatch_src);
+        priv->dispatch_src = 0;
+    }
+    queue_clear(self);
+    g_mutex_unlock(&priv->lock);
+
+    if (priv->session) {
+        g_object_remove_weak_pointer(G_OBJECT(priv->session), (gpointer *)&priv->session);
+        priv->session = NULL;
+    }
+
+    G_OBJECT_CLASS(virt_viewer_file_transfer_queue_parent_class)->dispose(object);
+}
+
+static void
+virt_viewer_file_transfer_queue_finalize(GObject *object)
+{
+    VirtViewerFileTransferQueue *self = VIRT_VIEWER_FILE_TRANSFER_QUEUE(object);
+
+    g_sequence_free(self->priv->queued);
+    g_clear_object(&self->priv->cancellable);
+    g_cond_clear(&self->priv->cond);
+    g_mutex_clear(&self->priv->lock);
+
+    G_OBJECT_CLASS(virt_viewer_file_transfer_queue_parent_class)->finalize(object);
+}
+
+static void
+virt_viewer_file_transfer_queue_class_init(VirtViewerFileTransferQueueClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+    object_class->get_property = virt_viewer_file_transfer_queue_get_property;
+    object_class->set_property = virt_viewer_file_transfer_queue_set_property;
+    object_class->dispose = virt_viewer_file_transfer_queue_dispose;
+    object_class->finalize = virt_viewer_file_transfer_queue_finalize;
+
+    g_object_class_install_property(object_class,
+                                    PROP_MAX_CONCURRENT,
+                                    g_param_spec_uint("max-concurrent",
+                                                      "Max concurrent",
+                                                      "Maximum number of transfers in flight",
+                                                      1, G_MAXUINT, 4,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+    signals[SIGNAL_CHANGED] =
+        g_signal_new("changed",
+                     G_OBJECT_CLASS_TYPE(object_class),
+                     G_SIGNAL_RUN_FIRST,
+                     0,
+                     NULL,
+                     NULL,
+                     g_cclosure_marshal_VOID__VOID,
+                     G_TYPE_NONE,
+                     0);
+}
+
+static void
+virt_viewer_file_transfer_queue_init(VirtViewerFileTransferQueue *self)
+{
+    self->priv = virt_viewer_file_transfer_queue_get_instance_private(self);
+
+    g_mutex_init(&self->priv->lock);
+    g_cond_init(&self->priv->cond);
+    g_queue_init(&self->priv->roots);
+    self->priv->queued = g_sequence_new(queued_file_free);
+    self->priv->cancellable = g_cancellable_new();
+}
+
+VirtViewerFileTransferQueue *
+virt_viewer_file_transfer_queue_new(VirtViewerSessionSpice *session,
+                                    guint max_concurrent)
+{
+    VirtViewerFileTransferQueue *self;
+
+    self = g_object_new(VIRT_VIEWER_TYPE_FILE_TRANSFER_QUEUE,
+                        "max-concurrent", MAX(max_concurrent, 1),
+                        NULL);
+    self->priv->session = session;
+    g_object_add_weak_pointer(G_OBJECT(session), (gpointer *)&self->priv->session);
+
+    return self;
+}
+
+/* Called from the walker thread */
+static void
+queue_push_file(VirtViewerFileTransferQueue *self,
+                GCancellable *cancellable,
+                GFile *file,
+                goffset size)
+{
+    VirtViewerFileTransferQueuePrivate *priv = self->priv;
+    QueuedFile *queued;
+
+    g_mutex_lock(&priv->lock);
+    if (cancellable == priv->cancellable && !priv->stopping) {
+        queued = g_slice_new(QueuedFile);
+        queued->file = g_object_ref(file);
+        queued->size = size;
+        g_sequence_insert_sorted(priv->queued, queued, queued_file_compare, NULL);
+        priv->queued_size += size;
+        queue_schedule_dispatch(self);
+    }
+    g_mutex_unlock(&priv->lock);
+}
+
+/* Called from the walker thread for files that can't be read */
+static void
+queue_count_failure(VirtViewerFileTransferQueue *self)
+{
+    g_mutex_lock(&self->priv->lock);
+    self->priv->n_failed++;
+    g_mutex_unlock(&self->priv->lock);
+}
+
+static gpointer
+queue_walker_thread(gpointer user_data)
+{
+    VirtViewerFileTransferQueue *self = user_data;
+    VirtViewerFileTransferQueuePrivate *priv = self->priv;
+    GCancellable *cancellable = NULL;
+    /* GFileEnumerator of the directories being walked, innermost first */
+    GSList *stack = NULL;
+
+    for (;;) {
+        GFile *root = NULL;
+        GFile *file;
+        GFileInfo *info;
+        GError *error = NULL;
+
+        g_mutex_lock(&priv->lock);
+        for (;;) {
+            if (priv->stopping)
+                break;
+            if (cancellable != priv->cancellable) {
+                g_slist_free_full(stack, g_object_unref);
+                stack = NULL;
+                g_clear_object(&cancellable);
+                cancellable = g_object_ref(priv->cancellable);
+            }
+            if (g_sequence_get_length(priv->queued) < MAX_QUEUED_FILES) {
+                if (stack != NULL)
+                    break;
+                root = g_queue_pop_head(&priv->roots);
+                if (root != NULL)
+                    break;
+                if (priv->walking) {
+                    priv->walking = FALSE;
+                    queue_schedule_dispatch(self);
+                }
+            }
+            g_cond_wait(&priv->cond, &priv->lock);
+        }
+        if (priv->stopping) {
+            g_mutex_unlock(&priv->lock);
+            g_clear_object(&root);
+            break;
+        }
+        g_mutex_unlock(&priv->lock);
+
+        if (root != NULL) {
+            file = root;
+            info = g_file_query_info(file, WALKER_ATTRIBUTES,
+                                     G_FILE_QUERY_INFO_NONE, cancellable, &error);
+        } else {
+            GFileEnumerator *enumerator = stack->data;
+
+            info = g_file_enumerator_next_file(enumerator, cancellable, &error);
+            if (info == NULL) {
+                if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                    gchar *name = g_file_get_parse_name(g_file_enumerator_get_container(enumerator));
+                    g_warning("Failed to list %s: %s", name, error->message);
+                    g_free(name);
+                    queue_count_failure(self);
+                }
+                g_clear_error(&error);
+                stack = g_slist_delete_link(stack, stack);
+                g_object_unref(enumerator);
+                continue;
+            }
+            file = g_file_enumerator_get_child(enumerator, info);
+        }
+
+        if (info == NULL) {
+            if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                gchar *name = g_file_get_parse_name(file);
+                g_warning("Failed to query %s: %s", name, error->message);
+                g_free(name);
+                queue_count_failure(self);
+            }
+            g_clear_error(&error);
+            g_object_unref(file);
+            continue;
+        }
+
+        switch (g_file_info_get_file_type(info)) {
+        case G_FILE_TYPE_REGULAR:
+            queue_push_file(self, cancellable, file, g_file_info_get_size(info));
+            break;
+        case G_FILE_TYPE_DIRECTORY: {
+            /* symlinks are not followed below the dropped items, so that
+             * a loop can't make the walk endless */
+            GFileEnumerator *enumerator =
+                g_file_enumerate_children(file, WALKER_ATTRIBUTES,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          cancellable, &error);
+            if (enumerator != NULL) {
+                stack = g_slist_prepend(stack, enumerator);
+            } else {
+                if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                    gchar *name = g_file_get_parse_name(file);
+                    g_warning("Failed to open %s: %s", name, error->message);
+                    g_free(name);
+                    queue_count_failure(self);
+                }
+                g_clear_error(&error);
+            }
+            break;
+        }
+        default:
+            g_debug("Skipping %s, not a regular file or directory",
+                    g_file_info_get_name(info));
+            break;
+        }
+
+        g_object_unref(info);
+        g_object_unref(file);
+    }
+
+    g_slist_free_full(stack, g_object_unref);
+    g_clear_object(&cancellable);
+
+    return NULL;
+}
+
+static void queue_dispatch(VirtViewerFileTransferQueue *self);
+
+static void
+file_copy_done(GObject *source_object,
+               GAsyncResult *result,
+               gpointer user_data)
+{
+    ActiveTransfer *transfer = user_data;
+    VirtViewerFileTransferQueue *self = transfer->queue;
+    GError *error = NULL;
+    gboolean success;
+
+    /* per-file failures are reported by the transfer dialog, only errors
+     * preventing the transfer from starting end up here unnoticed */
+    success = spice_main_channel_file_copy_finish(SPICE_MAIN_CHANNEL(source_object),
+                                                  result, &error);
+    if (!success) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_debug("File transfer failed: %s", error->message);
+        g_clear_error(&error);
+    }
+
+    g_mutex_lock(&self->priv->lock);
+    if (success) {
+        self->priv->n_completed++;
+        self->priv->completed_size += transfer->size;
+    } else {
+        self->priv->n_failed++;
+    }
+    g_mutex_unlock(&self->priv->lock);
+
+    self->priv->n_active--;
+    queue_dispatch(self);
+    g_object_unref(self);
+    g_slice_free(ActiveTransfer, transfer);
+}
+
+static void
+queue_dispatch(VirtViewerFileTransferQueue *self)
+{
+    VirtViewerFileTransferQueuePrivate *priv = self->priv;
+    SpiceMainChannel *channel = NULL;
+    GSList *files = NULL, *l;
+    GCancellable *cancellable;
+
+    g_mutex_lock(&priv->lock);
+    while (priv->n_active < priv->max_concurrent &&
+           g_sequence_get_length(priv->queued) > 0) {
+        GSequenceIter *first = g_sequence_get_begin_iter(priv->queued);
+        QueuedFile *queued = g_sequence_get(first);
+
+        QueuedFile *active = g_slice_new(QueuedFile);
+
+        active->file = g_object_ref(queued->file);
+        active->size = queued->size;
+        files = g_slist_prepend(files, active);
+        priv->queued_size -= queued->size;
+        g_sequence_remove(first);
+        priv->n_active++;
+    }
+    cancellable = g_object_ref(priv->cancellable);
+    /* there's room in the window again */
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->lock);
+
+    files = g_slist_reverse(files);
+    if (files != NULL && priv->session != NULL)
+        channel = virt_viewer_session_spice_get_main_channel(priv->session);
+    for (l = files; l != NULL; l = l->next) {
+        QueuedFile *queued = l->data;
+        GFile *sources[] = { queued->file, NULL };
+        ActiveTransfer *transfer;
+
+        if (channel == NULL) {
+            gchar *name = g_file_get_parse_name(queued->file);
+            g_warning("Unable to transfer %s, no main channel", name);
+            g_free(name);
+            g_mutex_lock(&priv->lock);
+            priv->n_failed++;
+            g_mutex_unlock(&priv->lock);
+            priv->n_active--;
+            continue;
+        }
+        transfer = g_slice_new(ActiveTransfer);
+        transfer->queue = g_object_ref(self);
+        transfer->size = queued->size;
+        spice_main_channel_file_copy_async(channel, sources, G_FILE_COPY_NONE,
+                                           cancellable, NULL, NULL,
+                                           file_copy_done, transfer);
+    }
+    g_slist_free_full(files, queued_file_free);
+    g_object_unref(cancellable);
+
+    g_signal_emit(self, signals[SIGNAL_CHANGED], 0);
+}
+
+static gboolean
+queue_dispatch_cb(gpointer user_data)
+{
+    VirtViewerFileTransferQueue *self = user_data;
+
+    g_mutex_lock(&self->priv->lock);
+    self->priv->dispatch_src = 0;
+    g_mutex_unlock(&self->priv->lock);
+
+    queue_dispatch(self);
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * virt_viewer_file_transfer_queue_add_files:
+ * @self: the queue
+ * @files: a %NULL-terminated array of files or directories
+ *
+ * Queues @files for transfer to the guest, directories are walked
+ * recursively and all the regular files they contain are transferred.
+ */
+void
+virt_viewer_file_transfer_queue_add_files(VirtViewerFileTransferQueue *self,
+                                          GFile **files)
+{
+    VirtViewerFileTransferQueuePrivate *priv;
+    guint i;
+
+    g_return_if_fail(VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE(self));
+    g_return_if_fail(files != NULL);
+
+    priv = self->priv;
+    g_mutex_lock(&priv->lock);
+    for (i = 0; files[i] != NULL; i++)
+        g_queue_push_tail(&priv->roots, g_object_ref(files[i]));
+    if (i > 0)
+        priv->walking = TRUE;
+    if (priv->walker == NULL)
+        priv->walker = g_thread_new("file-transfer-walker", queue_walker_thread, self);
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->lock);
+
+    g_signal_emit(self, signals[SIGNAL_CHANGED], 0);
+}
+
+/* Drops all files not transferred yet and cancels the ongoing transfers */
+void
+virt_viewer_file_transfer_queue_cancel(VirtViewerFileTransferQueue *self)
+{
+    VirtViewerFileTransferQueuePrivate *priv;
+    GCancellable *cancellable;
+
+    g_return_if_fail(VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE(self));
+
+    priv = self->priv;
+    g_mutex_lock(&priv->lock);
+    cancellable = priv->cancellable;
+    priv->cancellable = g_cancellable_new();
+    queue_clear(self);
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->lock);
+
+    /* cancellation callbacks may run synchronously, don't hold the lock */
+    g_cancellable_cancel(cancellable);
+    g_object_unref(cancellable);
+
+    g_signal_emit(self, signals[SIGNAL_CHANGED], 0);
+}
+
+/* Number and total size of the files found so far and not started yet */
+guint
+virt_viewer_file_transfer_queue_get_n_queued(VirtViewerFileTransferQueue *self,
+                                             guint64 *queued_size)
+{
+    guint n_queued;
+
+    g_return_val_if_fail(VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE(self), 0);
+
+    g_mutex_lock(&self->priv->lock);
+    n_queued = g_sequence_get_length(self->priv->queued);
+    if (queued_size != NULL)
+        *queued_size = self->priv->queued_size;
+    g_mutex_unlock(&self->priv->lock);
+
+    return n_queued;
+}
+
+/* Whether directories are still being walked or transfers are pending */
+gboolean
+virt_viewer_file_transfer_queue_is_busy(VirtViewerFileTransferQueue *self)
+{
+    gboolean busy;
+
+    g_return_val_if_fail(VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE(self), FALSE);
+
+    g_mutex_lock(&self->priv->lock);
+    busy = self->priv->walking ||
+           g_sequence_get_length(self->priv->queued) > 0 ||
+           self->priv->n_active > 0;
+    g_mutex_unlock(&self->priv->lock);
+
+    return busy;
+}
+
+/* Outcome of the transfers done since the last call to
+ * virt_viewer_file_transfer_queue_reset_stats(), files which couldn't be
+ * read or listed count as failed */
+void
+virt_viewer_file_transfer_queue_get_stats(VirtViewerFileTransferQueue *self,
+                                          guint *n_completed,
+                                          guint *n_failed,
+                                          guint64 *completed_size)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE(self));
+
+    g_mutex_lock(&self->priv->lock);
+    if (n_completed != NULL)
+        *n_completed = self->priv->n_completed;
+    if (n_failed != NULL)
+        *n_failed = self->priv->n_failed;
+    if (completed_size != NULL)
+        *completed_size = self->priv->completed_size;
+    g_mutex_unlock(&self->priv->lock);
+}
+
+void
+virt_viewer_file_transfer_queue_reset_stats(VirtViewerFileTransferQueue *self)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE(self));
+
+    g_mutex_lock(&self->priv->lock);
+    self->priv->n_completed = 0;
+    self->priv->n_failed = 0;
+    self->priv->completed_size = 0;
+    g_mutex_unlock(&self->priv->lock);
+}
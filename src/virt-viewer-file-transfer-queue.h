@@ -0,0 +1,72 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __VIRT_VIEWER_FILE_TRANSFER_QUEUE_H__
+#define __VIRT_VIEWER_FILE_TRANSFER_QUEUE_H__
+
+#include <gio/gio.h>
+
+#include "virt-viewer-session-spice.h"
+
+G_BEGIN_DECLS
+
+#define VIRT_VIEWER_TYPE_FILE_TRANSFER_QUEUE virt_viewer_file_transfer_queue_get_type()
+
+#define VIRT_VIEWER_FILE_TRANSFER_QUEUE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), VIRT_VIEWER_TYPE_FILE_TRANSFER_QUEUE, VirtViewerFileTransferQueue))
+#define VIRT_VIEWER_FILE_TRANSFER_QUEUE_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), VIRT_VIEWER_TYPE_FILE_TRANSFER_QUEUE, VirtViewerFileTransferQueueClass))
+#define VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), VIRT_VIEWER_TYPE_FILE_TRANSFER_QUEUE))
+#define VIRT_VIEWER_IS_FILE_TRANSFER_QUEUE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), VIRT_VIEWER_TYPE_FILE_TRANSFER_QUEUE))
+#define VIRT_VIEWER_FILE_TRANSFER_QUEUE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), VIRT_VIEWER_TYPE_FILE_TRANSFER_QUEUE, VirtViewerFileTransferQueueClass))
+
+typedef struct _VirtViewerFileTransferQueue VirtViewerFileTransferQueue;
+typedef struct _VirtViewerFileTransferQueueClass VirtViewerFileTransferQueueClass;
+typedef struct _VirtViewerFileTransferQueuePrivate VirtViewerFileTransferQueuePrivate;
+
+struct _VirtViewerFileTransferQueue
+{
+    GObject parent;
+
+    VirtViewerFileTransferQueuePrivate *priv;
+};
+
+struct _VirtViewerFileTransferQueueClass
+{
+    GObjectClass parent_class;
+};
+
+GType virt_viewer_file_transfer_queue_get_type(void) G_GNUC_CONST;
+
+VirtViewerFileTransferQueue *virt_viewer_file_transfer_queue_new(VirtViewerSessionSpice *session,
+                                                                 guint max_concurrent);
+void virt_viewer_file_transfer_queue_add_files(VirtViewerFileTransferQueue *self,
+                                               GFile **files);
+void virt_viewer_file_transfer_queue_cancel(VirtViewerFileTransferQueue *self);
+guint virt_viewer_file_transfer_queue_get_n_queued(VirtViewerFileTransferQueue *self,
+                                                   guint64 *queued_size);
+gboolean virt_viewer_file_transfer_queue_is_busy(VirtViewerFileTransferQueue *self);
+void virt_viewer_file_transfer_queue_get_stats(VirtViewerFileTransferQueue *self,
+                                               guint *n_completed,
+                                               guint *n_failed,
+                                               guint64 *completed_size);
+void virt_viewer_file_transfer_queue_reset_stats(VirtViewerFileTransferQueue *self);
+
+G_END_DECLS
+
+#endif /* __VIRT_VIEWER_FILE_TRANSFER_QUEUE_H__ */
@@ -0,0 +1,161 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include "virt-viewer-latency.h"
+
+#define SUB_BUCKETS 8
+/* about 33 seconds, longer latencies are counted as this */
+#define MAX_EXPONENT 24
+#define MAX_VALUE ((G_GINT64_CONSTANT(1) << (MAX_EXPONENT + 1)) - 1)
+#define N_BUCKETS ((MAX_EXPONENT - 1) * SUB_BUCKETS)
+
+struct _VirtViewerLatency {
+    guint64 buckets[N_BUCKETS];
+    guint64 count;
+    gint64 max;
+};
+
+const gchar *
+virt_viewer_latency_kind_to_string(VirtViewerLatencyKind kind)
+{
+    static const gchar *names[] = {
+        [VIRT_VIEWER_LATENCY_KEY_SENT] = "key-sent",
+        [VIRT_VIEWER_LATENCY_KEY_UPDATE] = "key-update",
+        [VIRT_VIEWER_LATENCY_MOTION_SENT] = "motion-sent",
+        [VIRT_VIEWER_LATENCY_MOTION_UPDATE] = "motion-update",
+    };
+
+    g_return_val_if_fail(kind < VIRT_VIEWER_LATENCY_N_KINDS, NULL);
+
+    return names[kind];
+}
+
+/* Values below SUB_BUCKETS get a bucket each, above that every power of
+ * two is split in SUB_BUCKETS buckets of the same width */
+static guint
+bucket_index(gint64 value)
+{
+    guint exponent;
+
+    if (value < SUB_BUCKETS)
+        return value;
+
+    exponent = g_bit_storage(value) - 1;
+    return (exponent - 2) * SUB_BUCKETS + (value >> (exponent - 3)) - SUB_BUCKETS;
+}
+
+static gint64
+bucket_upper_bound(guint index)
+{
+    guint exponent;
+    gint64 mantissa;
+
+    if (index < SUB_BUCKETS)
+        return index;
+
+    exponent = index / SUB_BUCKETS + 2;
+    mantissa = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((mantissa + 1) << (exponent - 3)) - 1;
+}
+
+VirtViewerLatency *
+virt_viewer_latency_new(void)
+{
+    return g_new0(VirtViewerLatency, 1);
+}
+
+void
+virt_viewer_latency_free(VirtViewerLatency *latency)
+{
+    g_free(latency);
+}
+
+void
+virt_viewer_latency_add(VirtViewerLatency *latency, gint64 usec)
+{
+    g_return_if_fail(latency != NULL);
+
+    usec = CLAMP(usec, 0, MAX_VALUE);
+    latency->buckets[bucket_index(usec)]++;
+    latency->count++;
+    latency->max = MAX(latency->max, usec);
+}
+
+guint64
+virt_viewer_latency_get_count(VirtViewerLatency *latency)
+{
+    g_return_val_if_fail(latency != NULL, 0);
+
+    return latency->count;
+}
+
+gint64
+virt_viewer_latency_get_max(VirtViewerLatency *latency)
+{
+    g_return_val_if_fail(latency != NULL, 0);
+
+    return latency->max;
+}
+
+gint64
+virt_viewer_latency_get_percentile(VirtViewerLatency *latency, gdouble percentile)
+{
+    guint64 rank, seen = 0;
+    guint i;
+
+    g_return_val_if_fail(latency != NULL, 0);
+    g_return_val_if_fail(percentile >= 0 && percentile <= 100, 0);
+
+    if (latency->count == 0)
+        return 0;
+
+    /* nearest rank */
+    rank = MAX((guint64)(percentile / 100 * latency->count + 0.5), 1);
+    for (i = 0; i < N_BUCKETS; i++) {
+        seen += latency->buckets[i];
+        if (seen >= rank)
+            return MIN(bucket_upper_bound(i), latency->max);
+    }
+
+    return latency->max;
+}
+
+gchar *
+virt_viewer_latency_to_string(VirtViewerLatency *latency)
+{
+    g_return_val_if_fail(latency != NULL, NULL);
+
+    return g_strdup_printf("n=%" G_GUINT64_FORMAT " p50=%.1fms p95=%.1fms p99=%.1fms max=%.1fms",
+                           latency->count,
+                           virt_viewer_latency_get_percentile(latency, 50) / 1000.0,
+                           virt_viewer_latency_get_percentile(latency, 95) / 1000.0,
+                           virt_viewer_latency_get_percentile(latency, 99) / 1000.0,
+                           latency->max / 1000.0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
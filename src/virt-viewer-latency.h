@@ -0,0 +1,66 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_LATENCY_H
+#define VIRT_VIEWER_LATENCY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* What an input event latency is measured up to */
+typedef enum {
+    VIRT_VIEWER_LATENCY_KEY_SENT,
+    VIRT_VIEWER_LATENCY_KEY_UPDATE,
+    VIRT_VIEWER_LATENCY_MOTION_SENT,
+    VIRT_VIEWER_LATENCY_MOTION_UPDATE,
+    VIRT_VIEWER_LATENCY_N_KINDS
+} VirtViewerLatencyKind;
+
+const gchar *virt_viewer_latency_kind_to_string(VirtViewerLatencyKind kind);
+
+/*
+ * A histogram of latencies in microseconds. Buckets are spaced
+ * logarithmically with 8 per power of two, so percentiles are within 12.5%
+ * of the real value whatever the range, in constant memory.
+ */
+typedef struct _VirtViewerLatency VirtViewerLatency;
+
+VirtViewerLatency *virt_viewer_latency_new(void);
+void virt_viewer_latency_free(VirtViewerLatency *latency);
+
+void virt_viewer_latency_add(VirtViewerLatency *latency, gint64 usec);
+guint64 virt_viewer_latency_get_count(VirtViewerLatency *latency);
+gint64 virt_viewer_latency_get_max(VirtViewerLatency *latency);
+/* Upper bound of the bucket holding the @percentile th value, 0 when empty */
+gint64 virt_viewer_latency_get_percentile(VirtViewerLatency *latency, gdouble percentile);
+/* "n=… p50=…ms p95=…ms p99=…ms max=…ms", for the debug log */
+gchar *virt_viewer_latency_to_string(VirtViewerLatency *latency);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_LATENCY_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
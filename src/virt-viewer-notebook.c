@@ -29,6 +29,8 @@
 
 struct _VirtViewerNotebookPrivate {
     GtkWidget *status;
+    /* last frame of a display that went away, painted behind the status */
+    GdkPixbuf *frame;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (VirtViewerNotebook, virt_viewer_notebook, GTK_TYPE_NOTEBOOK)
@@ -53,6 +55,16 @@ virt_viewer_notebook_set_property (GObject *object, guint property_id,
     }
 }
 
+static void
+virt_viewer_notebook_dispose (GObject *object)
+{
+    VirtViewerNotebook *self = VIRT_VIEWER_NOTEBOOK(object);
+
+    g_clear_object(&self->priv->frame);
+
+    G_OBJECT_CLASS(virt_viewer_notebook_parent_class)->dispose(object);
+}
+
 static void
 virt_viewer_notebook_class_init (VirtViewerNotebookClass *klass)
 {
@@ -60,6 +72,35 @@ virt_viewer_notebook_class_init (VirtViewerNotebookClass *klass)
 
     object_class->get_property = virt_viewer_notebook_get_property;
     object_class->set_property = virt_viewer_notebook_set_property;
+    object_class->dispose = virt_viewer_notebook_dispose;
+}
+
+/* Scaled to fit, the way the displays do it, so that the frame doesn't
+ * move when the display of the new session takes over */
+static gboolean
+status_draw(GtkWidget *widget, cairo_t *cr, VirtViewerNotebook *self)
+{
+    GdkPixbuf *frame = self->priv->frame;
+    gint width, height, frame_width, frame_height;
+    gdouble scale;
+
+    if (frame == NULL)
+        return FALSE;
+
+    width = gtk_widget_get_allocated_width(widget);
+    height = gtk_widget_get_allocated_height(widget);
+    frame_width = gdk_pixbuf_get_width(frame);
+    frame_height = gdk_pixbuf_get_height(frame);
+    scale = MIN((gdouble)width / frame_width, (gdouble)height / frame_height);
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+    cairo_translate(cr, (width - frame_width * scale) / 2, (height - frame_height * scale) / 2);
+    cairo_scale(cr, scale, scale);
+    gdk_cairo_set_source_pixbuf(cr, frame, 0, 0);
+    cairo_paint(cr);
+
+    return FALSE;
 }
 
 static void
@@ -71,6 +112,7 @@ virt_viewer_notebook_init (VirtViewerNotebook *self)
     priv = self->priv;
 
     priv->status = gtk_label_new("");
+    g_signal_connect(priv->status, "draw", G_CALLBACK(status_draw), self);
     gtk_notebook_set_show_tabs(GTK_NOTEBOOK(self), FALSE);
     gtk_notebook_set_show_border(GTK_NOTEBOOK(self), FALSE);
     gtk_widget_show_all(priv->status);
@@ -122,6 +164,29 @@ virt_viewer_notebook_show_display(VirtViewerNotebook *self)
 
     gtk_notebook_set_current_page(GTK_NOTEBOOK(self), 1);
     gtk_widget_show_all(GTK_WIDGET(self));
+    virt_viewer_notebook_set_frame(self, NULL);
+}
+
+/**
+ * virt_viewer_notebook_set_frame:
+ * @self: the notebook
+ * @frame: (allow-none): a picture of the display
+ *
+ * Keeps @frame on screen behind the status message until the next display
+ * is shown, so that a reconnection doesn't flash an empty window.
+ */
+void
+virt_viewer_notebook_set_frame(VirtViewerNotebook *self, GdkPixbuf *frame)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_NOTEBOOK(self));
+
+    if (frame == self->priv->frame)
+        return;
+
+    g_clear_object(&self->priv->frame);
+    if (frame != NULL)
+        self->priv->frame = g_object_ref(frame);
+    gtk_widget_queue_draw(self->priv->status);
 }
 
 VirtViewerNotebook*
@@ -63,6 +63,7 @@ VirtViewerNotebook* virt_viewer_notebook_new (void);
 void virt_viewer_notebook_show_status_va(VirtViewerNotebook *self, const gchar *fmt, va_list args);
 void virt_viewer_notebook_show_status(VirtViewerNotebook *nb, const gchar *fmt, ...);
 void virt_viewer_notebook_show_display(VirtViewerNotebook *nb);
+void virt_viewer_notebook_set_frame(VirtViewerNotebook *nb, GdkPixbuf *frame);
 
 G_END_DECLS
 
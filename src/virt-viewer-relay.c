@@ -0,0 +1,522 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib/gi18n.h>
+#ifdef G_OS_UNIX
+#include <sys/socket.h>
+#include <glib-unix.h>
+#endif
+
+#include "virt-viewer-relay.h"
+#include "virt-viewer-util.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define RELAY_CHUNK_SIZE (64 * 1024)
+/* Bytes queued in a paced direction before its reader waits */
+#define RELAY_QUEUE_MAX (1024 * 1024)
+
+typedef struct {
+    const VirtViewerRelayFilter *filter;
+    gpointer data;
+} RelayFilter;
+
+typedef struct {
+    gint64 release; /* when the packet is delivered */
+    gsize len;
+    guint8 *data;
+} RelayPacket;
+
+typedef struct {
+    VirtViewerRelay *relay;
+    VirtViewerRelayDirection direction;
+    int in;
+    int out;
+    GThread *thread;
+    guint64 bytes; /* protected by the relay lock */
+
+    /* only used with delaying filters, the reader queues the packets and
+     * the sender writes them once they are due */
+    GThread *sender;
+    GQueue packets; /* protected by the relay lock */
+    gsize queued; /* protected by the relay lock */
+    gboolean read_done; /* protected by the relay lock */
+    gboolean send_done; /* protected by the relay lock */
+    gint64 last_release; /* only used by the reader */
+} RelayStream;
+
+struct _VirtViewerRelay {
+    GArray *filters;
+    gboolean copy;
+    gboolean paced;
+    int transport_fd;
+    int relay_fd;
+    RelayStream streams[VIRT_VIEWER_RELAY_N_DIRECTIONS];
+    GMutex lock;
+    /* wakes up the threads waiting for packets, for room in the queues or
+     * for a packet to be due */
+    GCond cond;
+    gboolean stopping; /* protected by the lock */
+};
+
+#ifdef G_OS_UNIX
+static const gchar *direction_names[] = {
+    [VIRT_VIEWER_RELAY_TO_SERVER] = "to server",
+    [VIRT_VIEWER_RELAY_FROM_SERVER] = "from server",
+};
+
+/* Runs the filters that delay, or the others, and returns the delay */
+static gint64
+relay_filter(RelayStream *stream, const guint8 *data, gsize len, gboolean delays)
+{
+    GArray *filters = stream->relay->filters;
+    gint64 delay = 0;
+    guint i;
+
+    for (i = 0; i < filters->len; i++) {
+        RelayFilter *f = &g_array_index(filters, RelayFilter, i);
+
+        if (f->filter->delays != delays)
+            continue;
+        delay += f->filter->forward(f->data, stream->direction,
+                                    f->filter->needs_data ? data : NULL, len);
+    }
+
+    return delays ? MAX(delay, 0) : 0;
+}
+
+static gboolean
+relay_write(int fd, const guint8 *data, gsize len)
+{
+    while (len > 0) {
+        gssize n = send(fd, data, len, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        data += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+/* Returns the number of bytes forwarded, 0 at the end of the stream or -1
+ * with errno set */
+static gssize
+relay_forward_copy(RelayStream *stream, guint8 *buffer)
+{
+    gssize n;
+
+    do {
+        n = read(stream->in, buffer, RELAY_CHUNK_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return n;
+
+    relay_filter(stream, buffer, n, FALSE);
+
+    return relay_write(stream->out, buffer, n) ? n : -1;
+}
+
+/* Waits for room in the queue, FALSE when the relay stops meanwhile */
+static gboolean
+relay_queue_packet(RelayStream *stream, const guint8 *data, gsize len, gint64 release)
+{
+    VirtViewerRelay *relay = stream->relay;
+    RelayPacket *packet;
+
+    g_mutex_lock(&relay->lock);
+    while (!relay->stopping && !stream->send_done && stream->queued >= RELAY_QUEUE_MAX)
+        g_cond_wait(&relay->cond, &relay->lock);
+    if (relay->stopping || stream->send_done) {
+        g_mutex_unlock(&relay->lock);
+        return FALSE;
+    }
+
+    packet = g_malloc(sizeof(RelayPacket) + len);
+    packet->release = release;
+    packet->len = len;
+    packet->data = (guint8 *)(packet + 1);
+    memcpy(packet->data, data, len);
+    g_queue_push_tail(&stream->packets, packet);
+    stream->queued += len;
+    g_cond_broadcast(&relay->cond);
+    g_mutex_unlock(&relay->lock);
+
+    return TRUE;
+}
+
+/* Same as relay_forward_copy(), the chunk is cut in packets that are
+ * queued with their own delays. The reader never waits for them, so the
+ * delays overlap as on a real link. */
+static gssize
+relay_forward_paced(RelayStream *stream, guint8 *buffer)
+{
+    gint64 arrival;
+    gssize n, offset;
+
+    do {
+        n = read(stream->in, buffer, RELAY_CHUNK_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return n;
+
+    arrival = g_get_monotonic_time();
+    relay_filter(stream, buffer, n, FALSE);
+
+    for (offset = 0; offset < n; offset += VIRT_VIEWER_RELAY_PACKET_SIZE) {
+        gsize len = MIN(n - offset, VIRT_VIEWER_RELAY_PACKET_SIZE);
+        gint64 delay = relay_filter(stream, buffer + offset, len, TRUE);
+
+        /* the stream is delivered in order, a packet waits for those
+         * before it */
+        stream->last_release = MAX(arrival + delay, stream->last_release);
+        if (!relay_queue_packet(stream, buffer + offset, len, stream->last_release)) {
+            errno = ECONNABORTED;
+            return -1;
+        }
+    }
+
+    return n;
+}
+
+static gpointer
+relay_sender_thread(gpointer user_data)
+{
+    RelayStream *stream = user_data;
+    VirtViewerRelay *relay = stream->relay;
+    gboolean ok = TRUE;
+
+    g_mutex_lock(&relay->lock);
+    while (!relay->stopping) {
+        RelayPacket *packet = g_queue_peek_head(&stream->packets);
+
+        if (packet == NULL) {
+            if (stream->read_done)
+                break;
+            g_cond_wait(&relay->cond, &relay->lock);
+            continue;
+        }
+        if (g_get_monotonic_time() < packet->release) {
+            g_cond_wait_until(&relay->cond, &relay->lock, packet->release);
+            continue;
+        }
+
+        g_queue_pop_head(&stream->packets);
+        stream->queued -= packet->len;
+        g_cond_broadcast(&relay->cond);
+        g_mutex_unlock(&relay->lock);
+
+        ok = relay_write(stream->out, packet->data, packet->len);
+
+        g_mutex_lock(&relay->lock);
+        if (!ok) {
+            g_debug("Relay %s stopped: %s", direction_names[stream->direction], g_strerror(errno));
+            g_free(packet);
+            break;
+        }
+        stream->bytes += packet->len;
+        g_free(packet);
+    }
+    stream->send_done = TRUE;
+    g_cond_broadcast(&relay->cond);
+    g_mutex_unlock(&relay->lock);
+
+    /* let the other end see the end of the stream too */
+    shutdown(stream->out, SHUT_WR);
+
+    return NULL;
+}
+
+#ifdef HAVE_SPLICE
+/* Same as relay_forward_copy(), the data goes through a pipe in the kernel */
+static gssize
+relay_forward_splice(RelayStream *stream, const int *pipefd)
+{
+    gssize n, m, left;
+
+    do {
+        n = splice(stream->in, NULL, pipefd[1], NULL, RELAY_CHUNK_SIZE, SPLICE_F_MOVE);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return n;
+
+    relay_filter(stream, NULL, n, FALSE);
+
+    for (left = n; left > 0; left -= m) {
+        do {
+            m = splice(pipefd[0], NULL, stream->out, NULL, left, SPLICE_F_MOVE);
+        } while (m < 0 && errno == EINTR);
+        if (m <= 0)
+            return -1;
+    }
+
+    return n;
+}
+#endif
+
+static gpointer
+relay_thread(gpointer user_data)
+{
+    RelayStream *stream = user_data;
+    VirtViewerRelay *relay = stream->relay;
+    int pipefd[2] = { -1, -1 };
+    guint8 *buffer = NULL;
+    gssize n;
+
+#ifdef HAVE_SPLICE
+    if (!relay->copy && !g_unix_open_pipe(pipefd, FD_CLOEXEC, NULL))
+        g_debug("Unable to create a pipe, relaying %s by copying",
+                direction_names[stream->direction]);
+#endif
+    if (pipefd[0] < 0)
+        buffer = g_malloc(RELAY_CHUNK_SIZE);
+
+    for (;;) {
+#ifdef HAVE_SPLICE
+        if (buffer == NULL)
+            n = relay_forward_splice(stream, pipefd);
+        else
+#endif
+        if (relay->paced)
+            n = relay_forward_paced(stream, buffer);
+        else
+            n = relay_forward_copy(stream, buffer);
+        if (n <= 0)
+            break;
+
+        /* the sender counts what it wrote */
+        if (relay->paced)
+            continue;
+        g_mutex_lock(&relay->lock);
+        stream->bytes += n;
+        g_mutex_unlock(&relay->lock);
+    }
+
+    if (n < 0)
+        g_debug("Relay %s stopped: %s", direction_names[stream->direction], g_strerror(errno));
+
+    if (relay->paced) {
+        /* the sender ends the stream once the queue is empty */
+        g_mutex_lock(&relay->lock);
+        stream->read_done = TRUE;
+        g_cond_broadcast(&relay->cond);
+        g_mutex_unlock(&relay->lock);
+    } else {
+        /* let the other end see the end of the stream too */
+        shutdown(stream->out, SHUT_WR);
+    }
+
+    g_free(buffer);
+    if (pipefd[0] >= 0) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+
+    return NULL;
+}
+
+static void
+relay_stop(VirtViewerRelay *relay)
+{
+    guint i;
+
+    g_mutex_lock(&relay->lock);
+    relay->stopping = TRUE;
+    g_cond_broadcast(&relay->cond);
+    g_mutex_unlock(&relay->lock);
+
+    /* wakes up the threads blocked on either fd */
+    shutdown(relay->transport_fd, SHUT_RDWR);
+    shutdown(relay->relay_fd, SHUT_RDWR);
+    for (i = 0; i < VIRT_VIEWER_RELAY_N_DIRECTIONS; i++) {
+        RelayStream *stream = &relay->streams[i];
+
+        if (stream->thread != NULL) {
+            g_thread_join(stream->thread);
+            stream->thread = NULL;
+        }
+        if (stream->sender != NULL) {
+            g_thread_join(stream->sender);
+            stream->sender = NULL;
+        }
+        g_queue_foreach(&stream->packets, (GFunc)g_free, NULL);
+        g_queue_clear(&stream->packets);
+        stream->queued = 0;
+    }
+}
+#endif /* G_OS_UNIX */
+
+VirtViewerRelay *
+virt_viewer_relay_new(void)
+{
+    VirtViewerRelay *relay = g_new0(VirtViewerRelay, 1);
+
+    relay->filters = g_array_new(FALSE, FALSE, sizeof(RelayFilter));
+    relay->transport_fd = -1;
+    relay->relay_fd = -1;
+    g_mutex_init(&relay->lock);
+    g_cond_init(&relay->cond);
+#ifndef HAVE_SPLICE
+    relay->copy = TRUE;
+#endif
+
+    return relay;
+}
+
+void
+virt_viewer_relay_free(VirtViewerRelay *relay)
+{
+    guint i;
+
+    if (relay == NULL)
+        return;
+
+#ifdef G_OS_UNIX
+    if (relay->transport_fd >= 0) {
+        relay_stop(relay);
+        close(relay->transport_fd);
+        close(relay->relay_fd);
+    }
+#endif
+
+    for (i = 0; i < relay->filters->len; i++) {
+        RelayFilter *f = &g_array_index(relay->filters, RelayFilter, i);
+
+        if (f->filter->free != NULL)
+            f->filter->free(f->data);
+    }
+    g_array_unref(relay->filters);
+    g_mutex_clear(&relay->lock);
+    g_cond_clear(&relay->cond);
+    g_free(relay);
+}
+
+void
+virt_viewer_relay_add_filter(VirtViewerRelay *relay,
+                             const VirtViewerRelayFilter *filter,
+                             gpointer filter_data)
+{
+    RelayFilter f = { filter, filter_data };
+
+    g_return_if_fail(relay != NULL);
+    g_return_if_fail(filter != NULL && filter->forward != NULL);
+    g_return_if_fail(relay->transport_fd == -1);
+
+    g_array_append_val(relay->filters, f);
+    if (filter->needs_data || filter->delays)
+        relay->copy = TRUE;
+    if (filter->delays)
+        relay->paced = TRUE;
+}
+
+int
+virt_viewer_relay_start(VirtViewerRelay *relay, int fd, GError **error)
+{
+#ifdef G_OS_UNIX
+    int type, fds[2];
+    socklen_t len = sizeof(type);
+    guint i;
+
+    g_return_val_if_fail(relay != NULL, -1);
+    g_return_val_if_fail(relay->transport_fd == -1, -1);
+
+    /* stopping the threads relies on shutdown() */
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM) {
+        g_set_error_literal(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                            _("Only stream sockets can be relayed"));
+        return -1;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                    _("Unable to create relay socket: %s"), g_strerror(errno));
+        return -1;
+    }
+
+    /* GSocket makes the process ignore SIGPIPE, which the threads rely on
+     * where send() has no MSG_NOSIGNAL and for splice() */
+    g_type_ensure(G_TYPE_SOCKET);
+
+    /* the threads block rather than poll */
+    g_unix_set_fd_nonblocking(fd, FALSE, NULL);
+    relay->transport_fd = fd;
+    relay->relay_fd = fds[0];
+
+    relay->streams[VIRT_VIEWER_RELAY_TO_SERVER].in = fds[0];
+    relay->streams[VIRT_VIEWER_RELAY_TO_SERVER].out = fd;
+    relay->streams[VIRT_VIEWER_RELAY_FROM_SERVER].in = fd;
+    relay->streams[VIRT_VIEWER_RELAY_FROM_SERVER].out = fds[0];
+
+    for (i = 0; i < VIRT_VIEWER_RELAY_N_DIRECTIONS; i++) {
+        RelayStream *stream = &relay->streams[i];
+
+        stream->relay = relay;
+        stream->direction = i;
+        stream->thread = g_thread_new("relay", relay_thread, stream);
+        if (relay->paced)
+            stream->sender = g_thread_new("relay-sender", relay_sender_thread, stream);
+    }
+
+    g_debug("Relaying fd %d through fd %d, %s", fd, fds[1],
+            relay->paced ? "pacing" : relay->copy ? "copying" : "splicing");
+
+    return fds[1];
+#else
+    g_set_error_literal(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                        _("Relaying connections is not supported on this platform"));
+    return -1;
+#endif
+}
+
+void
+virt_viewer_relay_get_stats(VirtViewerRelay *relay,
+                            guint64 *bytes_to_server,
+                            guint64 *bytes_from_server)
+{
+    g_return_if_fail(relay != NULL);
+
+    g_mutex_lock(&relay->lock);
+    if (bytes_to_server != NULL)
+        *bytes_to_server = relay->streams[VIRT_VIEWER_RELAY_TO_SERVER].bytes;
+    if (bytes_from_server != NULL)
+        *bytes_from_server = relay->streams[VIRT_VIEWER_RELAY_FROM_SERVER].bytes;
+    g_mutex_unlock(&relay->lock);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,91 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_RELAY_H
+#define VIRT_VIEWER_RELAY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    VIRT_VIEWER_RELAY_TO_SERVER,
+    VIRT_VIEWER_RELAY_FROM_SERVER,
+    VIRT_VIEWER_RELAY_N_DIRECTIONS
+} VirtViewerRelayDirection;
+
+/* What delaying filters see at once, a TCP segment on Ethernet */
+#define VIRT_VIEWER_RELAY_PACKET_SIZE 1448
+
+/*
+ * A stage looking at the traffic of a relay. Its functions are called from
+ * the relay threads, one for each direction, so they must be thread safe.
+ */
+typedef struct {
+    /* @forward needs the bytes themselves, they can't be spliced then */
+    gboolean needs_data;
+    /* @forward delays the traffic. It is called with every packet of up to
+     * VIRT_VIEWER_RELAY_PACKET_SIZE bytes rather than every chunk, and the
+     * packet is delivered the returned number of microseconds after it
+     * arrived, but never before the packets ahead of it. Meanwhile the
+     * packets are queued and reading goes on. */
+    gboolean delays;
+    /* Called with every chunk before it is forwarded, @data is NULL unless
+     * needs_data is set. The return value is ignored unless delays is
+     * set. */
+    gint64 (*forward)(gpointer filter_data,
+                      VirtViewerRelayDirection direction,
+                      const guint8 *data,
+                      gsize len);
+    /* Called once the relay is freed */
+    void (*free)(gpointer filter_data);
+} VirtViewerRelayFilter;
+
+/*
+ * Forwards the traffic between the transport fd of a connection and the fd
+ * handed to the session, from threads of its own. Without filters needing
+ * the data, it is moved with splice() and never copied to user space.
+ */
+typedef struct _VirtViewerRelay VirtViewerRelay;
+
+VirtViewerRelay *virt_viewer_relay_new(void);
+void virt_viewer_relay_free(VirtViewerRelay *relay);
+
+/* Filters see the data in the order they were added, before starting */
+void virt_viewer_relay_add_filter(VirtViewerRelay *relay,
+                                  const VirtViewerRelayFilter *filter,
+                                  gpointer filter_data);
+/* Takes over @fd and returns the one the session should use instead, or -1
+ * when the relay can't be set up, @fd is left alone then */
+int virt_viewer_relay_start(VirtViewerRelay *relay, int fd, GError **error);
+void virt_viewer_relay_get_stats(VirtViewerRelay *relay,
+                                 guint64 *bytes_to_server,
+                                 guint64 *bytes_from_server);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_RELAY_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
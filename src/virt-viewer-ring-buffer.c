@@ -0,0 +1,130 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "virt-viewer-ring-buffer.h"
+
+struct _VirtViewerRingBuffer {
+    guint8 *data;
+    gsize size;
+    /* offset of the oldest byte */
+    gsize head;
+    gsize length;
+};
+
+VirtViewerRingBuffer *
+virt_viewer_ring_buffer_new(gsize size)
+{
+    VirtViewerRingBuffer *ring;
+
+    g_return_val_if_fail(size > 0, NULL);
+
+    ring = g_slice_new0(VirtViewerRingBuffer);
+    ring->data = g_malloc(size);
+    ring->size = size;
+
+    return ring;
+}
+
+void
+virt_viewer_ring_buffer_free(VirtViewerRingBuffer *ring)
+{
+    if (ring == NULL)
+        return;
+
+    g_free(ring->data);
+    g_slice_free(VirtViewerRingBuffer, ring);
+}
+
+gsize
+virt_viewer_ring_buffer_get_size(VirtViewerRingBuffer *ring)
+{
+    return ring->size;
+}
+
+gsize
+virt_viewer_ring_buffer_get_length(VirtViewerRingBuffer *ring)
+{
+    return ring->length;
+}
+
+gsize
+virt_viewer_ring_buffer_get_space(VirtViewerRingBuffer *ring)
+{
+    return ring->size - ring->length;
+}
+
+gsize
+virt_viewer_ring_buffer_write(VirtViewerRingBuffer *ring,
+                              const guint8 *data, gsize len)
+{
+    gsize tail, chunk;
+
+    len = MIN(len, ring->size - ring->length);
+    if (len == 0)
+        return 0;
+
+    tail = (ring->head + ring->length) % ring->size;
+    chunk = MIN(len, ring->size - tail);
+    memcpy(ring->data + tail, data, chunk);
+    if (chunk < len)
+        memcpy(ring->data, data + chunk, len - chunk);
+    ring->length += len;
+
+    return len;
+}
+
+const guint8 *
+virt_viewer_ring_buffer_peek(VirtViewerRingBuffer *ring, gsize *len)
+{
+    *len = MIN(ring->length, ring->size - ring->head);
+
+    return ring->data + ring->head;
+}
+
+void
+virt_viewer_ring_buffer_consume(VirtViewerRingBuffer *ring, gsize len)
+{
+    g_return_if_fail(len <= ring->length);
+
+    ring->head = (ring->head + len) % ring->size;
+    ring->length -= len;
+    /* start over from the beginning when empty, so that the next peek
+     * returns a run as long as possible */
+    if (ring->length == 0)
+        ring->head = 0;
+}
+
+void
+virt_viewer_ring_buffer_clear(VirtViewerRingBuffer *ring)
+{
+    ring->head = 0;
+    ring->length = 0;
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
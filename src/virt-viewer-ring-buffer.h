@@ -0,0 +1,62 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_RING_BUFFER_H
+#define VIRT_VIEWER_RING_BUFFER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A fixed-size byte FIFO. Readers get pointers into the buffer itself with
+ * virt_viewer_ring_buffer_peek(), and the bytes stay valid and unchanged
+ * until they are consumed, whatever is written in the meantime. This lets
+ * an asynchronous write be issued straight from the buffer while new data
+ * keeps being appended.
+ */
+typedef struct _VirtViewerRingBuffer VirtViewerRingBuffer;
+
+VirtViewerRingBuffer *virt_viewer_ring_buffer_new(gsize size);
+void virt_viewer_ring_buffer_free(VirtViewerRingBuffer *ring);
+
+gsize virt_viewer_ring_buffer_get_size(VirtViewerRingBuffer *ring);
+gsize virt_viewer_ring_buffer_get_length(VirtViewerRingBuffer *ring);
+gsize virt_viewer_ring_buffer_get_space(VirtViewerRingBuffer *ring);
+
+/* Appends as much of @data as fits, returns the number of bytes stored */
+gsize virt_viewer_ring_buffer_write(VirtViewerRingBuffer *ring,
+                                    const guint8 *data, gsize len);
+/* Returns the oldest contiguous run of buffered bytes and its length, the
+ * data may be split in two runs when it wraps around */
+const guint8 *virt_viewer_ring_buffer_peek(VirtViewerRingBuffer *ring, gsize *len);
+void virt_viewer_ring_buffer_consume(VirtViewerRingBuffer *ring, gsize len);
+void virt_viewer_ring_buffer_clear(VirtViewerRingBuffer *ring);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_RING_BUFFER_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -31,10 +31,12 @@
 #include <usb-device-widget.h>
 #include "virt-viewer-file.h"
 #include "virt-viewer-file-transfer-dialog.h"
+#include "virt-viewer-file-transfer-queue.h"
 #include "virt-viewer-util.h"
 #include "virt-viewer-session-spice.h"
 #include "virt-viewer-display-spice.h"
 #include "virt-viewer-display-vte.h"
+#include "virt-viewer-ring-buffer.h"
 #include "virt-viewer-auth.h"
 
 #if SPICE_GTK_CHECK_VERSION(0,36,0)
@@ -53,6 +55,10 @@ struct _VirtViewerSessionSpicePrivate {
     guint pass_try;
     gboolean did_auto_conf;
     VirtViewerFileTransferDialog *file_transfer_dialog;
+    VirtViewerFileTransferQueue *file_transfer_queue;
+    /* files to transfer once the agent connects, and when that started */
+    gchar **send_files;
+    gint64 send_files_start;
     GError *disconnect_error;
 #ifdef WITH_QMP_PORT
     SpiceQmpPort *qmp;
@@ -157,10 +163,15 @@ virt_viewer_session_spice_dispose(GObject *obj)
     spice->priv->audio = NULL;
 
     g_clear_object(&spice->priv->main_window);
+    if (spice->priv->file_transfer_queue) {
+        virt_viewer_file_transfer_queue_cancel(spice->priv->file_transfer_queue);
+        g_clear_object(&spice->priv->file_transfer_queue);
+    }
     if (spice->priv->file_transfer_dialog) {
         gtk_widget_destroy(GTK_WIDGET(spice->priv->file_transfer_dialog));
         spice->priv->file_transfer_dialog = NULL;
     }
+    g_clear_pointer(&spice->priv->send_files, g_strfreev);
     g_clear_error(&spice->priv->disconnect_error);
 
     G_OBJECT_CLASS(virt_viewer_session_spice_parent_class)->dispose(obj);
@@ -187,6 +198,39 @@ virt_viewer_session_spice_can_retry_auth(VirtViewerSession *session G_GNUC_UNUSE
     return TRUE;
 }
 
+static void
+virt_viewer_session_spice_get_stats(VirtViewerSession *session, GVariantBuilder *stats)
+{
+    VirtViewerSessionSpice *self = VIRT_VIEWER_SESSION_SPICE(session);
+    GList *l, *channels;
+    guint64 total = 0;
+    guint n_channels = 0;
+
+    channels = spice_session_get_channels(self->priv->session);
+    for (l = channels; l != NULL; l = l->next) {
+        gulong bytes;
+
+        g_object_get(l->data, "total-read-bytes", &bytes, NULL);
+        total += bytes;
+        n_channels++;
+    }
+    g_list_free(channels);
+
+    g_variant_builder_add(stats, "{sv}", "channels", g_variant_new_uint32(n_channels));
+    g_variant_builder_add(stats, "{sv}", "bytes-received", g_variant_new_uint64(total));
+
+    if (self->priv->file_transfer_queue) {
+        guint n_completed, n_failed;
+        guint64 size;
+
+        virt_viewer_file_transfer_queue_get_stats(self->priv->file_transfer_queue,
+                                                  &n_completed, &n_failed, &size);
+        g_variant_builder_add(stats, "{sv}", "files-sent", g_variant_new_uint32(n_completed));
+        g_variant_builder_add(stats, "{sv}", "files-failed", g_variant_new_uint32(n_failed));
+        g_variant_builder_add(stats, "{sv}", "file-bytes-sent", g_variant_new_uint64(size));
+    }
+}
+
 static void
 create_spice_session(VirtViewerSessionSpice *self);
 
@@ -223,10 +267,75 @@ update_share_folder(VirtViewerSessionSpice *self)
     g_list_free(channels);
 }
 
+static void
+file_transfer_queue_changed(VirtViewerFileTransferQueue *queue,
+                            VirtViewerSessionSpice *self)
+{
+    guint n_queued;
+    guint64 queued_size;
+    gboolean busy;
+
+    n_queued = virt_viewer_file_transfer_queue_get_n_queued(queue, &queued_size);
+    busy = virt_viewer_file_transfer_queue_is_busy(queue);
+    if (self->priv->file_transfer_dialog != NULL)
+        virt_viewer_file_transfer_dialog_set_queued(self->priv->file_transfer_dialog,
+                                                    n_queued, queued_size, busy);
+
+    if (self->priv->send_files_start != 0 && !busy) {
+        gint64 duration = g_get_monotonic_time() - self->priv->send_files_start;
+        guint n_completed, n_failed;
+        guint64 size;
+
+        self->priv->send_files_start = 0;
+        virt_viewer_file_transfer_queue_get_stats(queue, &n_completed, &n_failed, &size);
+        g_debug("Sent %u files (%" G_GUINT64_FORMAT " bytes) in %.3fs, %u failed",
+                n_completed, size, (gdouble)duration / G_USEC_PER_SEC, n_failed);
+        g_signal_emit_by_name(self, "send-files-finished",
+                              n_completed, n_failed, size, duration);
+    }
+}
+
+static void
+file_transfer_dialog_response(GtkDialog *dialog G_GNUC_UNUSED,
+                              gint response_id,
+                              VirtViewerSessionSpice *self)
+{
+    if (response_id == GTK_RESPONSE_CANCEL && self->priv->file_transfer_queue)
+        virt_viewer_file_transfer_queue_cancel(self->priv->file_transfer_queue);
+}
+
+/* The dialog is only needed once a transfer starts, most sessions never
+ * build it */
+static VirtViewerFileTransferDialog *
+get_file_transfer_dialog(VirtViewerSessionSpice *self)
+{
+    guint n_queued;
+    guint64 queued_size;
+
+    if (self->priv->file_transfer_dialog != NULL)
+        return self->priv->file_transfer_dialog;
+
+    self->priv->file_transfer_dialog =
+        virt_viewer_file_transfer_dialog_new(self->priv->main_window);
+    virt_viewer_signal_connect_object(self->priv->file_transfer_dialog, "response",
+                                      G_CALLBACK(file_transfer_dialog_response), self, 0);
+
+    if (self->priv->file_transfer_queue) {
+        n_queued = virt_viewer_file_transfer_queue_get_n_queued(self->priv->file_transfer_queue,
+                                                                &queued_size);
+        virt_viewer_file_transfer_dialog_set_queued(self->priv->file_transfer_dialog,
+                                                    n_queued, queued_size,
+                                                    virt_viewer_file_transfer_queue_is_busy(self->priv->file_transfer_queue));
+    }
+
+    return self->priv->file_transfer_dialog;
+}
+
 static void
 virt_viewer_session_spice_constructed(GObject *obj)
 {
     VirtViewerSessionSpice *self = VIRT_VIEWER_SESSION_SPICE(obj);
+    VirtViewerApp *app;
 
     create_spice_session(self);
 
@@ -239,8 +348,11 @@ virt_viewer_session_spice_constructed(GObject *obj)
                                       G_CALLBACK(update_share_folder), self,
                                       G_CONNECT_SWAPPED);
 
-    self->priv->file_transfer_dialog =
-        virt_viewer_file_transfer_dialog_new(self->priv->main_window);
+    app = virt_viewer_session_get_app(VIRT_VIEWER_SESSION(self));
+    self->priv->file_transfer_queue =
+        virt_viewer_file_transfer_queue_new(self, virt_viewer_app_get_config_max_file_transfers(app));
+    virt_viewer_signal_connect_object(self->priv->file_transfer_queue, "changed",
+                                      G_CALLBACK(file_transfer_queue_changed), self, 0);
 
     G_OBJECT_CLASS(virt_viewer_session_spice_parent_class)->constructed(obj);
 }
@@ -269,6 +381,7 @@ virt_viewer_session_spice_class_init(VirtViewerSessionSpiceClass *klass)
     dclass->can_share_folder = virt_viewer_session_spice_can_share_folder;
     dclass->can_retry_auth = virt_viewer_session_spice_can_retry_auth;
     dclass->vm_action = virt_viewer_session_spice_vm_action;
+    dclass->get_stats = virt_viewer_session_spice_get_stats;
 
     g_object_class_install_property(oclass,
                                     PROP_SPICE_SESSION,
@@ -289,6 +402,23 @@ virt_viewer_session_spice_class_init(VirtViewerSessionSpiceClass *klass)
     g_object_class_override_property(oclass,
                                      PROP_SW_SMARTCARD_READER,
                                      "software-smartcard-reader");
+
+    /* Emitted once the files set with
+     * virt_viewer_session_spice_set_send_files() have been transferred,
+     * with the number of files sent and failed, the number of bytes sent
+     * and the time it took in microseconds */
+    g_signal_new("send-files-finished",
+                 G_OBJECT_CLASS_TYPE(oclass),
+                 G_SIGNAL_RUN_FIRST,
+                 0,
+                 NULL, NULL,
+                 NULL,
+                 G_TYPE_NONE,
+                 4,
+                 G_TYPE_UINT,
+                 G_TYPE_UINT,
+                 G_TYPE_UINT64,
+                 G_TYPE_INT64);
 }
 
 static void
@@ -495,6 +625,38 @@ virt_viewer_session_spice_close(VirtViewerSession *session)
     create_spice_session(self);
 }
 
+/* Images are decoded on the CPUs that encode them when the server runs on
+ * this host, compressing them only costs time there */
+static void
+virt_viewer_session_spice_prefer_local(VirtViewerSessionSpice *self)
+{
+    VirtViewerSession *session = VIRT_VIEWER_SESSION(self);
+    gchar *host = NULL, *unix_path = NULL;
+    gint compression;
+    gboolean local;
+
+    g_object_get(self->priv->session,
+                 "host", &host,
+                 "unix-path", &unix_path,
+                 "preferred-compression", &compression,
+                 NULL);
+    /* URIs and files aren't looked at by the app */
+    local = virt_viewer_session_get_local(session) ||
+        (virt_viewer_app_get_config_local_fast_path(virt_viewer_session_get_app(session)) &&
+         (unix_path != NULL || (host != NULL && virt_viewer_util_is_loopback(host))));
+    g_free(host);
+    g_free(unix_path);
+
+    /* --spice-preferred-compression wins */
+    if (!local || compression != SPICE_IMAGE_COMPRESSION_INVALID)
+        return;
+
+    g_debug("Asking the server for uncompressed images");
+    g_object_set(self->priv->session,
+                 "preferred-compression", SPICE_IMAGE_COMPRESSION_OFF,
+                 NULL);
+}
+
 static gboolean
 virt_viewer_session_spice_open_host(VirtViewerSession *session,
                                     const gchar *host,
@@ -511,6 +673,7 @@ virt_viewer_session_spice_open_host(VirtViewerSession *session,
                  "port", port,
                  "tls-port", tlsport,
                  NULL);
+    virt_viewer_session_spice_prefer_local(self);
 
     return spice_session_connect(self->priv->session);
 }
@@ -653,6 +816,7 @@ virt_viewer_session_spice_open_uri(VirtViewerSession *session,
     } else {
         g_object_set(self->priv->session, "uri", uri, NULL);
     }
+    virt_viewer_session_spice_prefer_local(self);
 
     return spice_session_connect(self->priv->session);
 }
@@ -665,6 +829,8 @@ virt_viewer_session_spice_open_fd(VirtViewerSession *session,
 
     g_return_val_if_fail(self != NULL, FALSE);
 
+    virt_viewer_session_spice_prefer_local(self);
+
     return spice_session_open_fd(self->priv->session, fd);
 }
 
@@ -852,6 +1018,26 @@ virt_viewer_session_spice_usb_device_selection(VirtViewerSession *session,
     gtk_widget_destroy(dialog);
 }
 
+static void
+send_files_start(VirtViewerSessionSpice *self)
+{
+    guint i, n_files = g_strv_length(self->priv->send_files);
+    GFile **files = g_new0(GFile *, n_files + 1);
+
+    for (i = 0; i < n_files; i++)
+        files[i] = g_file_new_for_commandline_arg(self->priv->send_files[i]);
+    g_clear_pointer(&self->priv->send_files, g_strfreev);
+
+    g_debug("Agent connected, sending %u files or directories", n_files);
+    virt_viewer_file_transfer_queue_reset_stats(self->priv->file_transfer_queue);
+    self->priv->send_files_start = g_get_monotonic_time();
+    virt_viewer_file_transfer_queue_add_files(self->priv->file_transfer_queue, files);
+
+    for (i = 0; i < n_files; i++)
+        g_object_unref(files[i]);
+    g_free(files);
+}
+
 static void
 agent_connected_changed(SpiceChannel *cmain G_GNUC_UNUSED,
                         GParamSpec *pspec G_GNUC_UNUSED,
@@ -867,6 +1053,9 @@ agent_connected_changed(SpiceChannel *cmain G_GNUC_UNUSED,
         /* this will force update displays geometry when the agent has connected
          * after the application (eg: rebooting the guest) */
         virt_viewer_session_update_displays_geometry(VIRT_VIEWER_SESSION(self));
+
+        if (self->priv->send_files != NULL)
+            send_files_start(self);
     }
 }
 
@@ -974,41 +1163,147 @@ on_new_file_transfer(SpiceMainChannel *channel G_GNUC_UNUSED,
                      gpointer user_data)
 {
     VirtViewerSessionSpice *self = VIRT_VIEWER_SESSION_SPICE(user_data);
-    virt_viewer_file_transfer_dialog_add_task(self->priv->file_transfer_dialog,
+    virt_viewer_file_transfer_dialog_add_task(get_file_transfer_dialog(self),
                                               task);
 }
 
+/* Bytes of console input buffered per port while a write is in flight */
+#define PORT_WRITE_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+    VirtViewerRingBuffer *ring;
+    /* Whatever didn't fit in the ring, only ever holds one oversized commit
+     * since input is disabled until it has been drained */
+    GByteArray *overflow;
+    gsize in_flight;
+    gboolean input_blocked;
+} PortWriter;
+
+static void
+port_writer_free(gpointer data)
+{
+    PortWriter *writer = data;
+
+    virt_viewer_ring_buffer_free(writer->ring);
+    g_byte_array_unref(writer->overflow);
+    g_free(writer);
+}
+
+static PortWriter *
+port_writer_get(SpicePortChannel *port)
+{
+    PortWriter *writer = g_object_get_data(G_OBJECT(port), "virt-viewer-port-writer");
+
+    if (writer == NULL) {
+        writer = g_new0(PortWriter, 1);
+        writer->ring = virt_viewer_ring_buffer_new(PORT_WRITE_BUFFER_SIZE);
+        writer->overflow = g_byte_array_new();
+        g_object_set_data_full(G_OBJECT(port), "virt-viewer-port-writer",
+                               writer, port_writer_free);
+    }
+
+    return writer;
+}
+
+static void
+port_writer_set_input_blocked(SpicePortChannel *port, PortWriter *writer,
+                              gboolean blocked)
+{
+    VirtViewerDisplayVte *vte = g_object_get_data(G_OBJECT(port), "virt-viewer-vte");
+
+    if (writer->input_blocked == blocked)
+        return;
+
+    g_debug("%s console input on port %p", blocked ? "Blocking" : "Unblocking", port);
+    writer->input_blocked = blocked;
+    if (vte != NULL)
+        virt_viewer_display_vte_set_input_enabled(vte, !blocked);
+}
+
+static void spice_port_write_finished(GObject *source_object,
+                                      GAsyncResult *res,
+                                      gpointer user_data);
+
+static void
+port_writer_flush(SpicePortChannel *port, PortWriter *writer)
+{
+    const guint8 *data;
+
+    if (writer->in_flight > 0)
+        return;
+
+    /* The ring is not touched below the read position until the write
+     * completes, so the data can be handed to spice-gtk without a copy */
+    data = virt_viewer_ring_buffer_peek(writer->ring, &writer->in_flight);
+    if (writer->in_flight == 0)
+        return;
+
+    spice_port_channel_write_async(port, data, writer->in_flight,
+                                   NULL, spice_port_write_finished, NULL);
+}
+
 static void
 spice_port_write_finished(GObject *source_object,
                           GAsyncResult *res,
-                          gpointer dup)
+                          gpointer user_data G_GNUC_UNUSED)
 {
     SpicePortChannel *port = SPICE_PORT_CHANNEL(source_object);
+    PortWriter *writer = port_writer_get(port);
     GError *err = NULL;
+    gsize moved;
 
     spice_port_channel_write_finish(port, res, &err);
+    virt_viewer_ring_buffer_consume(writer->ring, writer->in_flight);
+    writer->in_flight = 0;
     if (err) {
         g_warning("Spice port write failed: %s", err->message);
         g_error_free(err);
+        virt_viewer_ring_buffer_clear(writer->ring);
+        g_byte_array_set_size(writer->overflow, 0);
     }
-    g_free(dup);
+
+    if (writer->overflow->len > 0) {
+        moved = virt_viewer_ring_buffer_write(writer->ring, writer->overflow->data,
+                                              writer->overflow->len);
+        g_byte_array_remove_range(writer->overflow, 0, moved);
+    }
+
+    /* Let the user type again once there is room for a burst of input */
+    if (writer->overflow->len == 0 &&
+        virt_viewer_ring_buffer_get_space(writer->ring) >= PORT_WRITE_BUFFER_SIZE / 2)
+        port_writer_set_input_blocked(port, writer, FALSE);
+
+    port_writer_flush(port, writer);
 }
 
 static void
 spice_vte_commit(SpicePortChannel *port, const char *text,
                  guint size, gpointer user_data G_GNUC_UNUSED)
 {
-    void *dup = g_memdup(text, size);
+    PortWriter *writer = port_writer_get(port);
+    gsize stored = 0;
+
+    /* Commits that arrive while a write is in flight are coalesced in the
+     * ring and sent together by the next write */
+    if (writer->overflow->len == 0)
+        stored = virt_viewer_ring_buffer_write(writer->ring, (const guint8 *)text, size);
+
+    if (stored < size) {
+        g_byte_array_append(writer->overflow, (const guint8 *)text + stored, size - stored);
+        port_writer_set_input_blocked(port, writer, TRUE);
+    }
 
-    /* note: spice-gtk queues write */
-    spice_port_channel_write_async(port, dup, size,
-                                   NULL, spice_port_write_finished, dup);
+    port_writer_flush(port, writer);
 }
 
 static void
 spice_port_data(VirtViewerDisplayVte *vte, gpointer data, int size,
-                SpicePortChannel *port G_GNUC_UNUSED)
+                SpicePortChannel *port)
 {
+    VirtViewerConsoleLog *log = g_object_get_data(G_OBJECT(port), "virt-viewer-console-log");
+
+    if (log != NULL)
+        virt_viewer_console_log_append(log, data, size);
     virt_viewer_display_vte_feed(vte, data, size);
 }
 
@@ -1151,28 +1446,40 @@ spice_port_opened(SpiceChannel *channel, GParamSpec *pspec G_GNUC_UNUSED,
     }
 #endif
 
-    g_free(name);
     vte = g_object_get_data(G_OBJECT(port), "virt-viewer-vte");
     if (vte) {
         if (opened)
-            return;
+            goto end;
 
         g_object_set_data(G_OBJECT(port), "virt-viewer-vte", NULL);
+        g_object_set_data(G_OBJECT(port), "virt-viewer-console-log", NULL);
         virt_viewer_session_remove_display(VIRT_VIEWER_SESSION(self), VIRT_VIEWER_DISPLAY(vte));
         g_object_unref(vte);
 
     } else if (opened) {
+        VirtViewerApp *app = virt_viewer_session_get_app(VIRT_VIEWER_SESSION(self));
+        PortWriter *writer;
+
         if (!vte_name)
-            return;
+            goto end;
 
+        g_object_set_data_full(G_OBJECT(port), "virt-viewer-console-log",
+                               virt_viewer_app_open_console_log(app, name),
+                               (GDestroyNotify)virt_viewer_console_log_free);
         vte = virt_viewer_display_vte_new(VIRT_VIEWER_SESSION(self), vte_name);
         g_object_set_data(G_OBJECT(port), "virt-viewer-vte", g_object_ref_sink(vte));
+        writer = g_object_get_data(G_OBJECT(port), "virt-viewer-port-writer");
+        if (writer != NULL && writer->input_blocked)
+            virt_viewer_display_vte_set_input_enabled(vte, FALSE);
         virt_viewer_session_add_display(VIRT_VIEWER_SESSION(self), VIRT_VIEWER_DISPLAY(vte));
         virt_viewer_signal_connect_object(vte, "commit",
                                           G_CALLBACK(spice_vte_commit), port, G_CONNECT_SWAPPED);
         virt_viewer_signal_connect_object(port, "port-data",
                                           G_CALLBACK(spice_port_data), vte, G_CONNECT_SWAPPED);
     }
+
+end:
+    g_free(name);
 }
 
 static void
@@ -1367,6 +1674,7 @@ virt_viewer_session_spice_channel_destroyed(G_GNUC_UNUSED SpiceSession *s,
         g_debug("zap port channel (#%d)", id);
         if (vte) {
             g_object_set_data(G_OBJECT(channel), "virt-viewer-vte", NULL);
+            g_object_set_data(G_OBJECT(channel), "virt-viewer-console-log", NULL);
             virt_viewer_session_remove_display(VIRT_VIEWER_SESSION(self), VIRT_VIEWER_DISPLAY(vte));
             g_object_unref(vte);
         }
@@ -1412,6 +1720,29 @@ virt_viewer_session_spice_get_main_channel(VirtViewerSessionSpice *self)
     return self->priv->main_channel;
 }
 
+/* Sets the files or directories, as paths or URIs, to transfer as soon as
+ * the guest agent connects. "send-files-finished" is emitted when done */
+void
+virt_viewer_session_spice_set_send_files(VirtViewerSessionSpice *self,
+                                         const gchar * const *files)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_SESSION_SPICE(self));
+
+    g_strfreev(self->priv->send_files);
+    self->priv->send_files = g_strdupv((gchar **)files);
+}
+
+/* Transfers @files, a NULL-terminated array of files and directories, to
+ * the guest through the spice agent */
+void
+virt_viewer_session_spice_transfer_files(VirtViewerSessionSpice *self,
+                                         GFile **files)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_SESSION_SPICE(self));
+
+    virt_viewer_file_transfer_queue_add_files(self->priv->file_transfer_queue, files);
+}
+
 static void
 virt_viewer_session_spice_smartcard_insert(VirtViewerSession *session G_GNUC_UNUSED)
 {
@@ -66,6 +66,9 @@ GType virt_viewer_session_spice_get_type(void);
 
 VirtViewerSession* virt_viewer_session_spice_new(VirtViewerApp *app, GtkWindow *main_window);
 SpiceMainChannel* virt_viewer_session_spice_get_main_channel(VirtViewerSessionSpice *self);
+void virt_viewer_session_spice_transfer_files(VirtViewerSessionSpice *self, GFile **files);
+void virt_viewer_session_spice_set_send_files(VirtViewerSessionSpice *self,
+                                              const gchar * const *files);
 
 G_END_DECLS
 
@@ -42,6 +42,11 @@ struct _VirtViewerSessionPrivate
     gboolean share_folder;
     gchar *shared_folder;
     gboolean share_folder_ro;
+    /* only allocated when tracing input latency */
+    VirtViewerLatency *latency[VIRT_VIEWER_LATENCY_N_KINDS];
+    gboolean local;
+    /* the displays are going away with the connection */
+    gboolean clearing_displays;
 };
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE(VirtViewerSession, virt_viewer_session, G_TYPE_OBJECT)
@@ -65,6 +70,8 @@ virt_viewer_session_finalize(GObject *obj)
     VirtViewerSession *session = VIRT_VIEWER_SESSION(obj);
     GList *tmp = session->priv->displays;
 
+    virt_viewer_session_set_trace_latency(session, FALSE);
+
     while (tmp) {
         g_object_unref(tmp->data);
         tmp = tmp->next;
@@ -477,6 +484,7 @@ void virt_viewer_session_clear_displays(VirtViewerSession *session)
 {
     GList *tmp = session->priv->displays;
 
+    session->priv->clearing_displays = TRUE;
     while (tmp) {
         VirtViewerDisplay *display = VIRT_VIEWER_DISPLAY(tmp->data);
         g_signal_emit_by_name(session, "session-display-removed", display);
@@ -486,6 +494,16 @@ void virt_viewer_session_clear_displays(VirtViewerSession *session)
     }
     g_list_free(session->priv->displays);
     session->priv->displays = NULL;
+    session->priv->clearing_displays = FALSE;
+}
+
+/* Whether the display being removed goes because the connection closes,
+ * rather than because the guest stopped using it */
+gboolean virt_viewer_session_get_clearing_displays(VirtViewerSession *self)
+{
+    g_return_val_if_fail(VIRT_VIEWER_IS_SESSION(self), FALSE);
+
+    return self->priv->clearing_displays;
 }
 
 void virt_viewer_session_update_displays_geometry(VirtViewerSession *session)
@@ -697,6 +715,115 @@ void virt_viewer_session_vm_action(VirtViewerSession *self, gint action)
     if (klass->vm_action)
         klass->vm_action(self, action);
 }
+
+/* Adds protocol specific statistics, and input latencies when they are
+ * traced, to the a{sv} @stats */
+void virt_viewer_session_get_stats(VirtViewerSession *self, GVariantBuilder *stats)
+{
+    static const gdouble percentiles[] = { 50, 95, 99 };
+    VirtViewerSessionClass *klass;
+    guint i, j;
+
+    g_return_if_fail(VIRT_VIEWER_IS_SESSION(self));
+
+    klass = VIRT_VIEWER_SESSION_GET_CLASS(self);
+
+    if (klass->get_stats)
+        klass->get_stats(self, stats);
+
+    for (i = 0; i < VIRT_VIEWER_LATENCY_N_KINDS; i++) {
+        VirtViewerLatency *latency = self->priv->latency[i];
+        const gchar *kind = virt_viewer_latency_kind_to_string(i);
+        gchar *key;
+
+        if (latency == NULL || virt_viewer_latency_get_count(latency) == 0)
+            continue;
+
+        key = g_strdup_printf("latency-%s-count", kind);
+        g_variant_builder_add(stats, "{sv}", key,
+                              g_variant_new_uint64(virt_viewer_latency_get_count(latency)));
+        g_free(key);
+
+        /* in microseconds */
+        for (j = 0; j < G_N_ELEMENTS(percentiles); j++) {
+            key = g_strdup_printf("latency-%s-p%.0f", kind, percentiles[j]);
+            g_variant_builder_add(stats, "{sv}", key,
+                                  g_variant_new_int64(virt_viewer_latency_get_percentile(latency, percentiles[j])));
+            g_free(key);
+        }
+    }
+}
+
+static void
+virt_viewer_session_log_latency(VirtViewerSession *self, VirtViewerLatencyKind kind)
+{
+    gchar *summary = virt_viewer_latency_to_string(self->priv->latency[kind]);
+
+    g_debug("Input latency %s: %s", virt_viewer_latency_kind_to_string(kind), summary);
+    g_free(summary);
+}
+
+/* Input latency tracing, displays time keyboard and pointer events from the
+ * moment they reach the display widget */
+void virt_viewer_session_set_trace_latency(VirtViewerSession *self, gboolean trace)
+{
+    VirtViewerSessionPrivate *priv;
+    guint i;
+
+    g_return_if_fail(VIRT_VIEWER_IS_SESSION(self));
+
+    priv = self->priv;
+    for (i = 0; i < VIRT_VIEWER_LATENCY_N_KINDS; i++) {
+        if (trace && priv->latency[i] == NULL) {
+            priv->latency[i] = virt_viewer_latency_new();
+        } else if (!trace && priv->latency[i] != NULL) {
+            if (virt_viewer_latency_get_count(priv->latency[i]) > 0)
+                virt_viewer_session_log_latency(self, i);
+            g_clear_pointer(&priv->latency[i], virt_viewer_latency_free);
+        }
+    }
+}
+
+gboolean virt_viewer_session_get_trace_latency(VirtViewerSession *self)
+{
+    g_return_val_if_fail(VIRT_VIEWER_IS_SESSION(self), FALSE);
+
+    return self->priv->latency[0] != NULL;
+}
+
+/* The display server runs on this host, set before the session is opened */
+void virt_viewer_session_set_local(VirtViewerSession *self, gboolean local)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_SESSION(self));
+
+    self->priv->local = local;
+}
+
+gboolean virt_viewer_session_get_local(VirtViewerSession *self)
+{
+    g_return_val_if_fail(VIRT_VIEWER_IS_SESSION(self), FALSE);
+
+    return self->priv->local;
+}
+
+void virt_viewer_session_add_latency(VirtViewerSession *self,
+                                     VirtViewerLatencyKind kind,
+                                     gint64 usec)
+{
+    VirtViewerLatency *latency;
+
+    g_return_if_fail(VIRT_VIEWER_IS_SESSION(self));
+    g_return_if_fail(kind < VIRT_VIEWER_LATENCY_N_KINDS);
+
+    latency = self->priv->latency[kind];
+    if (latency == NULL)
+        return;
+
+    virt_viewer_latency_add(latency, usec);
+    /* often enough to follow a typing session in the log */
+    if (virt_viewer_latency_get_count(latency) % 256 == 0)
+        virt_viewer_session_log_latency(self, kind);
+}
 /*
  * Local variables:
  *  c-indent-level: 4
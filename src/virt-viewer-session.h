@@ -29,6 +29,7 @@
 #include "virt-viewer-app.h"
 #include "virt-viewer-file.h"
 #include "virt-viewer-display.h"
+#include "virt-viewer-latency.h"
 
 G_BEGIN_DECLS
 
@@ -88,6 +89,8 @@ struct _VirtViewerSessionClass {
     gboolean (*can_share_folder)(VirtViewerSession *session);
     gboolean (*can_retry_auth)(VirtViewerSession *session);
     void (*vm_action)(VirtViewerSession *session, gint action);
+    /* adds a{sv} entries */
+    void (*get_stats)(VirtViewerSession *session, GVariantBuilder *stats);
 };
 
 GType virt_viewer_session_get_type(void);
@@ -99,6 +102,7 @@ void virt_viewer_session_add_display(VirtViewerSession *session,
 void virt_viewer_session_remove_display(VirtViewerSession *session,
                                         VirtViewerDisplay *display);
 void virt_viewer_session_clear_displays(VirtViewerSession *session);
+gboolean virt_viewer_session_get_clearing_displays(VirtViewerSession *self);
 void virt_viewer_session_update_displays_geometry(VirtViewerSession *session);
 
 void virt_viewer_session_close(VirtViewerSession* session);
@@ -126,6 +130,15 @@ gboolean virt_viewer_session_can_share_folder(VirtViewerSession *self);
 gboolean virt_viewer_session_can_retry_auth(VirtViewerSession *self);
 
 void virt_viewer_session_vm_action(VirtViewerSession *self, gint action);
+void virt_viewer_session_get_stats(VirtViewerSession *self, GVariantBuilder *stats);
+
+void virt_viewer_session_set_trace_latency(VirtViewerSession *self, gboolean trace);
+gboolean virt_viewer_session_get_trace_latency(VirtViewerSession *self);
+void virt_viewer_session_set_local(VirtViewerSession *self, gboolean local);
+gboolean virt_viewer_session_get_local(VirtViewerSession *self);
+void virt_viewer_session_add_latency(VirtViewerSession *self,
+                                     VirtViewerLatencyKind kind,
+                                     gint64 usec);
 
 G_END_DECLS
 
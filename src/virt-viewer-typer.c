@@ -0,0 +1,240 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <gtk/gtk.h>
+
+#include "virt-viewer-typer.h"
+
+#define TYPER_DATA "virt-viewer-typer"
+#define TYPER_INTERVAL_MS 10
+#define TYPER_MIN_RATE 5
+/* never more than this many characters from one main loop iteration */
+#define TYPER_MAX_BATCH 32
+
+/* Keys pressed together for one character, modifiers first */
+typedef struct {
+    guint keyvals[3];
+    guint nkeyvals;
+} TyperKeys;
+
+typedef struct {
+    VirtViewerDisplay *display; /* weak reference, the display owns us */
+    GArray *keys;
+    guint pos;
+
+    guint max_rate;
+    guint rate; /* characters per second */
+    gdouble budget;
+    gint64 start;
+    gint64 last_tick;
+    guint timeout_id;
+} VirtViewerTyper;
+
+static gboolean
+typer_lookup(GdkKeymap *keymap, gunichar c, TyperKeys *keys)
+{
+    GdkKeymapKey *entries, key;
+    gint i, n_entries, best = -1;
+    guint keyval;
+
+    keys->nkeyvals = 0;
+
+    if (c == '\n') {
+        keys->keyvals[keys->nkeyvals++] = GDK_KEY_Return;
+        return TRUE;
+    }
+    if (c == '\t') {
+        keys->keyvals[keys->nkeyvals++] = GDK_KEY_Tab;
+        return TRUE;
+    }
+
+    keyval = gdk_unicode_to_keyval(c);
+    if (keymap == NULL ||
+        !gdk_keymap_get_entries_for_keyval(keymap, keyval, &entries, &n_entries))
+        return FALSE;
+
+    /* switching groups can't be expressed with key presses, and the lowest
+     * level needs the fewest modifiers */
+    for (i = 0; i < n_entries; i++) {
+        if (entries[i].group == 0 && entries[i].level < 4 &&
+            (best < 0 || entries[i].level < entries[best].level))
+            best = i;
+    }
+    if (best < 0) {
+        g_free(entries);
+        return FALSE;
+    }
+
+    key = entries[best];
+    g_free(entries);
+    if (key.level & 2)
+        keys->keyvals[keys->nkeyvals++] = GDK_KEY_ISO_Level3_Shift;
+    if (key.level & 1)
+        keys->keyvals[keys->nkeyvals++] = GDK_KEY_Shift_L;
+
+    /* the key itself is sent as its unmodified symbol, that's what maps back
+     * to its keycode */
+    key.level = 0;
+    keyval = gdk_keymap_lookup_key(keymap, &key);
+    if (keyval == 0)
+        return FALSE;
+    keys->keyvals[keys->nkeyvals++] = keyval;
+
+    return TRUE;
+}
+
+static void
+typer_free(VirtViewerTyper *self)
+{
+    if (self->timeout_id != 0)
+        g_source_remove(self->timeout_id);
+    g_array_unref(self->keys);
+    g_free(self);
+}
+
+static gboolean
+typer_tick(gpointer user_data)
+{
+    VirtViewerTyper *self = user_data;
+    gint64 now = g_get_monotonic_time();
+    gint64 elapsed = now - self->last_tick;
+    guint n;
+
+    self->last_tick = now;
+
+    /* keys would be lost while the display isn't connected */
+    if (!(virt_viewer_display_get_show_hint(self->display) & VIRT_VIEWER_DISPLAY_SHOW_HINT_READY))
+        return G_SOURCE_CONTINUE;
+
+    /* Neither protocol acknowledges key events, the only sign that the guest
+     * and the connection are falling behind is the main loop coming back to
+     * us late because it's busy with their updates. Back off quickly then,
+     * and speed up slowly otherwise. */
+    if (elapsed > 2 * TYPER_INTERVAL_MS * G_TIME_SPAN_MILLISECOND) {
+        self->rate = MAX(self->rate / 2, TYPER_MIN_RATE);
+        elapsed = TYPER_INTERVAL_MS * G_TIME_SPAN_MILLISECOND;
+    } else if (self->rate < self->max_rate) {
+        self->rate++;
+    }
+
+    self->budget += self->rate * (gdouble)elapsed / G_TIME_SPAN_SECOND;
+    n = MIN((guint)self->budget, TYPER_MAX_BATCH);
+    self->budget -= n;
+
+    for (; n > 0 && self->pos < self->keys->len; n--) {
+        TyperKeys *keys = &g_array_index(self->keys, TyperKeys, self->pos++);
+
+        virt_viewer_display_send_keys(self->display, keys->keyvals, keys->nkeyvals);
+    }
+
+    if (self->pos < self->keys->len)
+        return G_SOURCE_CONTINUE;
+
+    g_debug("Typed %u characters in %.1f s, %u per second at the end",
+            self->keys->len,
+            (now - self->start) / (gdouble)G_TIME_SPAN_SECOND,
+            self->rate);
+    self->timeout_id = 0;
+    g_object_set_data(G_OBJECT(self->display), TYPER_DATA, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+guint
+virt_viewer_typer_start(VirtViewerDisplay *display,
+                        const gchar *text,
+                        guint max_rate)
+{
+    VirtViewerTyper *self;
+    GdkKeymap *keymap;
+    GHashTable *cache;
+    const gchar *p;
+    guint skipped = 0;
+
+    g_return_val_if_fail(VIRT_VIEWER_DISPLAY_CAN_SEND_KEYS(display), 0);
+    g_return_val_if_fail(text != NULL, 0);
+
+    keymap = gdk_keymap_get_for_display(gtk_widget_get_display(GTK_WIDGET(display)));
+    cache = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+    self = g_new0(VirtViewerTyper, 1);
+    self->display = display;
+    self->keys = g_array_new(FALSE, FALSE, sizeof(TyperKeys));
+    self->max_rate = MAX(max_rate, TYPER_MIN_RATE);
+    /* start slowly, guests often drop keys when a burst arrives */
+    self->rate = MAX(self->max_rate / 4, TYPER_MIN_RATE);
+
+    /* Looked up once per distinct character, passwords and scripts repeat a
+     * small set of them */
+    for (p = text; *p != '\0'; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+        TyperKeys *keys;
+
+        if (c == '\r') {
+            if (p[1] == '\n')
+                continue;
+            c = '\n';
+        }
+
+        keys = g_hash_table_lookup(cache, GUINT_TO_POINTER(c));
+        if (keys == NULL) {
+            keys = g_new0(TyperKeys, 1);
+            if (!typer_lookup(keymap, c, keys))
+                g_debug("No key for character U+%04X", c);
+            g_hash_table_insert(cache, GUINT_TO_POINTER(c), keys);
+        }
+
+        if (keys->nkeyvals == 0)
+            skipped++;
+        else
+            g_array_append_val(self->keys, *keys);
+    }
+    g_hash_table_unref(cache);
+
+    self->start = self->last_tick = g_get_monotonic_time();
+    if (self->keys->len > 0)
+        self->timeout_id = g_timeout_add(TYPER_INTERVAL_MS, typer_tick, self);
+
+    /* replaces, and so stops, whatever was still being typed */
+    g_object_set_data_full(G_OBJECT(display), TYPER_DATA, self,
+                           (GDestroyNotify)typer_free);
+    if (self->timeout_id == 0)
+        g_object_set_data(G_OBJECT(display), TYPER_DATA, NULL);
+
+    return skipped;
+}
+
+void
+virt_viewer_typer_stop(VirtViewerDisplay *display)
+{
+    g_return_if_fail(VIRT_VIEWER_IS_DISPLAY(display));
+
+    g_object_set_data(G_OBJECT(display), TYPER_DATA, NULL);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,52 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_TYPER_H
+#define VIRT_VIEWER_TYPER_H
+
+#include "virt-viewer-display.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Types text into a display as key presses, for guests which can't receive
+ * the clipboard. The keys are looked up in the client keyboard layout, the
+ * same one spice-gtk and gtk-vnc use to turn them into scancodes, so the
+ * guest has to use that layout too.
+ *
+ * Typing happens in the background at up to @max_rate characters per
+ * second, and replaces whatever was still being typed into @display.
+ * Returns the number of characters which have no key and are left out.
+ */
+guint virt_viewer_typer_start(VirtViewerDisplay *display,
+                              const gchar *text,
+                              guint max_rate);
+void virt_viewer_typer_stop(VirtViewerDisplay *display);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_TYPER_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -525,6 +525,52 @@ end:
     return ret;
 }
 
+gboolean
+virt_viewer_util_is_loopback(const char *host)
+{
+    GInetAddress *addr = NULL;
+    gboolean is_loopback = FALSE;
+
+    g_return_val_if_fail(host != NULL, FALSE);
+
+    addr = g_inet_address_new_from_string(host);
+    if (!addr) /* Parsing error means it was probably a hostname */
+        return (strcmp(host, "localhost") == 0);
+
+    is_loopback = g_inet_address_get_is_loopback(addr);
+    g_object_unref(addr);
+
+    return is_loopback;
+}
+
+/* Converts @len bytes of ISO-8859-1 @text to UTF-8 in a single pass. Every
+ * latin-1 character maps to the code point of the same value, so unlike
+ * g_convert() no iconv state is needed and the result size is known upfront. */
+gchar *
+virt_viewer_util_latin1_to_utf8(const gchar *text, gsize len)
+{
+    const guchar *in = (const guchar *)text;
+    gsize i, extra = 0;
+    gchar *utf8, *out;
+
+    for (i = 0; i < len; i++)
+        if (in[i] >= 0x80)
+            extra++;
+
+    out = utf8 = g_malloc(len + extra + 1);
+    for (i = 0; i < len; i++) {
+        if (in[i] < 0x80) {
+            *out++ = in[i];
+        } else {
+            *out++ = 0xc0 | (in[i] >> 6);
+            *out++ = 0x80 | (in[i] & 0x3f);
+        }
+    }
+    *out = '\0';
+
+    return utf8;
+}
+
 /* simple sorting of monitors. Primary sort left-to-right, secondary sort from
  * top-to-bottom, finally by monitor id */
 static int
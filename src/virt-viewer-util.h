@@ -56,6 +56,8 @@ gulong virt_viewer_signal_connect_object(gpointer instance,
 
 gchar* spice_hotkey_to_gtk_accelerator(const gchar *key);
 gint virt_viewer_compare_buildid(const gchar *s1, const gchar *s2);
+gchar *virt_viewer_util_latin1_to_utf8(const gchar *text, gsize len);
+gboolean virt_viewer_util_is_loopback(const char *host);
 
 /* monitor alignment */
 void virt_viewer_align_monitors_linear(GHashTable *displays);
@@ -0,0 +1,231 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib/gi18n.h>
+
+#include "virt-viewer-wan.h"
+#include "virt-viewer-util.h"
+
+/* Linux's minimum retransmission timeout */
+#define WAN_RETRANSMIT_TIMEOUT (200 * G_TIME_SPAN_MILLISECOND)
+
+static const struct {
+    const gchar *name;
+    VirtViewerWanProfile profile;
+} presets[] = {
+    { "lan", { 1, 0, 0, 0, 0 } },
+    { "dsl", { 20, 5, 8000, 0, 0 } },
+    { "vpn", { 60, 15, 4000, 0.5, 0 } },
+    { "mobile", { 100, 40, 1500, 1, 0 } },
+    { "satellite", { 300, 20, 2000, 0.5, 0 } },
+};
+
+typedef struct {
+    GRand *rand;
+    gint64 link_free; /* when the previous chunk is done being sent */
+} WanDirection;
+
+typedef struct {
+    VirtViewerWanProfile profile;
+    /* each direction is only used by its own relay thread */
+    WanDirection directions[VIRT_VIEWER_RELAY_N_DIRECTIONS];
+} WanFilter;
+
+static gboolean
+parse_uint(const gchar *key, const gchar *value, guint *result, GError **error)
+{
+    gchar *end;
+    guint64 n = g_ascii_strtoull(value, &end, 10);
+
+    if (*value == '\0' || *end != '\0' || n > G_MAXUINT) {
+        g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                    _("Invalid value for %s: %s"), key, value);
+        return FALSE;
+    }
+    *result = n;
+
+    return TRUE;
+}
+
+gboolean
+virt_viewer_wan_profile_parse(const gchar *spec,
+                              VirtViewerWanProfile *profile,
+                              GError **error)
+{
+    gchar **items;
+    gboolean ret = FALSE;
+    guint i, j;
+
+    g_return_val_if_fail(spec != NULL, FALSE);
+    g_return_val_if_fail(profile != NULL, FALSE);
+
+    memset(profile, 0, sizeof(*profile));
+    items = g_strsplit(spec, ",", -1);
+
+    for (i = 0; items[i] != NULL; i++) {
+        gchar *key = g_strstrip(items[i]);
+        gchar *value = strchr(key, '=');
+        guint seed;
+
+        if (value == NULL) {
+            /* a preset, the items after it can change parts of it */
+            for (j = 0; j < G_N_ELEMENTS(presets); j++) {
+                if (g_str_equal(key, presets[j].name))
+                    break;
+            }
+            if (j == G_N_ELEMENTS(presets)) {
+                g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                            _("Unknown network profile: %s"), key);
+                goto end;
+            }
+            *profile = presets[j].profile;
+            continue;
+        }
+
+        *value++ = '\0';
+        if (g_str_equal(key, "latency")) {
+            if (!parse_uint(key, value, &profile->latency, error))
+                goto end;
+        } else if (g_str_equal(key, "jitter")) {
+            if (!parse_uint(key, value, &profile->jitter, error))
+                goto end;
+        } else if (g_str_equal(key, "bandwidth")) {
+            if (!parse_uint(key, value, &profile->bandwidth, error))
+                goto end;
+        } else if (g_str_equal(key, "seed")) {
+            if (!parse_uint(key, value, &seed, error))
+                goto end;
+            profile->seed = seed;
+        } else if (g_str_equal(key, "loss")) {
+            gchar *end;
+
+            profile->loss = g_ascii_strtod(value, &end);
+            if (*value == '\0' || *end != '\0' || profile->loss < 0 || profile->loss > 100) {
+                g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                            _("Invalid value for %s: %s"), key, value);
+                goto end;
+            }
+        } else {
+            g_set_error(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                        _("Unknown network profile setting: %s"), key);
+            goto end;
+        }
+    }
+
+    /* jitter can't make the latency negative */
+    profile->jitter = MIN(profile->jitter, profile->latency);
+    ret = TRUE;
+
+end:
+    g_strfreev(items);
+    return ret;
+}
+
+gchar *
+virt_viewer_wan_profile_to_string(const VirtViewerWanProfile *profile)
+{
+    gchar loss[G_ASCII_DTOSTR_BUF_SIZE];
+
+    g_return_val_if_fail(profile != NULL, NULL);
+
+    return g_strdup_printf("latency=%u,jitter=%u,bandwidth=%u,loss=%s,seed=%u",
+                           profile->latency, profile->jitter, profile->bandwidth,
+                           g_ascii_dtostr(loss, sizeof(loss), profile->loss),
+                           profile->seed);
+}
+
+/* Packets leave once the previous one is sent over the emulated link and
+ * arrive after the latency. The relay queues them until then without
+ * waiting, so the link stays busy as with a large enough TCP window, and a
+ * lost packet holds back the ones after it, as in TCP. */
+static gint64
+wan_forward(gpointer filter_data,
+            VirtViewerRelayDirection direction,
+            const guint8 *data G_GNUC_UNUSED,
+            gsize len)
+{
+    WanFilter *filter = filter_data;
+    const VirtViewerWanProfile *profile = &filter->profile;
+    WanDirection *dir = &filter->directions[direction];
+    gint64 now = g_get_monotonic_time();
+    gint64 sent = now, delay = profile->latency * G_TIME_SPAN_MILLISECOND;
+
+    if (profile->jitter > 0)
+        delay += g_rand_int_range(dir->rand, -(gint32)profile->jitter, profile->jitter + 1) *
+            G_TIME_SPAN_MILLISECOND;
+
+    /* a lost packet costs the retransmission timeout and a round trip */
+    if (profile->loss > 0 && g_rand_double(dir->rand) * 100 < profile->loss)
+        delay += WAN_RETRANSMIT_TIMEOUT + 2 * profile->latency * G_TIME_SPAN_MILLISECOND;
+
+    if (profile->bandwidth > 0) {
+        /* kbit/s are bits per ms */
+        sent = MAX(now, dir->link_free) + len * 8 * G_TIME_SPAN_MILLISECOND / profile->bandwidth;
+        dir->link_free = sent;
+    }
+
+    return sent + delay - now;
+}
+
+static void
+wan_free(gpointer filter_data)
+{
+    WanFilter *filter = filter_data;
+    guint i;
+
+    for (i = 0; i < VIRT_VIEWER_RELAY_N_DIRECTIONS; i++)
+        g_rand_free(filter->directions[i].rand);
+    g_free(filter);
+}
+
+static const VirtViewerRelayFilter wan_filter = {
+    .needs_data = FALSE,
+    .delays = TRUE,
+    .forward = wan_forward,
+    .free = wan_free,
+};
+
+void
+virt_viewer_wan_add_relay(const VirtViewerWanProfile *profile, VirtViewerRelay *relay)
+{
+    WanFilter *filter;
+    guint i;
+
+    g_return_if_fail(profile != NULL);
+    g_return_if_fail(relay != NULL);
+
+    filter = g_new0(WanFilter, 1);
+    filter->profile = *profile;
+    for (i = 0; i < VIRT_VIEWER_RELAY_N_DIRECTIONS; i++)
+        filter->directions[i].rand = g_rand_new_with_seed(profile->seed + i);
+
+    virt_viewer_relay_add_filter(relay, &wan_filter, filter);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,57 @@
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIRT_VIEWER_WAN_H
+#define VIRT_VIEWER_WAN_H
+
+#include <glib.h>
+
+#include "virt-viewer-relay.h"
+
+G_BEGIN_DECLS
+
+/* How a relay slows the traffic down, in each direction */
+typedef struct {
+    guint latency;   /* milliseconds */
+    guint jitter;    /* milliseconds, up to this much more or less latency */
+    guint bandwidth; /* kbit/s, 0 for unlimited */
+    gdouble loss;    /* percentage of the packets that need resending */
+    guint32 seed;    /* for the jitter and losses, the same seed replays them */
+} VirtViewerWanProfile;
+
+/* Parses "[PRESET][,KEY=VALUE]…" where the keys are the fields above */
+gboolean virt_viewer_wan_profile_parse(const gchar *spec,
+                                       VirtViewerWanProfile *profile,
+                                       GError **error);
+gchar *virt_viewer_wan_profile_to_string(const VirtViewerWanProfile *profile);
+
+/* Emulates @profile on the traffic of @relay, before it is started */
+void virt_viewer_wan_add_relay(const VirtViewerWanProfile *profile, VirtViewerRelay *relay);
+
+G_END_DECLS
+
+#endif /* VIRT_VIEWER_WAN_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
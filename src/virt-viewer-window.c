@@ -114,6 +114,7 @@ struct _VirtViewerWindowPrivate {
     gboolean fullscreen;
     gchar *subtitle;
     gboolean initial_zoom_set;
+    GtkWidget *guest_details;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (VirtViewerWindow, virt_viewer_window, G_TYPE_OBJECT)
@@ -183,6 +184,11 @@ virt_viewer_window_dispose (GObject *object)
 
     g_debug("Disposing window %p\n", object);
 
+    if (priv->guest_details) {
+        gtk_widget_destroy(priv->guest_details);
+        priv->guest_details = NULL;
+    }
+
     if (priv->window) {
         gtk_widget_destroy(priv->window);
         priv->window = NULL;
@@ -473,6 +479,14 @@ virt_viewer_window_menu_view_zoom_reset(GtkWidget *menu G_GNUC_UNUSED,
     }
 }
 
+G_MODULE_EXPORT void
+virt_viewer_window_menu_view_find(GtkWidget *menu G_GNUC_UNUSED,
+                                  VirtViewerWindow *self)
+{
+    if (VIRT_VIEWER_IS_DISPLAY_VTE(self->priv->display))
+        virt_viewer_display_vte_show_find_bar(VIRT_VIEWER_DISPLAY_VTE(self->priv->display));
+}
+
 /* Kick GtkWindow to tell it to adjust to our new widget sizes */
 static void
 virt_viewer_window_queue_resize(VirtViewerWindow *self)
@@ -662,6 +676,39 @@ virt_viewer_window_menu_send(GtkWidget *menu,
                                   keys, get_nkeys(keys));
 }
 
+static void
+virt_viewer_window_type_clipboard_received(GtkClipboard *clipboard G_GNUC_UNUSED,
+                                           const gchar *text,
+                                           gpointer user_data)
+{
+    VirtViewerWindow *self = user_data;
+    VirtViewerWindowPrivate *priv = self->priv;
+
+    if (text != NULL && VIRT_VIEWER_DISPLAY_CAN_SEND_KEYS(priv->display))
+        virt_viewer_app_type_text(priv->app, VIRT_VIEWER_DISPLAY(priv->display), text);
+
+    g_object_unref(self);
+}
+
+G_MODULE_EXPORT void
+virt_viewer_window_menu_type_clipboard(GtkWidget *menu G_GNUC_UNUSED,
+                                       VirtViewerWindow *self)
+{
+    GtkClipboard *clipboard = gtk_widget_get_clipboard(self->priv->window,
+                                                       GDK_SELECTION_CLIPBOARD);
+
+    gtk_clipboard_request_text(clipboard, virt_viewer_window_type_clipboard_received,
+                               g_object_ref(self));
+}
+
+G_MODULE_EXPORT void
+virt_viewer_window_menu_stop_typing(GtkWidget *menu G_GNUC_UNUSED,
+                                    VirtViewerWindow *self)
+{
+    if (self->priv->display != NULL)
+        virt_viewer_app_stop_typing(self->priv->app, VIRT_VIEWER_DISPLAY(self->priv->display));
+}
+
 static void
 virt_viewer_menu_add_combo(VirtViewerWindow *self, GtkMenu *menu,
                            const guint *keys, const gchar *label, const gchar* accel_path)
@@ -754,6 +801,7 @@ virt_viewer_window_get_keycombo_menu(VirtViewerWindow *self)
     gint i;
     VirtViewerWindowPrivate *priv = self->priv;
     GtkMenu *menu = GTK_MENU(gtk_menu_new());
+    GtkWidget *item;
     gtk_menu_set_accel_group(menu, priv->accel_group);
 
     for (i = 0 ; i < G_N_ELEMENTS(keyCombos); i++) {
@@ -769,6 +817,15 @@ virt_viewer_window_get_keycombo_menu(VirtViewerWindow *self)
         gtk_accel_map_foreach(&d, accel_map_item_cb);
     }
 
+    /* for guests without an agent to paste into */
+    virt_viewer_menu_add_combo(self, menu, NULL, NULL, NULL);
+    item = gtk_menu_item_new_with_mnemonic(_("_Type Clipboard"));
+    g_signal_connect(item, "activate", G_CALLBACK(virt_viewer_window_menu_type_clipboard), self);
+    gtk_container_add(GTK_CONTAINER(menu), item);
+    item = gtk_menu_item_new_with_mnemonic(_("_Stop Typing"));
+    g_signal_connect(item, "activate", G_CALLBACK(virt_viewer_window_menu_stop_typing), self);
+    gtk_container_add(GTK_CONTAINER(menu), item);
+
     gtk_widget_show_all(GTK_WIDGET(menu));
     return menu;
 }
@@ -1117,41 +1174,71 @@ virt_viewer_window_menu_view_release_cursor(GtkWidget *menu G_GNUC_UNUSED,
     virt_viewer_display_release_cursor(VIRT_VIEWER_DISPLAY(self->priv->display));
 }
 
-G_MODULE_EXPORT void
-virt_viewer_window_menu_help_guest_details(GtkWidget *menu G_GNUC_UNUSED,
-                                           VirtViewerWindow *self)
+static gboolean
+guest_details_transform(GBinding *binding G_GNUC_UNUSED,
+                        const GValue *from_value,
+                        GValue *to_value,
+                        gpointer user_data G_GNUC_UNUSED)
+{
+    const gchar *value = g_value_get_string(from_value);
+
+    g_value_set_string(to_value, (value && *value) ? value : _("Unknown"));
+
+    return TRUE;
+}
+
+/* Built once per window, the labels follow the app properties from then on */
+static GtkWidget *
+virt_viewer_window_get_guest_details(VirtViewerWindow *self)
 {
-    GtkBuilder *ui = virt_viewer_util_load_ui("virt-viewer-guest-details.ui");
-    char *name = NULL;
-    char *uuid = NULL;
+    GtkBuilder *ui;
+    GtkWidget *dialog, *namelabel, *guidlabel;
 
-    g_return_if_fail(ui != NULL);
+    if (self->priv->guest_details)
+        return self->priv->guest_details;
 
-    GtkWidget *dialog = GTK_WIDGET(gtk_builder_get_object(ui, "guestdetailsdialog"));
-    GtkWidget *namelabel = GTK_WIDGET(gtk_builder_get_object(ui, "namevaluelabel"));
-    GtkWidget *guidlabel = GTK_WIDGET(gtk_builder_get_object(ui, "guidvaluelabel"));
+    ui = virt_viewer_util_load_ui("virt-viewer-guest-details.ui");
+    g_return_val_if_fail(ui != NULL, NULL);
 
-    g_return_if_fail(dialog && namelabel && guidlabel);
+    dialog = GTK_WIDGET(gtk_builder_get_object(ui, "guestdetailsdialog"));
+    namelabel = GTK_WIDGET(gtk_builder_get_object(ui, "namevaluelabel"));
+    guidlabel = GTK_WIDGET(gtk_builder_get_object(ui, "guidvaluelabel"));
 
-    g_object_get(self->priv->app, "guest-name", &name, "uuid", &uuid, NULL);
+    if (!dialog || !namelabel || !guidlabel) {
+        g_object_unref(G_OBJECT(ui));
+        g_return_val_if_reached(NULL);
+    }
 
-    if (!name || *name == '\0')
-        name = g_strdup(_("Unknown"));
-    if (!uuid || *uuid == '\0')
-        uuid = g_strdup(_("Unknown"));
-    gtk_label_set_text(GTK_LABEL(namelabel), name);
-    gtk_label_set_text(GTK_LABEL(guidlabel), uuid);
-    g_free(name);
-    g_free(uuid);
+    g_object_bind_property_full(self->priv->app, "guest-name", namelabel, "label",
+                                G_BINDING_SYNC_CREATE, guest_details_transform,
+                                NULL, NULL, NULL);
+    g_object_bind_property_full(self->priv->app, "uuid", guidlabel, "label",
+                                G_BINDING_SYNC_CREATE, guest_details_transform,
+                                NULL, NULL, NULL);
 
     gtk_window_set_transient_for(GTK_WINDOW(dialog),
                                  GTK_WINDOW(self->priv->window));
+    /* closing it from the window manager must not destroy it */
+    g_signal_connect(dialog, "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL);
 
     gtk_builder_connect_signals(ui, self);
-
-    gtk_widget_show_all(dialog);
+    self->priv->guest_details = dialog;
 
     g_object_unref(G_OBJECT(ui));
+
+    return dialog;
+}
+
+G_MODULE_EXPORT void
+virt_viewer_window_menu_help_guest_details(GtkWidget *menu G_GNUC_UNUSED,
+                                           VirtViewerWindow *self)
+{
+    GtkWidget *dialog = virt_viewer_window_get_guest_details(self);
+
+    g_return_if_fail(dialog != NULL);
+
+    gtk_widget_show_all(dialog);
+    gtk_window_present(GTK_WINDOW(dialog));
 }
 
 G_MODULE_EXPORT void
@@ -1159,7 +1246,8 @@ virt_viewer_window_guest_details_response(GtkDialog *dialog,
                                           gint response_id,
                                           gpointer user_data G_GNUC_UNUSED)
 {
-    if (response_id == GTK_RESPONSE_CLOSE)
+    if (response_id == GTK_RESPONSE_CLOSE ||
+        response_id == GTK_RESPONSE_DELETE_EVENT)
         gtk_widget_hide(GTK_WIDGET(dialog));
 }
 
@@ -1428,6 +1516,10 @@ virt_viewer_window_set_menus_sensitive(VirtViewerWindow *self, gboolean sensitiv
     menu = GTK_WIDGET(gtk_builder_get_object(priv->builder, "menu-view-zoom"));
     gtk_widget_set_sensitive(menu, sensitive);
 
+    menu = GTK_WIDGET(gtk_builder_get_object(priv->builder, "menu-view-find"));
+    gtk_widget_set_sensitive(menu, sensitive &&
+                             VIRT_VIEWER_IS_DISPLAY_VTE(self->priv->display));
+
     menu = GTK_WIDGET(gtk_builder_get_object(priv->builder, "menu-machine"));
     gtk_widget_set_sensitive(menu, sensitive);
 
@@ -46,10 +46,16 @@
 #include <sys/socket.h>
 #endif
 
+#ifdef G_OS_UNIX
+#include <poll.h>
+#include <gio/gunixsocketaddress.h>
+#endif
+
 #include "virt-viewer.h"
 #include "virt-viewer-app.h"
 #include "virt-viewer-vm-connection.h"
 #include "virt-viewer-auth.h"
+#include "virt-viewer-display-vte.h"
 #include "virt-viewer-util.h"
 
 #ifdef HAVE_SPICE_GTK
@@ -66,8 +72,44 @@ struct _VirtViewerPrivate {
     gboolean auth_cancelled;
     gint domain_event;
     guint reconnect_poll; /* source id */
+
+    gboolean console;
+    virStreamPtr console_stream;
+    VirtViewerDisplayVte *console_vte;
+    VirtViewerConsoleLog *console_log;
+    /* input the stream did not accept yet */
+    GByteArray *console_pending;
+    guint console_close_id; /* source id */
+
+    gboolean benchmark_paths;
+    /* where the display listens, to measure connecting to it */
+    gchar *display_host;
+    gchar *display_port;
+    gchar *display_socket;
+    gboolean display_tunnelled;
+};
+
+/* Ways of connecting to the display, in the order they're tried without a
+ * measured preference */
+typedef enum {
+    CONNECTION_PATH_GRAPHICS_FD,
+    CONNECTION_PATH_SOCKETPAIR,
+    CONNECTION_PATH_DIRECT,
+    N_CONNECTION_PATHS
+} ConnectionPath;
+
+static const gchar *connection_path_names[N_CONNECTION_PATHS] = {
+    [CONNECTION_PATH_GRAPHICS_FD] = "graphics-fd",
+    [CONNECTION_PATH_SOCKETPAIR] = "socketpair",
+    [CONNECTION_PATH_DIRECT] = "direct",
 };
 
+#define BENCHMARK_ROUNDS 5
+#define BENCHMARK_TIMEOUT 5 /* seconds */
+
+/* Pending console input beyond which the terminal stops accepting input */
+#define CONSOLE_MAX_PENDING (64 * 1024)
+
 G_DEFINE_TYPE_WITH_PRIVATE (VirtViewer, virt_viewer, VIRT_VIEWER_TYPE_APP)
 
 static gboolean virt_viewer_initial_connect(VirtViewerApp *self, GError **error);
@@ -83,6 +125,9 @@ static gboolean opt_direct = FALSE;
 static gboolean opt_attach = FALSE;
 static gboolean opt_waitvm = FALSE;
 static gboolean opt_reconnect = FALSE;
+static gboolean opt_console = FALSE;
+static gboolean opt_ssh_compression = FALSE;
+static gboolean opt_benchmark_paths = FALSE;
 
 typedef enum {
     DOMAIN_SELECTION_ID = (1 << 0),
@@ -129,6 +174,10 @@ virt_viewer_add_option_entries(VirtViewerApp *self, GOptionContext *context, GOp
     static const GOptionEntry options[] = {
         { "direct", 'd', 0, G_OPTION_ARG_NONE, &opt_direct,
           N_("Direct connection with no automatic tunnels"), NULL },
+        { "ssh-compression", '\0', 0, G_OPTION_ARG_NONE, &opt_ssh_compression,
+          N_("Compress the SSH tunnel of the display"), NULL },
+        { "benchmark-connection", '\0', 0, G_OPTION_ARG_NONE, &opt_benchmark_paths,
+          N_("Measure the ways of connecting to the display and remember the fastest"), NULL },
         { "attach", 'a', 0, G_OPTION_ARG_NONE, &opt_attach,
           N_("Attach to the local display using libvirt"), NULL },
         { "connect", 'c', 0, G_OPTION_ARG_STRING, &opt_uri,
@@ -137,6 +186,8 @@ virt_viewer_add_option_entries(VirtViewerApp *self, GOptionContext *context, GOp
           N_("Wait for domain to start"), NULL },
         { "reconnect", 'r', 0, G_OPTION_ARG_NONE, &opt_reconnect,
           N_("Reconnect to domain upon restart"), NULL },
+        { "console", '\0', 0, G_OPTION_ARG_NONE, &opt_console,
+          N_("Open the guest text console through libvirt"), NULL },
         { "domain-name", '\0', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, opt_domain_selection_cb,
           N_("Select the virtual machine only by its name"), NULL },
         { "id", '\0', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, opt_domain_selection_cb,
@@ -191,8 +242,11 @@ virt_viewer_local_command_line (GApplication   *gapp,
     }
 
     virt_viewer_app_set_direct(app, opt_direct);
+    virt_viewer_app_set_ssh_compression(app, opt_ssh_compression);
     virt_viewer_app_set_attach(app, opt_attach);
     self->priv->reconnect = opt_reconnect;
+    self->priv->console = opt_console;
+    self->priv->benchmark_paths = opt_benchmark_paths;
     self->priv->uri = g_strdup(opt_uri);
 
 end:
@@ -204,6 +258,18 @@ end:
     return ret;
 }
 
+/* The guest is given on the command line, with the libvirt connection it
+ * belongs to */
+static gboolean
+virt_viewer_set_connect_uri(VirtViewerApp *self G_GNUC_UNUSED,
+                            const gchar *uri G_GNUC_UNUSED,
+                            GError **error)
+{
+    g_set_error_literal(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                        _("virt-viewer only connects to the guest given on its command line"));
+    return FALSE;
+}
+
 static void
 virt_viewer_class_init (VirtViewerClass *klass)
 {
@@ -218,6 +284,7 @@ virt_viewer_class_init (VirtViewerClass *klass)
     app_class->open_connection = virt_viewer_open_connection;
     app_class->start = virt_viewer_start;
     app_class->add_option_entries = virt_viewer_add_option_entries;
+    app_class->set_connect_uri = virt_viewer_set_connect_uri;
 
     g_app_class->local_command_line = virt_viewer_local_command_line;
 }
@@ -470,25 +537,6 @@ virt_viewer_replace_host(const gchar *host)
 }
 
 
-static gboolean
-virt_viewer_is_loopback(const char *host)
-{
-    GInetAddress *addr = NULL;
-    gboolean is_loopback = FALSE;
-
-    g_return_val_if_fail(host != NULL, FALSE);
-
-    addr = g_inet_address_new_from_string(host);
-    if (!addr) /* Parsing error means it was probably a hostname */
-        return (strcmp(host, "localhost") == 0);
-
-    is_loopback = g_inet_address_get_is_loopback(addr);
-    g_object_unref(addr);
-
-    return is_loopback;
-}
-
-
 static gboolean
 virt_viewer_is_reachable(const gchar *host,
                          const char *transport,
@@ -510,8 +558,8 @@ virt_viewer_is_reachable(const gchar *host,
     if (strcmp(transport, "unix") == 0)
         return TRUE;
 
-    host_is_loopback = virt_viewer_is_loopback(host);
-    transport_is_loopback = virt_viewer_is_loopback(transport_host);
+    host_is_loopback = virt_viewer_util_is_loopback(host);
+    transport_is_loopback = virt_viewer_util_is_loopback(transport_host);
 
     if (transport_is_loopback && host_is_loopback)
         return TRUE;
@@ -520,6 +568,207 @@ virt_viewer_is_reachable(const gchar *host,
 }
 
 
+static void
+virt_viewer_console_close(VirtViewer *self)
+{
+    VirtViewerPrivate *priv = self->priv;
+
+    if (priv->console_close_id) {
+        g_source_remove(priv->console_close_id);
+        priv->console_close_id = 0;
+    }
+
+    if (priv->console_stream) {
+        g_debug("Closing guest console stream");
+        virStreamEventRemoveCallback(priv->console_stream);
+        virStreamAbort(priv->console_stream);
+        virStreamFree(priv->console_stream);
+        priv->console_stream = NULL;
+    }
+
+    if (priv->console_vte) {
+        VirtViewerSession *session = virt_viewer_app_get_session(VIRT_VIEWER_APP(self));
+
+        if (session)
+            virt_viewer_session_remove_display(session, VIRT_VIEWER_DISPLAY(priv->console_vte));
+        g_clear_object(&priv->console_vte);
+    }
+
+    g_clear_pointer(&priv->console_log, virt_viewer_console_log_free);
+    g_clear_pointer(&priv->console_pending, g_byte_array_unref);
+}
+
+static gboolean
+virt_viewer_console_close_idle(gpointer opaque)
+{
+    VirtViewer *self = opaque;
+
+    self->priv->console_close_id = 0;
+    virt_viewer_console_close(self);
+
+    return FALSE;
+}
+
+/* The stream can't be freed from its own event callback, stop listening
+ * to it right away and close it from the main loop */
+static void
+virt_viewer_console_hangup(VirtViewer *self)
+{
+    VirtViewerPrivate *priv = self->priv;
+
+    if (priv->console_close_id)
+        return;
+
+    virStreamEventRemoveCallback(priv->console_stream);
+    virt_viewer_display_vte_set_input_enabled(priv->console_vte, FALSE);
+    priv->console_close_id = g_idle_add(virt_viewer_console_close_idle, self);
+}
+
+static void
+virt_viewer_console_update_events(VirtViewer *self)
+{
+    VirtViewerPrivate *priv = self->priv;
+    int events = VIR_STREAM_EVENT_READABLE | VIR_STREAM_EVENT_ERROR | VIR_STREAM_EVENT_HANGUP;
+
+    if (priv->console_pending->len > 0)
+        events |= VIR_STREAM_EVENT_WRITABLE;
+
+    virStreamEventUpdateCallback(priv->console_stream, events);
+}
+
+static gboolean
+virt_viewer_console_flush(VirtViewer *self)
+{
+    VirtViewerPrivate *priv = self->priv;
+
+    while (priv->console_pending->len > 0) {
+        int n = virStreamSend(priv->console_stream,
+                              (const char *)priv->console_pending->data,
+                              priv->console_pending->len);
+        if (n == -2)
+            break;
+        if (n < 0) {
+            virErrorPtr err = virGetLastError();
+            g_warning("Unable to write to the guest console: %s",
+                      err && err->message ? err->message : "unknown libvirt error");
+            return FALSE;
+        }
+        g_byte_array_remove_range(priv->console_pending, 0, n);
+    }
+
+    if (priv->console_pending->len < CONSOLE_MAX_PENDING / 2)
+        virt_viewer_display_vte_set_input_enabled(priv->console_vte, TRUE);
+    virt_viewer_console_update_events(self);
+
+    return TRUE;
+}
+
+static void
+virt_viewer_console_commit(VirtViewer *self, const char *text, guint size)
+{
+    VirtViewerPrivate *priv = self->priv;
+
+    if (priv->console_close_id)
+        return;
+
+    g_byte_array_append(priv->console_pending, (const guint8 *)text, size);
+    /* Stop accepting input until the guest catches up */
+    if (priv->console_pending->len >= CONSOLE_MAX_PENDING)
+        virt_viewer_display_vte_set_input_enabled(priv->console_vte, FALSE);
+
+    if (!virt_viewer_console_flush(self))
+        virt_viewer_console_hangup(self);
+}
+
+static void
+virt_viewer_console_stream_event(virStreamPtr stream,
+                                 int events,
+                                 void *opaque)
+{
+    VirtViewer *self = opaque;
+    VirtViewerPrivate *priv = self->priv;
+    guint i;
+
+    if (events & VIR_STREAM_EVENT_READABLE) {
+        /* Bounded so a chatty guest does not starve the main loop, the
+         * callback fires again while data is available */
+        for (i = 0; i < 16; i++) {
+            char buf[4096];
+            int n = virStreamRecv(stream, buf, sizeof(buf));
+
+            if (n == -2)
+                break;
+            if (n <= 0) {
+                if (n < 0) {
+                    virErrorPtr err = virGetLastError();
+                    g_warning("Unable to read from the guest console: %s",
+                              err && err->message ? err->message : "unknown libvirt error");
+                }
+                virt_viewer_console_hangup(self);
+                return;
+            }
+
+            if (priv->console_log)
+                virt_viewer_console_log_append(priv->console_log, (const guint8 *)buf, n);
+            virt_viewer_display_vte_feed(priv->console_vte, buf, n);
+        }
+    }
+
+    if ((events & VIR_STREAM_EVENT_WRITABLE) && !virt_viewer_console_flush(self)) {
+        virt_viewer_console_hangup(self);
+        return;
+    }
+
+    if (events & (VIR_STREAM_EVENT_ERROR | VIR_STREAM_EVENT_HANGUP)) {
+        g_debug("Guest console stream hung up");
+        virt_viewer_console_hangup(self);
+    }
+}
+
+static void
+virt_viewer_console_open(VirtViewer *self)
+{
+    VirtViewerPrivate *priv = self->priv;
+    VirtViewerApp *app = VIRT_VIEWER_APP(self);
+    VirtViewerSession *session = virt_viewer_app_get_session(app);
+    virStreamPtr stream;
+    GtkWidget *vte;
+
+    if (!priv->console || priv->console_stream || !priv->dom || !session)
+        return;
+
+    stream = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK);
+    if (!stream ||
+        virDomainOpenConsole(priv->dom, NULL, stream, 0) < 0 ||
+        virStreamEventAddCallback(stream,
+                                  VIR_STREAM_EVENT_READABLE |
+                                  VIR_STREAM_EVENT_ERROR |
+                                  VIR_STREAM_EVENT_HANGUP,
+                                  virt_viewer_console_stream_event,
+                                  self, NULL) < 0) {
+        virErrorPtr err = virGetLastError();
+        g_warning("Unable to open the guest console: %s",
+                  err && err->message ? err->message : "unknown libvirt error");
+        if (stream) {
+            virStreamAbort(stream);
+            virStreamFree(stream);
+        }
+        return;
+    }
+
+    g_debug("Opened guest console stream");
+    priv->console_stream = stream;
+    priv->console_pending = g_byte_array_new();
+    priv->console_log = virt_viewer_app_open_console_log(app, "console");
+
+    vte = virt_viewer_display_vte_new(session, _("Serial console"));
+    priv->console_vte = g_object_ref_sink(vte);
+    virt_viewer_signal_connect_object(vte, "commit",
+                                      G_CALLBACK(virt_viewer_console_commit),
+                                      self, G_CONNECT_SWAPPED);
+    virt_viewer_session_add_display(session, VIRT_VIEWER_DISPLAY(vte));
+}
+
 static gboolean
 virt_viewer_extract_connect_info(VirtViewer *self,
                                  virDomainPtr dom,
@@ -543,6 +792,9 @@ virt_viewer_extract_connect_info(VirtViewer *self,
     gboolean direct = virt_viewer_app_get_direct(app);
 
     virt_viewer_app_free_connect_info(app);
+    g_clear_pointer(&priv->display_host, g_free);
+    g_clear_pointer(&priv->display_port, g_free);
+    g_clear_pointer(&priv->display_socket, g_free);
 
     if ((type = virt_viewer_extract_xpath_string(xmldesc, "string(/domain/devices/graphics/@type)")) == NULL) {
         g_set_error(error,
@@ -555,6 +807,15 @@ virt_viewer_extract_connect_info(VirtViewer *self,
     if (!virt_viewer_app_create_session(app, type, error))
         goto cleanup;
 
+    /* The console is a display of the graphical session, so it follows
+     * its lifetime */
+    virt_viewer_signal_connect_object(virt_viewer_app_get_session(app), "session-connected",
+                                      G_CALLBACK(virt_viewer_console_open),
+                                      self, G_CONNECT_SWAPPED);
+    virt_viewer_signal_connect_object(virt_viewer_app_get_session(app), "session-disconnected",
+                                      G_CALLBACK(virt_viewer_console_close),
+                                      self, G_CONNECT_SWAPPED);
+
     xpath = g_strdup_printf("string(/domain/devices/graphics[@type='%s']/@port)", type);
     gport = virt_viewer_extract_xpath_string(xmldesc, xpath);
     g_free(xpath);
@@ -633,6 +894,10 @@ virt_viewer_extract_connect_info(VirtViewer *self,
     }
 
     virt_viewer_app_set_connect_info(app, host, ghost, gport, gtlsport,transport, unixsock, user, port, NULL);
+    priv->display_host = g_strdup(ghost);
+    priv->display_port = g_strdup(gport);
+    priv->display_socket = g_strdup(unixsock);
+    priv->display_tunnelled = g_strcmp0(transport, "ssh") == 0 && !direct;
 
     retval = TRUE;
 
@@ -671,50 +936,298 @@ virt_viewer_update_display(VirtViewer *self, virDomainPtr dom, GError **error)
     return virt_viewer_extract_connect_info(self, dom, error);
 }
 
-static gboolean
-virt_viewer_open_connection(VirtViewerApp *self G_GNUC_UNUSED, int *fd)
+/* Fills @order with the paths measured fastest for the libvirt connection
+ * first, then the others in the default order */
+static void
+virt_viewer_get_connection_paths(VirtViewer *self, ConnectionPath order[N_CONNECTION_PATHS])
 {
-    VirtViewer *viewer = VIRT_VIEWER(self);
-    VirtViewerPrivate *priv = viewer->priv;
+    gboolean seen[N_CONNECTION_PATHS] = { FALSE, };
+    gchar **names = NULL;
+    gchar *uri;
+    guint i, j, n = 0;
+
+    uri = virConnectGetURI(self->priv->conn);
+    if (uri != NULL)
+        names = virt_viewer_app_get_config_connection_paths(VIRT_VIEWER_APP(self), uri);
+    g_free(uri);
+
+    for (i = 0; names != NULL && names[i] != NULL; i++) {
+        for (j = 0; j < N_CONNECTION_PATHS; j++) {
+            if (!seen[j] && g_str_equal(names[i], connection_path_names[j])) {
+                seen[j] = TRUE;
+                order[n++] = j;
+            }
+        }
+    }
+    g_strfreev(names);
+
+    for (j = 0; j < N_CONNECTION_PATHS; j++) {
+        if (!seen[j])
+            order[n++] = j;
+    }
+}
+
+/* Connects to the display address like the app does, to measure it. SSH
+ * tunnels are left out, they're set up by the app. */
+static int
+virt_viewer_open_display_address(VirtViewer *self)
+{
+    VirtViewerPrivate *priv = self->priv;
+    GSocketConnectable *address;
+    GSocketClient *client;
+    GSocketConnection *connection;
+    GError *error = NULL;
+    int fd = -1;
+
+    if (priv->display_tunnelled)
+        return -1;
+
+#ifdef G_OS_UNIX
+    if (priv->display_socket)
+        address = G_SOCKET_CONNECTABLE(g_unix_socket_address_new(priv->display_socket));
+    else
+#endif
+    if (priv->display_host && priv->display_port)
+        address = g_network_address_new(priv->display_host, atoi(priv->display_port));
+    else
+        return -1;
+
+    client = g_socket_client_new();
+    g_socket_client_set_timeout(client, BENCHMARK_TIMEOUT);
+    connection = g_socket_client_connect(client, address, NULL, &error);
+    if (connection != NULL) {
+        /* the connection closes its socket when it goes */
+        fd = dup(g_socket_get_fd(g_socket_connection_get_socket(connection)));
+        g_object_unref(connection);
+    } else {
+        g_debug("Error %s", error->message);
+        g_clear_error(&error);
+    }
+    g_object_unref(client);
+    g_object_unref(address);
+
+    return fd;
+}
+
+/* Returns a connection to the display through @path, or -1 */
+static int
+virt_viewer_open_path(VirtViewer *self, ConnectionPath path)
+{
+    VirtViewerPrivate *priv = self->priv;
 #if defined(HAVE_SOCKETPAIR) || defined(HAVE_VIR_DOMAIN_OPEN_GRAPHICS_FD)
     virErrorPtr err;
 #endif
 #if defined(HAVE_SOCKETPAIR)
     int pair[2];
 #endif
+    int fd = -1;
+
+    switch (path) {
+    case CONNECTION_PATH_GRAPHICS_FD:
+#ifdef HAVE_VIR_DOMAIN_OPEN_GRAPHICS_FD
+        if ((fd = virDomainOpenGraphicsFD(priv->dom, 0,
+                                          VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH)) < 0) {
+            err = virGetLastError();
+            g_debug("Error %s", err && err->message ? err->message : "Unknown");
+        }
+#endif
+        break;
+
+    case CONNECTION_PATH_SOCKETPAIR:
+#if defined(HAVE_SOCKETPAIR)
+        if (socketpair(PF_UNIX, SOCK_STREAM, 0, pair) < 0)
+            break;
+
+        if (virDomainOpenGraphics(priv->dom, 0, pair[0],
+                                  VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH) < 0) {
+            err = virGetLastError();
+            g_debug("Error %s", err && err->message ? err->message : "Unknown");
+            close(pair[0]);
+            close(pair[1]);
+            break;
+        }
+        close(pair[0]);
+        fd = pair[1];
+#endif
+        break;
+
+    case CONNECTION_PATH_DIRECT:
+        fd = virt_viewer_open_display_address(self);
+        break;
+
+    default:
+        g_warn_if_reached();
+    }
+
+    return fd;
+}
+
+static gboolean
+virt_viewer_open_connection(VirtViewerApp *self G_GNUC_UNUSED, int *fd)
+{
+    VirtViewer *viewer = VIRT_VIEWER(self);
+    VirtViewerPrivate *priv = viewer->priv;
+    ConnectionPath order[N_CONNECTION_PATHS];
+    guint i;
+
     *fd = -1;
 
     if (!priv->dom)
         return TRUE;
 
+    virt_viewer_get_connection_paths(viewer, order);
+    for (i = 0; i < N_CONNECTION_PATHS; i++) {
+        if (order[i] == CONNECTION_PATH_DIRECT) {
+            /* the app connects to the display address itself, with the
+             * tunnel and TLS it needs */
+            if (priv->display_host || priv->display_socket) {
+                g_debug("Connecting directly to the display");
+                break;
+            }
+            continue;
+        }
+        *fd = virt_viewer_open_path(viewer, order[i]);
+        if (*fd >= 0) {
+            g_debug("Connected to the display through %s", connection_path_names[order[i]]);
+            break;
+        }
 #ifdef HAVE_VIR_DOMAIN_OPEN_GRAPHICS_FD
-    if ((*fd = virDomainOpenGraphicsFD(priv->dom, 0,
-                                       VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH)) >= 0)
-        return TRUE;
+        /* virDomainOpenGraphics() would fail the same way */
+        if (order[i] == CONNECTION_PATH_GRAPHICS_FD) {
+            virErrorPtr err = virGetLastError();
 
-    err = virGetLastError();
-    if (err && err->code != VIR_ERR_NO_SUPPORT) {
-        g_debug("Error %s", err->message ? err->message : "Unknown");
-        return TRUE;
+            if (err && err->code != VIR_ERR_NO_SUPPORT)
+                break;
+        }
+#endif
     }
+
+    return TRUE;
+}
+
+#ifdef G_OS_UNIX
+/* Time in microseconds to open @path and get the first bytes from the
+ * server, and *open_time to open it, -1 when the path doesn't work */
+static gint64
+virt_viewer_time_path(VirtViewer *self, ConnectionPath path, gboolean spice, gint64 *open_time)
+{
+    /* a SpiceLinkHeader and SpiceLinkMess for the main channel, enough for
+     * the server to reply, the handshake stops there so the session of
+     * another client isn't taken over */
+    static const guint8 spice_link[] = {
+        'R', 'E', 'D', 'Q', 2, 0, 0, 0, 2, 0, 0, 0, 18, 0, 0, 0,
+        0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 18, 0, 0, 0,
+    };
+    struct pollfd pfd;
+    gint64 start = g_get_monotonic_time(), opened;
+    guint8 byte;
+    int fd;
+
+    if ((fd = virt_viewer_open_path(self, path)) < 0)
+        return -1;
+    opened = g_get_monotonic_time();
+
+    /* VNC servers speak first */
+    if (spice && write(fd, spice_link, sizeof(spice_link)) != sizeof(spice_link))
+        goto error;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, BENCHMARK_TIMEOUT * 1000) != 1 || read(fd, &byte, 1) != 1)
+        goto error;
+
+    close(fd);
+    *open_time = opened - start;
+    return g_get_monotonic_time() - start;
+
+error:
+    close(fd);
+    return -1;
+}
+
+static int
+compare_time(gconstpointer a, gconstpointer b)
+{
+    gint64 ta = *(const gint64 *)a, tb = *(const gint64 *)b;
+
+    return ta < tb ? -1 : ta > tb;
+}
 #endif
 
-#if defined(HAVE_SOCKETPAIR)
-    if (socketpair(PF_UNIX, SOCK_STREAM, 0, pair) < 0)
+/* Measures every path to the display, prints the results, and saves their
+ * order, fastest first, for the later connections to the same libvirt */
+static gboolean
+virt_viewer_benchmark_connection_paths(VirtViewer *self, GError **error)
+{
+#ifdef G_OS_UNIX
+    VirtViewerApp *app = VIRT_VIEWER_APP(self);
+    gint64 total[N_CONNECTION_PATHS], opened[N_CONNECTION_PATHS];
+    const gchar *names[N_CONNECTION_PATHS + 1];
+    ConnectionPath order[N_CONNECTION_PATHS];
+    gboolean spice = FALSE;
+    gchar *uri;
+    guint i, j, round;
+
+#ifdef HAVE_SPICE_GTK
+    spice = VIRT_VIEWER_IS_SESSION_SPICE(virt_viewer_app_get_session(app));
+#endif
+
+    g_print(_("Connecting to the display of %s, median of %d tries:\n"),
+            self->priv->domkey, BENCHMARK_ROUNDS);
+    for (i = 0; i < N_CONNECTION_PATHS; i++) {
+        gint64 totals[BENCHMARK_ROUNDS], opens[BENCHMARK_ROUNDS];
+
+        for (round = 0; round < BENCHMARK_ROUNDS; round++) {
+            if ((totals[round] = virt_viewer_time_path(self, i, spice, &opens[round])) < 0)
+                break;
+        }
+
+        if (round < BENCHMARK_ROUNDS) {
+            total[i] = opened[i] = G_MAXINT64;
+            g_print(_("  %-12s not available\n"), connection_path_names[i]);
+            continue;
+        }
+
+        qsort(totals, BENCHMARK_ROUNDS, sizeof(gint64), compare_time);
+        qsort(opens, BENCHMARK_ROUNDS, sizeof(gint64), compare_time);
+        total[i] = totals[BENCHMARK_ROUNDS / 2];
+        opened[i] = opens[BENCHMARK_ROUNDS / 2];
+        g_print(_("  %-12s %.2f ms to connect, %.2f ms to the first reply\n"),
+                connection_path_names[i], opened[i] / 1000.0, total[i] / 1000.0);
+    }
+
+    /* the paths that didn't work stay in the default order, last */
+    for (i = 0; i < N_CONNECTION_PATHS; i++) {
+        for (j = i; j > 0 && total[order[j - 1]] > total[i]; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+    for (i = 0; i < N_CONNECTION_PATHS; i++)
+        names[i] = connection_path_names[order[i]];
+    names[N_CONNECTION_PATHS] = NULL;
+
+    if (total[order[0]] == G_MAXINT64) {
+        g_set_error_literal(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                            _("No way of connecting to the display could be measured"));
         return FALSE;
+    }
 
-    if (virDomainOpenGraphics(priv->dom, 0, pair[0],
-                              VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH) < 0) {
-        err = virGetLastError();
-        g_debug("Error %s", err && err->message ? err->message : "Unknown");
-        close(pair[0]);
-        close(pair[1]);
-        return TRUE;
+    uri = virConnectGetURI(self->priv->conn);
+    if (uri != NULL) {
+        gchar *list = g_strjoinv(", ", (gchar **)names);
+
+        virt_viewer_app_set_config_connection_paths(app, uri, names);
+        g_print(_("Connections to %s will try %s, in this order\n"), uri, list);
+        g_free(list);
     }
-    close(pair[0]);
-    *fd = pair[1];
-#endif
+    g_free(uri);
+
     return TRUE;
+#else
+    g_set_error_literal(error, VIRT_VIEWER_ERROR, VIRT_VIEWER_ERROR_FAILED,
+                        _("Measuring connections is not supported on this platform"));
+    return FALSE;
+#endif
 }
 
 static int
@@ -790,6 +1303,7 @@ virt_viewer_dispose (GObject *object)
     VirtViewer *self = VIRT_VIEWER(object);
     VirtViewerPrivate *priv = self->priv;
 
+    virt_viewer_console_close(self);
     if (priv->conn) {
         if (priv->domain_event >= 0) {
             virConnectDomainEventDeregisterAny(priv->conn,
@@ -809,6 +1323,9 @@ virt_viewer_dispose (GObject *object)
     priv->uri = NULL;
     g_free(priv->domkey);
     priv->domkey = NULL;
+    g_clear_pointer(&priv->display_host, g_free);
+    g_clear_pointer(&priv->display_port, g_free);
+    g_clear_pointer(&priv->display_socket, g_free);
     G_OBJECT_CLASS(virt_viewer_parent_class)->dispose (object);
 }
 
@@ -934,6 +1451,13 @@ virt_viewer_initial_connect(VirtViewerApp *app, GError **error)
     if (!virt_viewer_update_display(self, dom, &err))
         goto cleanup;
 
+    if (priv->benchmark_paths) {
+        ret = virt_viewer_benchmark_connection_paths(self, &err);
+        if (ret)
+            g_application_quit(G_APPLICATION(app));
+        goto cleanup;
+    }
+
     ret = VIRT_VIEWER_APP_CLASS(virt_viewer_parent_class)->initial_connect(app, &err);
     if (ret || err)
         goto cleanup;
@@ -1080,7 +1604,9 @@ virt_viewer_connect(VirtViewerApp *app, GError **err)
     int oflags = 0;
     GError *error = NULL;
 
-    if (!virt_viewer_app_get_attach(app))
+    /* virDomainOpenConsole() needs a read-write connection, and so do
+     * measurements of virDomainOpenGraphics*() */
+    if (!virt_viewer_app_get_attach(app) && !priv->console && !priv->benchmark_paths)
         oflags |= VIR_CONNECT_RO;
 
     g_debug("connecting ...");
@@ -0,0 +1,154 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Measures time-to-ISO-list and memory use of OvirtForeignMenu against a
+ * local oVirt REST stand-in. Run with '-m perf' to also measure with a
+ * simulated engine round-trip latency.
+ */
+
+#include <config.h>
+#include <glib.h>
+
+#include "ovirt-foreign-menu.h"
+#include "benchmark-util.h"
+#include "ovirt-rest-stub.h"
+
+typedef struct {
+    guint n_iso_files;
+    guint latency_ms;
+} BenchmarkParams;
+
+typedef struct {
+    GMainLoop *loop;
+    GList *iso_names;
+    GError *error;
+} BenchmarkResult;
+
+/* libgovirt warns when talking plain HTTP, which is all the stand-in does */
+static gboolean
+ignore_govirt_warnings(const gchar *log_domain,
+                       GLogLevelFlags log_level,
+                       const gchar *message G_GNUC_UNUSED,
+                       gpointer user_data G_GNUC_UNUSED)
+{
+    return !((log_level & G_LOG_LEVEL_WARNING) &&
+             g_strcmp0(log_domain, "libgovirt") == 0);
+}
+
+static void
+iso_names_fetched(GObject *source_object,
+                  GAsyncResult *result,
+                  gpointer user_data)
+{
+    BenchmarkResult *res = user_data;
+
+    res->iso_names = ovirt_foreign_menu_fetch_iso_names_finish(OVIRT_FOREIGN_MENU(source_object),
+                                                               result, &res->error);
+    g_main_loop_quit(res->loop);
+}
+
+static void
+benchmark_iso_list(gconstpointer data)
+{
+    const BenchmarkParams *params = data;
+    OvirtRestStub *stub;
+    OvirtProxy *proxy;
+    OvirtForeignMenu *menu;
+    BenchmarkResult res = { NULL, };
+    GError *error = NULL;
+    gulong rss_before, rss_after;
+    gint64 start, elapsed;
+
+    stub = ovirt_rest_stub_new(params->n_iso_files, &error);
+    g_assert_no_error(error);
+    ovirt_rest_stub_set_latency(stub, params->latency_ms);
+    ovirt_rest_stub_set_n_other_files(stub, params->n_iso_files / 10);
+
+    proxy = ovirt_proxy_new(ovirt_rest_stub_get_url(stub));
+    g_assert_nonnull(proxy);
+    g_object_set(G_OBJECT(proxy), "sso-token", "benchmark", NULL);
+    menu = g_object_new(OVIRT_TYPE_FOREIGN_MENU,
+                        "proxy", proxy,
+                        "vm-guid", OVIRT_REST_STUB_VM_GUID,
+                        NULL);
+
+    res.loop = g_main_loop_new(NULL, FALSE);
+    rss_before = benchmark_get_rss_kb();
+    start = g_get_monotonic_time();
+    ovirt_foreign_menu_fetch_iso_names_async(menu, NULL, iso_names_fetched, &res);
+    g_main_loop_run(res.loop);
+    elapsed = g_get_monotonic_time() - start;
+    rss_after = benchmark_get_rss_kb();
+
+    g_assert_no_error(res.error);
+    g_assert_cmpuint(g_list_length(res.iso_names), ==, params->n_iso_files);
+    g_assert_true(res.iso_names == ovirt_foreign_menu_get_iso_names(menu));
+
+    g_test_minimized_result(elapsed / (gdouble)G_TIME_SPAN_SECOND,
+                            "%u ISOs, %ums latency: %.3f ms to ISO list, "
+                            "%u requests, %" G_GUINT64_FORMAT " bytes, RSS +%lu kB",
+                            params->n_iso_files, params->latency_ms,
+                            elapsed / (gdouble)G_TIME_SPAN_MILLISECOND,
+                            ovirt_rest_stub_get_n_requests(stub),
+                            ovirt_rest_stub_get_bytes_sent(stub),
+                            rss_after > rss_before ? rss_after - rss_before : 0);
+
+    g_main_loop_unref(res.loop);
+    g_object_unref(menu);
+    g_object_unref(proxy);
+    ovirt_rest_stub_free(stub);
+}
+
+int main(int argc, char* argv[])
+{
+    static const BenchmarkParams params[] = {
+        { 10, 0 }, { 1000, 0 }, { 10000, 0 },
+        { 10, 20 }, { 1000, 20 }, { 10000, 20 },
+    };
+    guint i;
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_log_set_fatal_handler(ignore_govirt_warnings, NULL);
+
+    for (i = 0; i < G_N_ELEMENTS(params); i++) {
+        gchar *path;
+
+        /* Latency and large lists only make the run longer, make check
+         * keeps the small case, the others are for perf mode */
+        if ((params[i].latency_ms > 0 || params[i].n_iso_files > 10) && !g_test_perf())
+            continue;
+
+        path = g_strdup_printf("/ovirt-foreign-menu/iso-list/%u-isos/%ums",
+                               params[i].n_iso_files, params[i].latency_ms);
+        g_test_add_data_func(path, &params[i], benchmark_iso_list);
+        g_free(path);
+    }
+
+    return g_test_run();
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,135 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Measures the time from running the application to the first status
+ * message, which is where remote-viewer and virt-viewer start connecting,
+ * and the memory used at that point.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "benchmark-util.h"
+#include "virt-viewer-app.h"
+
+G_BEGIN_DECLS
+
+#define VIRT_VIEWER_BENCHMARK_TYPE virt_viewer_benchmark_get_type()
+
+typedef struct {
+    VirtViewerApp parent;
+    gint64 first_status;
+    gulong first_status_rss;
+} VirtViewerBenchmark;
+
+typedef struct {
+    VirtViewerAppClass parent_class;
+} VirtViewerBenchmarkClass;
+
+GType virt_viewer_benchmark_get_type (void);
+
+G_DEFINE_TYPE (VirtViewerBenchmark, virt_viewer_benchmark, VIRT_VIEWER_TYPE_APP)
+
+G_END_DECLS
+
+static gboolean
+benchmark_quit(gpointer user_data)
+{
+    g_application_quit(G_APPLICATION(user_data));
+
+    return FALSE;
+}
+
+static gboolean
+virt_viewer_benchmark_start(VirtViewerApp *app, GError **error G_GNUC_UNUSED)
+{
+    VirtViewerBenchmark *self = (VirtViewerBenchmark *)app;
+
+    virt_viewer_app_show_status(app, "Connecting to graphic server");
+    self->first_status = g_get_monotonic_time();
+    self->first_status_rss = benchmark_get_rss_kb();
+    g_idle_add(benchmark_quit, app);
+
+    return TRUE;
+}
+
+static void
+virt_viewer_benchmark_class_init (VirtViewerBenchmarkClass *klass)
+{
+    VIRT_VIEWER_APP_CLASS(klass)->start = virt_viewer_benchmark_start;
+}
+
+static void
+virt_viewer_benchmark_init(VirtViewerBenchmark *self G_GNUC_UNUSED)
+{
+}
+
+static void
+benchmark_startup(void)
+{
+    gchar *argv[] = { (gchar *)"benchmark-startup", NULL };
+    VirtViewerBenchmark *app;
+    gulong rss_before;
+    gint64 start;
+    int status;
+
+    rss_before = benchmark_get_rss_kb();
+    start = g_get_monotonic_time();
+    app = g_object_new(VIRT_VIEWER_BENCHMARK_TYPE,
+                       "application-id", "org.virt-manager.virt-viewer.benchmark",
+                       "flags", G_APPLICATION_NON_UNIQUE,
+                       NULL);
+    status = g_application_run(G_APPLICATION(app), G_N_ELEMENTS(argv) - 1, argv);
+
+    g_assert_cmpint(status, ==, 0);
+    g_assert_cmpint(app->first_status, >, 0);
+
+    g_test_minimized_result((app->first_status - start) / (gdouble)G_TIME_SPAN_SECOND,
+                            "%.3f ms to first status message, RSS %lu kB (+%lu kB)",
+                            (app->first_status - start) / (gdouble)G_TIME_SPAN_MILLISECOND,
+                            app->first_status_rss,
+                            app->first_status_rss > rss_before ?
+                            app->first_status_rss - rss_before : 0);
+
+    g_object_unref(app);
+}
+
+int main(int argc, char* argv[])
+{
+    gboolean has_display = gtk_init_check(&argc, &argv);
+
+    g_test_init(&argc, &argv, NULL);
+
+    /* Building the windows needs a display to talk to */
+    if (has_display)
+        g_test_add_func("/virt-viewer/startup", benchmark_startup);
+
+    return g_test_run();
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,174 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Measures how long building each GtkBuilder UI takes, and checks that
+ * dialogs which are cached after their first use are not built again when
+ * they are reopened.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "virt-viewer-app.h"
+#include "virt-viewer-util.h"
+
+G_BEGIN_DECLS
+
+#define VIRT_VIEWER_TEST_TYPE virt_viewer_test_get_type()
+
+typedef struct {
+    VirtViewerApp parent;
+} VirtViewerTest;
+
+typedef struct {
+    VirtViewerAppClass parent_class;
+} VirtViewerTestClass;
+
+GType virt_viewer_test_get_type (void);
+
+G_DEFINE_TYPE (VirtViewerTest, virt_viewer_test, VIRT_VIEWER_TYPE_APP)
+
+G_END_DECLS
+
+static void
+virt_viewer_test_class_init (VirtViewerTestClass *klass G_GNUC_UNUSED)
+{
+}
+
+static void
+virt_viewer_test_init(VirtViewerTest *self G_GNUC_UNUSED)
+{
+}
+
+static void
+benchmark_load_ui(gconstpointer data)
+{
+    const gchar *name = data;
+    guint i, n = g_test_perf() ? 100 : 5;
+    gint64 start, elapsed;
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < n; i++) {
+        GtkBuilder *builder = virt_viewer_util_load_ui(name);
+
+        g_assert_nonnull(builder);
+        g_object_unref(builder);
+    }
+    elapsed = g_get_monotonic_time() - start;
+
+    g_test_minimized_result(elapsed / (gdouble)n / G_TIME_SPAN_SECOND,
+                            "%s: %.3f ms per build", name,
+                            elapsed / (gdouble)n / G_TIME_SPAN_MILLISECOND);
+}
+
+static guint
+count_toplevels(void)
+{
+    GList *toplevels = gtk_window_list_toplevels();
+    guint n = g_list_length(toplevels);
+
+    g_list_free(toplevels);
+
+    return n;
+}
+
+typedef struct {
+    const gchar *menu_item;
+    const gchar *name;
+} ReopenTest;
+
+static void
+benchmark_dialog_reopen(gconstpointer data)
+{
+    const ReopenTest *test = data;
+    VirtViewerApp *app = g_object_new(VIRT_VIEWER_TEST_TYPE, NULL);
+    VirtViewerWindow *window = g_object_new(VIRT_VIEWER_TYPE_WINDOW, "app", app, NULL);
+    GtkMenuItem *item = GTK_MENU_ITEM(gtk_builder_get_object(virt_viewer_window_get_builder(window),
+                                                             test->menu_item));
+    guint n_toplevels;
+    gint64 start, first, again;
+
+    start = g_get_monotonic_time();
+    gtk_menu_item_activate(item);
+    first = g_get_monotonic_time() - start;
+    n_toplevels = count_toplevels();
+
+    start = g_get_monotonic_time();
+    gtk_menu_item_activate(item);
+    again = g_get_monotonic_time() - start;
+
+    /* the dialog is reused rather than built anew */
+    g_assert_cmpuint(count_toplevels(), ==, n_toplevels);
+
+    g_test_minimized_result(again / (gdouble)G_TIME_SPAN_SECOND,
+                            "%s: %.3f ms to open, %.3f ms to reopen", test->name,
+                            first / (gdouble)G_TIME_SPAN_MILLISECOND,
+                            again / (gdouble)G_TIME_SPAN_MILLISECOND);
+
+    g_object_unref(window);
+    g_object_unref(app);
+}
+
+int main(int argc, char* argv[])
+{
+    static const gchar *uis[] = {
+        "virt-viewer.ui",
+        "virt-viewer-about.ui",
+        "virt-viewer-auth.ui",
+        "virt-viewer-guest-details.ui",
+        "virt-viewer-preferences.ui",
+        "virt-viewer-vm-connection.ui",
+        "remote-viewer-connect.ui",
+        "remote-viewer-iso-list.ui",
+    };
+    static const ReopenTest guest_details = { "menu-help-guest-details", "guest details" };
+    static const ReopenTest preferences = { "menu-preferences", "preferences" };
+    gboolean has_display = gtk_init_check(&argc, &argv);
+    guint i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    /* Building widgets needs a display to talk to */
+    if (!has_display)
+        return g_test_run();
+
+    for (i = 0; i < G_N_ELEMENTS(uis); i++) {
+        gchar *path = g_strdup_printf("/virt-viewer-ui/build/%s", uis[i]);
+
+        g_test_add_data_func(path, uis[i], benchmark_load_ui);
+        g_free(path);
+    }
+    g_test_add_data_func("/virt-viewer-ui/guest-details/reopen", &guest_details,
+                         benchmark_dialog_reopen);
+    g_test_add_data_func("/virt-viewer-ui/preferences/reopen", &preferences,
+                         benchmark_dialog_reopen);
+
+    return g_test_run();
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,332 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Serves the streams of a capture made with --capture, so the viewer can be
+ * benchmarked without the server. Each connection is given the stream of
+ * the same SPICE channel, or the next stream for other protocols, and only
+ * the server side is replayed, what the viewer sends is read and dropped.
+ *
+ *   capture-replay --unix /tmp/replay.sock session.capture
+ *   remote-viewer spice+unix:///tmp/replay.sock
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+
+#include "virt-viewer-capture.h"
+
+/* enough of the SPICE link message for the channel type and id */
+#define SPICE_LINK_LEN 22
+
+typedef struct {
+    guint32 id;
+    GPtrArray *records;
+    gboolean spice;
+    guint8 channel_type;
+    guint8 channel_id;
+    gboolean taken;
+} Stream;
+
+static gboolean opt_fast = FALSE;
+static gchar *opt_unix = NULL;
+static gint opt_port = 0;
+
+static GMutex lock;
+static GPtrArray *streams;
+static guint n_done;
+static GMainLoop *loop;
+
+static void
+record_free(gpointer data)
+{
+    VirtViewerCaptureRecord *record = data;
+
+    g_bytes_unref(record->data);
+    g_free(record);
+}
+
+static Stream *
+stream_get(guint32 id)
+{
+    guint i;
+
+    for (i = 0; i < streams->len; i++) {
+        Stream *stream = g_ptr_array_index(streams, i);
+
+        if (stream->id == id)
+            return stream;
+    }
+
+    return NULL;
+}
+
+/* Everything is loaded up front, so the disk isn't part of the measure */
+static gboolean
+load_capture(const gchar *filename, GError **error)
+{
+    VirtViewerCaptureReader *reader = virt_viewer_capture_reader_new(filename, error);
+    VirtViewerCaptureRecord record;
+    GError *read_error = NULL;
+
+    if (reader == NULL)
+        return FALSE;
+
+    streams = g_ptr_array_new();
+    while (virt_viewer_capture_reader_next(reader, &record, &read_error)) {
+        Stream *stream = stream_get(record.stream);
+
+        if (stream == NULL) {
+            gsize len;
+            const guint8 *data = g_bytes_get_data(record.data, &len);
+
+            stream = g_new0(Stream, 1);
+            stream->id = record.stream;
+            stream->records = g_ptr_array_new_with_free_func(record_free);
+            /* SPICE clients link a channel before anything else */
+            if (record.direction == VIRT_VIEWER_RELAY_TO_SERVER &&
+                len >= SPICE_LINK_LEN && memcmp(data, "REDQ", 4) == 0) {
+                stream->spice = TRUE;
+                stream->channel_type = data[20];
+                stream->channel_id = data[21];
+            }
+            g_ptr_array_add(streams, stream);
+        }
+        g_ptr_array_add(stream->records, g_memdup(&record, sizeof(record)));
+    }
+    virt_viewer_capture_reader_free(reader);
+
+    if (read_error != NULL) {
+        g_propagate_error(error, read_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+receive_all(GSocket *socket, guint8 *buffer, gsize len)
+{
+    while (len > 0) {
+        gssize n = g_socket_receive(socket, (gchar *)buffer, len, NULL, NULL);
+
+        if (n <= 0)
+            return FALSE;
+        buffer += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+static Stream *
+stream_take(GSocket *socket)
+{
+    guint8 link[SPICE_LINK_LEN];
+    gboolean spice = FALSE;
+    Stream *found = NULL;
+    guint i;
+
+    /* SPICE clients speak first, VNC ones wait for the server */
+    if (g_socket_condition_timed_wait(socket, G_IO_IN, 200 * G_TIME_SPAN_MILLISECOND, NULL, NULL)) {
+        if (!receive_all(socket, link, sizeof(link)))
+            return NULL;
+        spice = memcmp(link, "REDQ", 4) == 0;
+    }
+
+    g_mutex_lock(&lock);
+    for (i = 0; i < streams->len && found == NULL; i++) {
+        Stream *stream = g_ptr_array_index(streams, i);
+
+        if (stream->taken || stream->spice != spice)
+            continue;
+        if (spice && (stream->channel_type != link[20] || stream->channel_id != link[21]))
+            continue;
+        found = stream;
+        found->taken = TRUE;
+    }
+    g_mutex_unlock(&lock);
+
+    return found;
+}
+
+static gpointer
+drain_thread(gpointer user_data)
+{
+    GSocket *socket = user_data;
+    gchar buffer[4096];
+
+    while (g_socket_receive(socket, buffer, sizeof(buffer), NULL, NULL) > 0)
+        ;
+
+    return NULL;
+}
+
+static gboolean
+serve(GThreadedSocketService *service G_GNUC_UNUSED,
+      GSocketConnection *connection,
+      GObject *source G_GNUC_UNUSED,
+      gpointer user_data G_GNUC_UNUSED)
+{
+    GSocket *socket = g_socket_connection_get_socket(connection);
+    VirtViewerCaptureRecord *first, *last;
+    GThread *drain;
+    Stream *stream;
+    gint64 start, elapsed;
+    guint64 bytes = 0;
+    guint i;
+
+    stream = stream_take(socket);
+    if (stream == NULL) {
+        g_printerr("No stream left for a connection\n");
+        return TRUE;
+    }
+
+    drain = g_thread_new("drain", drain_thread, socket);
+    first = g_ptr_array_index(stream->records, 0);
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < stream->records->len; i++) {
+        VirtViewerCaptureRecord *record = g_ptr_array_index(stream->records, i);
+        gsize len;
+        const gchar *data = g_bytes_get_data(record->data, &len);
+
+        if (record->direction != VIRT_VIEWER_RELAY_FROM_SERVER)
+            continue;
+
+        if (!opt_fast) {
+            gint64 delay = start + record->time - first->time - g_get_monotonic_time();
+
+            if (delay > 0)
+                g_usleep(delay);
+        }
+
+        while (len > 0) {
+            gssize n = g_socket_send(socket, data, len, NULL, NULL);
+
+            if (n <= 0)
+                goto done;
+            data += n;
+            len -= n;
+            bytes += n;
+        }
+    }
+
+done:
+    elapsed = g_get_monotonic_time() - start;
+    g_socket_shutdown(socket, FALSE, TRUE, NULL);
+    g_thread_join(drain);
+
+    last = g_ptr_array_index(stream->records, stream->records->len - 1);
+    g_print("stream %u: %" G_GUINT64_FORMAT " bytes in %.3f s, recorded in %.3f s, %.1f MB/s\n",
+            stream->id, bytes,
+            elapsed / (gdouble)G_TIME_SPAN_SECOND,
+            (last->time - first->time) / (gdouble)G_TIME_SPAN_SECOND,
+            elapsed > 0 ? bytes / (gdouble)elapsed : 0.0);
+
+    g_mutex_lock(&lock);
+    if (++n_done == streams->len)
+        g_main_loop_quit(loop);
+    g_mutex_unlock(&lock);
+
+    return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+    const GOptionEntry options[] = {
+        { "fast", '\0', 0, G_OPTION_ARG_NONE, &opt_fast,
+          "Send as fast as the viewer reads rather than at the recorded pace", NULL },
+        { "unix", '\0', 0, G_OPTION_ARG_FILENAME, &opt_unix,
+          "Listen on the UNIX socket PATH", "PATH" },
+        { "port", '\0', 0, G_OPTION_ARG_INT, &opt_port,
+          "Listen on PORT of the loopback interface", "PORT" },
+        { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+    };
+    GOptionContext *context = g_option_context_new("CAPTURE");
+    GSocketService *service;
+    GSocketAddress *address;
+    GError *error = NULL;
+
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error) ||
+        argc != 2 || (opt_unix == NULL) == (opt_port <= 0)) {
+        g_printerr("%s\n", error ? error->message : "Usage: capture-replay --unix PATH|--port PORT CAPTURE");
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    if (!load_capture(argv[1], &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    if (streams->len == 0) {
+        g_printerr("%s holds no streams\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if (opt_unix != NULL) {
+        g_unlink(opt_unix);
+        address = g_unix_socket_address_new(opt_unix);
+    } else {
+        GInetAddress *loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+
+        address = g_inet_socket_address_new(loopback, opt_port);
+        g_object_unref(loopback);
+    }
+
+    /* one thread per connection, the streams are replayed in parallel */
+    service = g_threaded_socket_service_new(streams->len);
+    if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address,
+                                       G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                       NULL, NULL, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    g_object_unref(address);
+    g_signal_connect(service, "run", G_CALLBACK(serve), NULL);
+
+    g_print("Replaying %u streams %s\n", streams->len,
+            opt_fast ? "as fast as possible" : "at the recorded pace");
+    loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(loop);
+
+    g_main_loop_unref(loop);
+    g_object_unref(service);
+    if (opt_unix != NULL)
+        g_unlink(opt_unix);
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,458 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <gio/gio.h>
+
+#include "ovirt-rest-stub.h"
+
+#define API_ROOT "/ovirt-engine/api"
+#define HOST_ID "a0b1c2d3-0000-4000-8000-000000000001"
+#define CLUSTER_ID "a0b1c2d3-0000-4000-8000-000000000002"
+#define DATA_CENTER_ID "a0b1c2d3-0000-4000-8000-000000000003"
+#define STORAGE_DOMAIN_ID "a0b1c2d3-0000-4000-8000-000000000004"
+#define CDROM_ID "00000000-0000-0000-0000-000000000000"
+
+struct _OvirtRestStub {
+    GSocketService *service;
+    gchar *url;
+
+    guint n_iso_files;
+    volatile gint latency_ms;
+
+    /* Everything below is shared with the worker threads */
+    GMutex lock;
+    guint n_other_files;
+    gchar *files_xml;
+    guint n_requests;
+    guint64 bytes_sent;
+    /* connections being served, shut down to free the stub */
+    GPtrArray *connections;
+    GCond idle;
+    gboolean stopping;
+};
+
+
+static gchar *
+build_api_xml(void)
+{
+    return g_strdup("<api>"
+                    "<link href=\"" API_ROOT "/vms\" rel=\"vms\"/>"
+                    "<link href=\"" API_ROOT "/vms?search={query}\" rel=\"vms/search\"/>"
+                    "<link href=\"" API_ROOT "/storagedomains\" rel=\"storagedomains\"/>"
+                    "<link href=\"" API_ROOT "/hosts\" rel=\"hosts\"/>"
+                    "<link href=\"" API_ROOT "/clusters\" rel=\"clusters\"/>"
+                    "<link href=\"" API_ROOT "/datacenters\" rel=\"datacenters\"/>"
+                    "<product_info><name>oVirt Engine stand-in</name></product_info>"
+                    "</api>");
+}
+
+static gchar *
+build_vms_xml(void)
+{
+    return g_strdup("<vms>"
+                    "<vm href=\"" API_ROOT "/vms/" OVIRT_REST_STUB_VM_GUID "\""
+                    " id=\"" OVIRT_REST_STUB_VM_GUID "\">"
+                    "<name>stub-vm</name>"
+                    "<link href=\"" API_ROOT "/vms/" OVIRT_REST_STUB_VM_GUID "/cdroms\" rel=\"cdroms\"/>"
+                    "<status><state>up</state></status>"
+                    "<host href=\"" API_ROOT "/hosts/" HOST_ID "\" id=\"" HOST_ID "\"/>"
+                    "<cluster href=\"" API_ROOT "/clusters/" CLUSTER_ID "\" id=\"" CLUSTER_ID "\"/>"
+                    "</vm>"
+                    "</vms>");
+}
+
+static gchar *
+build_cdrom_xml(gboolean collection)
+{
+    return g_strdup_printf("%s"
+                           "<cdrom href=\"" API_ROOT "/vms/" OVIRT_REST_STUB_VM_GUID "/cdroms/" CDROM_ID "\""
+                           " id=\"" CDROM_ID "\">"
+                           "<file id=\"\"/>"
+                           "<vm href=\"" API_ROOT "/vms/" OVIRT_REST_STUB_VM_GUID "\""
+                           " id=\"" OVIRT_REST_STUB_VM_GUID "\"/>"
+                           "</cdrom>"
+                           "%s",
+                           collection ? "<cdroms>" : "",
+                           collection ? "</cdroms>" : "");
+}
+
+static gchar *
+build_host_xml(void)
+{
+    return g_strdup("<host href=\"" API_ROOT "/hosts/" HOST_ID "\" id=\"" HOST_ID "\">"
+                    "<name>stub-host</name>"
+                    "<cluster href=\"" API_ROOT "/clusters/" CLUSTER_ID "\" id=\"" CLUSTER_ID "\"/>"
+                    "</host>");
+}
+
+static gchar *
+build_cluster_xml(void)
+{
+    return g_strdup("<cluster href=\"" API_ROOT "/clusters/" CLUSTER_ID "\" id=\"" CLUSTER_ID "\">"
+                    "<name>stub-cluster</name>"
+                    "<data_center href=\"" API_ROOT "/datacenters/" DATA_CENTER_ID "\" id=\"" DATA_CENTER_ID "\"/>"
+                    "</cluster>");
+}
+
+static gchar *
+build_data_center_xml(void)
+{
+    return g_strdup("<data_center href=\"" API_ROOT "/datacenters/" DATA_CENTER_ID "\" id=\"" DATA_CENTER_ID "\">"
+                    "<name>stub-dc</name>"
+                    "<link href=\"" API_ROOT "/datacenters/" DATA_CENTER_ID "/storagedomains\" rel=\"storagedomains\"/>"
+                    "</data_center>");
+}
+
+static gchar *
+build_storage_domains_xml(void)
+{
+    return g_strdup("<storage_domains>"
+                    "<storage_domain href=\"" API_ROOT "/storagedomains/" STORAGE_DOMAIN_ID "\""
+                    " id=\"" STORAGE_DOMAIN_ID "\">"
+                    "<name>stub-iso-domain</name>"
+                    "<link href=\"" API_ROOT "/storagedomains/" STORAGE_DOMAIN_ID "/files\" rel=\"files\"/>"
+                    "<data_centers><data_center id=\"" DATA_CENTER_ID "\"/></data_centers>"
+                    "<type>iso</type>"
+                    "<status><state>active</state></status>"
+                    "</storage_domain>"
+                    "</storage_domains>");
+}
+
+static gchar *
+build_files_xml(OvirtRestStub *stub)
+{
+    GString *xml = g_string_new("<files>");
+    guint i;
+
+    for (i = 0; i < stub->n_iso_files + stub->n_other_files; i++) {
+        const char *ext = (i < stub->n_iso_files) ? "iso" : "vfd";
+
+        g_string_append_printf(xml,
+                               "<file href=\"" API_ROOT "/storagedomains/" STORAGE_DOMAIN_ID
+                               "/files/image-%06u.%s\" id=\"image-%06u.%s\">"
+                               "<name>image-%06u.%s</name>"
+                               "<type>%s</type>"
+                               "</file>",
+                               i, ext, i, ext, i, ext, ext);
+    }
+    g_string_append(xml, "</files>");
+
+    return g_string_free(xml, FALSE);
+}
+
+/* Returns the XML body for @path, or NULL if the resource is unknown */
+static gchar *
+ovirt_rest_stub_lookup(OvirtRestStub *stub, const char *path)
+{
+    if (!g_str_has_prefix(path, API_ROOT))
+        return NULL;
+    path += strlen(API_ROOT);
+
+    if (*path == '\0' || g_str_equal(path, "/"))
+        return build_api_xml();
+    if (g_str_equal(path, "/vms"))
+        return build_vms_xml();
+    if (g_str_equal(path, "/vms/" OVIRT_REST_STUB_VM_GUID "/cdroms"))
+        return build_cdrom_xml(TRUE);
+    if (g_str_equal(path, "/vms/" OVIRT_REST_STUB_VM_GUID "/cdroms/" CDROM_ID))
+        return build_cdrom_xml(FALSE);
+    if (g_str_equal(path, "/hosts/" HOST_ID))
+        return build_host_xml();
+    if (g_str_equal(path, "/clusters/" CLUSTER_ID))
+        return build_cluster_xml();
+    if (g_str_equal(path, "/datacenters/" DATA_CENTER_ID))
+        return build_data_center_xml();
+    if (g_str_equal(path, "/storagedomains") ||
+        g_str_equal(path, "/datacenters/" DATA_CENTER_ID "/storagedomains"))
+        return build_storage_domains_xml();
+    if (g_str_equal(path, "/storagedomains/" STORAGE_DOMAIN_ID "/files")) {
+        gchar *xml;
+
+        g_mutex_lock(&stub->lock);
+        if (stub->files_xml == NULL)
+            stub->files_xml = build_files_xml(stub);
+        xml = g_strdup(stub->files_xml);
+        g_mutex_unlock(&stub->lock);
+
+        return xml;
+    }
+
+    return NULL;
+}
+
+static gboolean
+ovirt_rest_stub_handle_request(OvirtRestStub *stub,
+                               GDataInputStream *input,
+                               GOutputStream *output)
+{
+    gchar *line;
+    gchar **request = NULL;
+    gchar *path;
+    gchar *body = NULL;
+    gchar *header = NULL;
+    gsize content_length = 0;
+    gboolean keep_alive = TRUE;
+    gboolean ret = FALSE;
+    gint latency;
+
+    line = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+    if (line == NULL)
+        return FALSE;
+
+    request = g_strsplit(g_strchomp(line), " ", 3);
+    g_free(line);
+    if (g_strv_length(request) != 3)
+        goto end;
+
+    /* Headers */
+    while ((line = g_data_input_stream_read_line(input, NULL, NULL, NULL)) != NULL) {
+        g_strchomp(line);
+        if (*line == '\0') {
+            g_free(line);
+            break;
+        }
+        if (g_ascii_strncasecmp(line, "Content-Length:", strlen("Content-Length:")) == 0)
+            content_length = strtoul(line + strlen("Content-Length:"), NULL, 10);
+        if (g_ascii_strcasecmp(line, "Connection: close") == 0)
+            keep_alive = FALSE;
+        g_free(line);
+    }
+    if (line == NULL)
+        goto end;
+
+    /* PUT bodies (cdrom updates) are accepted and ignored */
+    if (content_length > 0 &&
+        !g_input_stream_skip(G_INPUT_STREAM(input), content_length, NULL, NULL))
+        goto end;
+
+    latency = g_atomic_int_get(&stub->latency_ms);
+    if (latency > 0)
+        g_usleep(latency * G_TIME_SPAN_MILLISECOND);
+
+    path = request[1];
+    path[strcspn(path, "?")] = '\0';
+    body = ovirt_rest_stub_lookup(stub, path);
+    /* The only writable resource is the cdrom, PUT just echoes it back
+     * which is good enough for ovirt_cdrom_update_async() */
+    if (body != NULL && !g_str_equal(request[0], "GET") &&
+        !(g_str_equal(request[0], "PUT") && g_str_has_suffix(path, "/cdroms/" CDROM_ID)))
+        g_clear_pointer(&body, g_free);
+
+    if (body != NULL) {
+        header = g_strdup_printf("HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: application/xml\r\n"
+                                 "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+                                 "%s"
+                                 "\r\n",
+                                 strlen(body),
+                                 keep_alive ? "" : "Connection: close\r\n");
+    } else {
+        g_debug("ovirt stub: no resource for %s %s", request[0], request[1]);
+        body = g_strdup("<fault><reason>Not Found</reason></fault>");
+        header = g_strdup_printf("HTTP/1.1 404 Not Found\r\n"
+                                 "Content-Type: application/xml\r\n"
+                                 "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+                                 "%s"
+                                 "\r\n",
+                                 strlen(body),
+                                 keep_alive ? "" : "Connection: close\r\n");
+    }
+
+    if (!g_output_stream_write_all(output, header, strlen(header), NULL, NULL, NULL) ||
+        !g_output_stream_write_all(output, body, strlen(body), NULL, NULL, NULL))
+        goto end;
+
+    g_mutex_lock(&stub->lock);
+    stub->n_requests++;
+    stub->bytes_sent += strlen(header) + strlen(body);
+    g_mutex_unlock(&stub->lock);
+
+    ret = keep_alive;
+
+end:
+    g_strfreev(request);
+    g_free(header);
+    g_free(body);
+
+    return ret;
+}
+
+static gboolean
+ovirt_rest_stub_run(GThreadedSocketService *service G_GNUC_UNUSED,
+                    GSocketConnection *connection,
+                    GObject *source_object G_GNUC_UNUSED,
+                    gpointer user_data)
+{
+    OvirtRestStub *stub = user_data;
+    GDataInputStream *input;
+    GOutputStream *output;
+
+    g_mutex_lock(&stub->lock);
+    if (stub->stopping) {
+        g_mutex_unlock(&stub->lock);
+        return TRUE;
+    }
+    g_ptr_array_add(stub->connections, connection);
+    g_mutex_unlock(&stub->lock);
+
+    input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    g_data_input_stream_set_newline_type(input, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+    output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+
+    while (ovirt_rest_stub_handle_request(stub, input, output))
+        ;
+
+    g_object_unref(input);
+
+    g_mutex_lock(&stub->lock);
+    g_ptr_array_remove_fast(stub->connections, connection);
+    g_cond_signal(&stub->idle);
+    g_mutex_unlock(&stub->lock);
+
+    return TRUE;
+}
+
+OvirtRestStub *
+ovirt_rest_stub_new(guint n_iso_files, GError **error)
+{
+    OvirtRestStub *stub = g_new0(OvirtRestStub, 1);
+    GInetAddress *loopback;
+    GSocketAddress *address;
+    GSocketAddress *effective = NULL;
+    gboolean bound;
+
+    g_mutex_init(&stub->lock);
+    g_cond_init(&stub->idle);
+    stub->connections = g_ptr_array_new();
+    stub->n_iso_files = n_iso_files;
+    stub->service = g_threaded_socket_service_new(-1);
+
+    loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    address = g_inet_socket_address_new(loopback, 0);
+    bound = g_socket_listener_add_address(G_SOCKET_LISTENER(stub->service), address,
+                                          G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP,
+                                          NULL, &effective, error);
+    g_object_unref(address);
+    g_object_unref(loopback);
+    if (!bound) {
+        ovirt_rest_stub_free(stub);
+        return NULL;
+    }
+
+    stub->url = g_strdup_printf("http://127.0.0.1:%u",
+                                g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(effective)));
+    g_object_unref(effective);
+
+    g_signal_connect(stub->service, "run", G_CALLBACK(ovirt_rest_stub_run), stub);
+    g_socket_service_start(stub->service);
+
+    return stub;
+}
+
+void
+ovirt_rest_stub_free(OvirtRestStub *stub)
+{
+    guint i;
+
+    if (stub == NULL)
+        return;
+
+    g_socket_service_stop(stub->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(stub->service));
+
+    /* wakes up the workers waiting for the next request of a kept-alive
+     * connection, and waits for them to be done with the stub */
+    g_mutex_lock(&stub->lock);
+    stub->stopping = TRUE;
+    for (i = 0; i < stub->connections->len; i++) {
+        GSocketConnection *connection = g_ptr_array_index(stub->connections, i);
+
+        g_socket_shutdown(g_socket_connection_get_socket(connection), TRUE, TRUE, NULL);
+    }
+    while (stub->connections->len > 0)
+        g_cond_wait(&stub->idle, &stub->lock);
+    g_mutex_unlock(&stub->lock);
+
+    g_object_unref(stub->service);
+    g_ptr_array_unref(stub->connections);
+    g_free(stub->url);
+    g_free(stub->files_xml);
+    g_cond_clear(&stub->idle);
+    g_mutex_clear(&stub->lock);
+    g_free(stub);
+}
+
+void
+ovirt_rest_stub_set_latency(OvirtRestStub *stub, guint latency_ms)
+{
+    g_atomic_int_set(&stub->latency_ms, latency_ms);
+}
+
+void
+ovirt_rest_stub_set_n_other_files(OvirtRestStub *stub, guint n_other_files)
+{
+    g_mutex_lock(&stub->lock);
+    stub->n_other_files = n_other_files;
+    g_clear_pointer(&stub->files_xml, g_free);
+    g_mutex_unlock(&stub->lock);
+}
+
+const gchar *
+ovirt_rest_stub_get_url(OvirtRestStub *stub)
+{
+    return stub->url;
+}
+
+guint
+ovirt_rest_stub_get_n_requests(OvirtRestStub *stub)
+{
+    guint n;
+
+    g_mutex_lock(&stub->lock);
+    n = stub->n_requests;
+    g_mutex_unlock(&stub->lock);
+
+    return n;
+}
+
+guint64
+ovirt_rest_stub_get_bytes_sent(OvirtRestStub *stub)
+{
+    guint64 bytes;
+
+    g_mutex_lock(&stub->lock);
+    bytes = stub->bytes_sent;
+    g_mutex_unlock(&stub->lock);
+
+    return bytes;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,62 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef OVIRT_REST_STUB_H
+#define OVIRT_REST_STUB_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define OVIRT_REST_STUB_VM_GUID "a0b1c2d3-0000-4000-8000-00000000cafe"
+
+typedef struct _OvirtRestStub OvirtRestStub;
+
+/*
+ * A minimal HTTP server answering the subset of the oVirt REST API used by
+ * OvirtForeignMenu (api root, vms, hosts, clusters, datacenters,
+ * storagedomains and files) with canned XML. Requests are served from
+ * worker threads so that the caller's main loop stays free to drive the
+ * code under test.
+ */
+OvirtRestStub *ovirt_rest_stub_new(guint n_iso_files, GError **error);
+void ovirt_rest_stub_free(OvirtRestStub *stub);
+
+/* Delay applied before answering every request */
+void ovirt_rest_stub_set_latency(OvirtRestStub *stub, guint latency_ms);
+/* Number of non-ISO files (floppy images) listed next to the ISOs */
+void ovirt_rest_stub_set_n_other_files(OvirtRestStub *stub, guint n_other_files);
+
+/* "http://127.0.0.1:<port>", suitable for ovirt_proxy_new() */
+const gchar *ovirt_rest_stub_get_url(OvirtRestStub *stub);
+guint ovirt_rest_stub_get_n_requests(OvirtRestStub *stub);
+guint64 ovirt_rest_stub_get_bytes_sent(OvirtRestStub *stub);
+
+G_END_DECLS
+
+#endif /* OVIRT_REST_STUB_H */
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
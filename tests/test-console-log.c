@@ -0,0 +1,128 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "virt-viewer-console-log.h"
+
+static gchar **
+read_log_lines(const gchar *path)
+{
+    gchar *contents = NULL;
+    gchar **lines;
+
+    g_assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+    /* every line is complete, including the last one */
+    g_assert_true(g_str_has_suffix(contents, "\n"));
+    contents[strlen(contents) - 1] = '\0';
+    lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    return lines;
+}
+
+static void
+test_console_log_timestamps(void)
+{
+    gchar *dir = g_dir_make_tmp("virt-viewer-console-log-XXXXXX", NULL);
+    gchar *path = g_build_filename(dir, "serial.log", NULL);
+    VirtViewerConsoleLog *log;
+    gchar **lines;
+
+    g_assert_nonnull(dir);
+    log = virt_viewer_console_log_new(path, 0, 0);
+    /* a line split across several chunks only gets one timestamp */
+    virt_viewer_console_log_append(log, (const guint8 *)"Booting\nKernel pa", 17);
+    virt_viewer_console_log_append(log, (const guint8 *)"nic\n", 4);
+    virt_viewer_console_log_free(log);
+
+    lines = read_log_lines(path);
+    g_assert_cmpuint(g_strv_length(lines), ==, 2);
+    g_assert_true(lines[0][0] == '[');
+    g_assert_true(g_str_has_suffix(lines[0], "] Booting"));
+    g_assert_true(g_str_has_suffix(lines[1], "] Kernel panic"));
+    g_strfreev(lines);
+
+    g_remove(path);
+    g_rmdir(dir);
+    g_free(path);
+    g_free(dir);
+}
+
+static void
+test_console_log_rotate(void)
+{
+    gchar *dir = g_dir_make_tmp("virt-viewer-console-log-XXXXXX", NULL);
+    gchar *path = g_build_filename(dir, "serial.log", NULL);
+    VirtViewerConsoleLog *log;
+    guint i;
+
+    g_assert_nonnull(dir);
+    log = virt_viewer_console_log_new(path, 256, 2);
+    for (i = 0; i < 100; i++) {
+        gchar *line = g_strdup_printf("line %03u\n", i);
+        virt_viewer_console_log_append(log, (const guint8 *)line, strlen(line));
+        g_free(line);
+    }
+    virt_viewer_console_log_free(log);
+
+    for (i = 0; i <= 3; i++) {
+        gchar *rotated = i == 0 ? g_strdup(path) : g_strdup_printf("%s.%u", path, i);
+
+        /* only the current log and the two newest rotated ones are kept */
+        if (i < 3) {
+            gchar **lines = read_log_lines(rotated);
+            GStatBuf st;
+
+            g_assert_cmpint(g_stat(rotated, &st), ==, 0);
+            g_assert_cmpint(st.st_size, <, 256 + 64);
+            g_strfreev(lines);
+        } else {
+            g_assert_false(g_file_test(rotated, G_FILE_TEST_EXISTS));
+        }
+        g_remove(rotated);
+        g_free(rotated);
+    }
+
+    g_rmdir(dir);
+    g_free(path);
+    g_free(dir);
+}
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/virt-viewer-console-log/timestamps", test_console_log_timestamps);
+    g_test_add_func("/virt-viewer-console-log/rotate", test_console_log_rotate);
+
+    return g_test_run();
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,99 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <config.h>
+#include <glib.h>
+
+#include "virt-viewer-latency.h"
+
+static void
+test_latency_empty(void)
+{
+    VirtViewerLatency *latency = virt_viewer_latency_new();
+
+    g_assert_cmpuint(virt_viewer_latency_get_count(latency), ==, 0);
+    g_assert_cmpint(virt_viewer_latency_get_percentile(latency, 50), ==, 0);
+    g_assert_cmpint(virt_viewer_latency_get_max(latency), ==, 0);
+
+    virt_viewer_latency_free(latency);
+}
+
+static void
+test_latency_percentiles(void)
+{
+    VirtViewerLatency *latency = virt_viewer_latency_new();
+    gint64 i, p50, p99;
+
+    /* 1 ms to 100 ms */
+    for (i = 1; i <= 100; i++)
+        virt_viewer_latency_add(latency, i * 1000);
+
+    g_assert_cmpuint(virt_viewer_latency_get_count(latency), ==, 100);
+    g_assert_cmpint(virt_viewer_latency_get_max(latency), ==, 100000);
+
+    /* buckets are at most 12.5% wide, and their upper bound is reported */
+    p50 = virt_viewer_latency_get_percentile(latency, 50);
+    g_assert_cmpint(p50, >=, 50000);
+    g_assert_cmpint(p50, <=, 50000 * 9 / 8);
+    p99 = virt_viewer_latency_get_percentile(latency, 99);
+    g_assert_cmpint(p99, >=, 99000);
+    g_assert_cmpint(p99, <=, 100000);
+    g_assert_cmpint(virt_viewer_latency_get_percentile(latency, 100), ==, 100000);
+
+    virt_viewer_latency_free(latency);
+}
+
+static void
+test_latency_range(void)
+{
+    VirtViewerLatency *latency = virt_viewer_latency_new();
+
+    /* small values are exact, huge ones are clamped rather than lost */
+    virt_viewer_latency_add(latency, 3);
+    g_assert_cmpint(virt_viewer_latency_get_percentile(latency, 50), ==, 3);
+    virt_viewer_latency_add(latency, -5);
+    g_assert_cmpint(virt_viewer_latency_get_percentile(latency, 1), ==, 0);
+    virt_viewer_latency_add(latency, G_MAXINT64);
+    g_assert_cmpuint(virt_viewer_latency_get_count(latency), ==, 3);
+    g_assert_cmpint(virt_viewer_latency_get_percentile(latency, 100), ==,
+                    virt_viewer_latency_get_max(latency));
+
+    virt_viewer_latency_free(latency);
+}
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/virt-viewer-latency/empty", test_latency_empty);
+    g_test_add_func("/virt-viewer-latency/percentiles", test_latency_percentiles);
+    g_test_add_func("/virt-viewer-latency/range", test_latency_range);
+
+    return g_test_run();
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,381 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#include <config.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "virt-viewer-relay.h"
+#include "virt-viewer-capture.h"
+#include "virt-viewer-wan.h"
+
+typedef struct {
+    gint chunks;
+    gsize bytes[VIRT_VIEWER_RELAY_N_DIRECTIONS];
+    gboolean freed;
+} Counter;
+
+static gint64
+counter_forward(gpointer filter_data,
+                VirtViewerRelayDirection direction,
+                const guint8 *data,
+                gsize len)
+{
+    Counter *counter = filter_data;
+
+    g_assert_nonnull(data);
+    g_atomic_int_inc(&counter->chunks);
+    counter->bytes[direction] += len;
+
+    return 0;
+}
+
+static void
+counter_free(gpointer filter_data)
+{
+    Counter *counter = filter_data;
+
+    counter->freed = TRUE;
+}
+
+static const VirtViewerRelayFilter counter_filter = {
+    .needs_data = TRUE,
+    .forward = counter_forward,
+    .free = counter_free,
+};
+
+static void
+read_all(int fd, gchar *buffer, gsize len)
+{
+    while (len > 0) {
+        gssize n = read(fd, buffer, len);
+
+        g_assert_cmpint(n, >, 0);
+        buffer += n;
+        len -= n;
+    }
+}
+
+static void
+check_relay(gboolean filtered)
+{
+    static const gchar request[] = "client hello";
+    static const gchar reply[] = "server hello, and a longer reply";
+    VirtViewerRelay *relay = virt_viewer_relay_new();
+    Counter counter = { 0, };
+    GError *error = NULL;
+    gchar buffer[64];
+    guint64 to_server, from_server;
+    int fds[2], session_fd;
+
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+    if (filtered)
+        virt_viewer_relay_add_filter(relay, &counter_filter, &counter);
+    session_fd = virt_viewer_relay_start(relay, fds[0], &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(session_fd, >=, 0);
+
+    /* fds[1] plays the server */
+    g_assert_cmpint(write(session_fd, request, sizeof(request)), ==, sizeof(request));
+    read_all(fds[1], buffer, sizeof(request));
+    g_assert_cmpstr(buffer, ==, request);
+
+    g_assert_cmpint(write(fds[1], reply, sizeof(reply)), ==, sizeof(reply));
+    read_all(session_fd, buffer, sizeof(reply));
+    g_assert_cmpstr(buffer, ==, reply);
+
+    /* the end of the stream is forwarded too */
+    close(fds[1]);
+    g_assert_cmpint(read(session_fd, buffer, sizeof(buffer)), ==, 0);
+
+    virt_viewer_relay_get_stats(relay, &to_server, &from_server);
+    g_assert_cmpuint(to_server, ==, sizeof(request));
+    g_assert_cmpuint(from_server, ==, sizeof(reply));
+
+    close(session_fd);
+    virt_viewer_relay_free(relay);
+
+    if (filtered) {
+        g_assert_cmpint(counter.chunks, >=, 2);
+        g_assert_cmpuint(counter.bytes[VIRT_VIEWER_RELAY_TO_SERVER], ==, sizeof(request));
+        g_assert_cmpuint(counter.bytes[VIRT_VIEWER_RELAY_FROM_SERVER], ==, sizeof(reply));
+        g_assert_true(counter.freed);
+    }
+}
+
+static void
+test_relay_plain(void)
+{
+    check_relay(FALSE);
+}
+
+static void
+test_relay_filter(void)
+{
+    check_relay(TRUE);
+}
+
+static void
+test_relay_not_socket(void)
+{
+    VirtViewerRelay *relay = virt_viewer_relay_new();
+    GError *error = NULL;
+    int fds[2];
+
+    g_assert_cmpint(pipe(fds), ==, 0);
+    g_assert_cmpint(virt_viewer_relay_start(relay, fds[0], &error), ==, -1);
+    g_assert_nonnull(error);
+    g_clear_error(&error);
+    virt_viewer_relay_free(relay);
+
+    /* still ours */
+    g_assert_cmpint(close(fds[0]), ==, 0);
+    close(fds[1]);
+}
+
+static void
+test_relay_capture(void)
+{
+    static const gchar request[] = "client hello";
+    static const gchar reply[] = "server hello";
+    gchar *filename = g_build_filename(g_get_tmp_dir(), "test-relay-XXXXXX", NULL);
+    VirtViewerCaptureReader *reader;
+    VirtViewerCaptureRecord record;
+    VirtViewerCapture *capture;
+    VirtViewerRelay *relay;
+    GError *error = NULL;
+    gchar buffer[64];
+    int fds[2], session_fd, tmp_fd;
+
+    tmp_fd = g_mkstemp(filename);
+    g_assert_cmpint(tmp_fd, >=, 0);
+    close(tmp_fd);
+
+    capture = virt_viewer_capture_new(filename, &error);
+    g_assert_no_error(error);
+
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+    relay = virt_viewer_relay_new();
+    virt_viewer_capture_add_relay(capture, relay);
+    session_fd = virt_viewer_relay_start(relay, fds[0], &error);
+    g_assert_no_error(error);
+
+    /* one exchange after the other, so the order of the records is known */
+    g_assert_cmpint(write(session_fd, request, sizeof(request)), ==, sizeof(request));
+    read_all(fds[1], buffer, sizeof(request));
+    g_assert_cmpint(write(fds[1], reply, sizeof(reply)), ==, sizeof(reply));
+    read_all(session_fd, buffer, sizeof(reply));
+
+    close(fds[1]);
+    close(session_fd);
+    virt_viewer_relay_free(relay);
+    virt_viewer_capture_unref(capture);
+
+    reader = virt_viewer_capture_reader_new(filename, &error);
+    g_assert_no_error(error);
+
+    g_assert_true(virt_viewer_capture_reader_next(reader, &record, &error));
+    g_assert_cmpuint(record.stream, ==, 0);
+    g_assert_cmpint(record.direction, ==, VIRT_VIEWER_RELAY_TO_SERVER);
+    g_assert_cmpstr(g_bytes_get_data(record.data, NULL), ==, request);
+    g_bytes_unref(record.data);
+
+    g_assert_true(virt_viewer_capture_reader_next(reader, &record, &error));
+    g_assert_cmpint(record.direction, ==, VIRT_VIEWER_RELAY_FROM_SERVER);
+    g_assert_cmpstr(g_bytes_get_data(record.data, NULL), ==, reply);
+    g_bytes_unref(record.data);
+
+    g_assert_false(virt_viewer_capture_reader_next(reader, &record, &error));
+    g_assert_no_error(error);
+    virt_viewer_capture_reader_free(reader);
+
+    g_unlink(filename);
+    g_free(filename);
+}
+
+static void
+test_relay_capture_corrupt(void)
+{
+    /* a record claiming 4 GiB of data */
+    static const gchar contents[] = "VVCAPT01"
+        "\0\0\0\0" "\0" "\0\0\0\0\0\0\0\0" "\xff\xff\xff\xff";
+    gchar *filename = g_build_filename(g_get_tmp_dir(), "test-relay-XXXXXX", NULL);
+    VirtViewerCaptureReader *reader;
+    VirtViewerCaptureRecord record;
+    GError *error = NULL;
+    int tmp_fd;
+
+    tmp_fd = g_mkstemp(filename);
+    g_assert_cmpint(tmp_fd, >=, 0);
+    close(tmp_fd);
+    g_assert_true(g_file_set_contents(filename, contents, sizeof(contents) - 1, NULL));
+
+    reader = virt_viewer_capture_reader_new(filename, &error);
+    g_assert_no_error(error);
+    g_assert_false(virt_viewer_capture_reader_next(reader, &record, &error));
+    g_assert_nonnull(error);
+    g_clear_error(&error);
+    virt_viewer_capture_reader_free(reader);
+
+    g_unlink(filename);
+    g_free(filename);
+}
+
+static void
+test_relay_wan_profile(void)
+{
+    VirtViewerWanProfile profile;
+    GError *error = NULL;
+
+    g_assert_true(virt_viewer_wan_profile_parse("vpn,loss=2.5,seed=7", &profile, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(profile.latency, ==, 60);
+    g_assert_cmpuint(profile.bandwidth, ==, 4000);
+    g_assert_cmpfloat(profile.loss, ==, 2.5);
+    g_assert_cmpuint(profile.seed, ==, 7);
+
+    /* the jitter is capped by the latency */
+    g_assert_true(virt_viewer_wan_profile_parse("latency=10,jitter=50", &profile, &error));
+    g_assert_cmpuint(profile.jitter, ==, 10);
+
+    g_assert_false(virt_viewer_wan_profile_parse("latency=fast", &profile, &error));
+    g_assert_nonnull(error);
+    g_clear_error(&error);
+    g_assert_false(virt_viewer_wan_profile_parse("moon", &profile, &error));
+    g_assert_nonnull(error);
+    g_clear_error(&error);
+}
+
+static void
+test_relay_wan_latency(void)
+{
+    static const gchar request[] = "client hello";
+    VirtViewerRelay *relay = virt_viewer_relay_new();
+    VirtViewerWanProfile profile = { .latency = 50 };
+    GError *error = NULL;
+    gchar buffer[64];
+    gint64 start;
+    int fds[2], session_fd;
+
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+    virt_viewer_wan_add_relay(&profile, relay);
+    session_fd = virt_viewer_relay_start(relay, fds[0], &error);
+    g_assert_no_error(error);
+
+    start = g_get_monotonic_time();
+    g_assert_cmpint(write(session_fd, request, sizeof(request)), ==, sizeof(request));
+    read_all(fds[1], buffer, sizeof(request));
+    g_assert_cmpint(g_get_monotonic_time() - start, >=, 50 * G_TIME_SPAN_MILLISECOND);
+
+    close(fds[1]);
+    close(session_fd);
+    virt_viewer_relay_free(relay);
+}
+
+static void
+test_relay_wan_pipelined(void)
+{
+    VirtViewerRelay *relay = virt_viewer_relay_new();
+    VirtViewerWanProfile profile = { .latency = 100 };
+    GError *error = NULL;
+    gchar buffer[1024] = { 0, };
+    gint64 start, elapsed;
+    int fds[2], session_fd, i;
+
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+    virt_viewer_wan_add_relay(&profile, relay);
+    session_fd = virt_viewer_relay_start(relay, fds[0], &error);
+    g_assert_no_error(error);
+
+    /* ten writes, each read separately, are delayed at the same time
+     * rather than one after the other */
+    start = g_get_monotonic_time();
+    for (i = 0; i < 10; i++) {
+        g_assert_cmpint(write(session_fd, buffer, sizeof(buffer)), ==, sizeof(buffer));
+        g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+    }
+    for (i = 0; i < 10; i++)
+        read_all(fds[1], buffer, sizeof(buffer));
+    elapsed = g_get_monotonic_time() - start;
+    g_assert_cmpint(elapsed, >=, 100 * G_TIME_SPAN_MILLISECOND);
+    g_assert_cmpint(elapsed, <, 500 * G_TIME_SPAN_MILLISECOND);
+
+    close(fds[1]);
+    close(session_fd);
+    virt_viewer_relay_free(relay);
+}
+
+static void
+test_relay_stop_delayed(void)
+{
+    static const gchar request[] = "client hello";
+    VirtViewerRelay *relay = virt_viewer_relay_new();
+    VirtViewerWanProfile profile = { .latency = 10000 };
+    GError *error = NULL;
+    gint64 start;
+    int fds[2], session_fd;
+
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+    virt_viewer_wan_add_relay(&profile, relay);
+    session_fd = virt_viewer_relay_start(relay, fds[0], &error);
+    g_assert_no_error(error);
+
+    /* the chunk is held back for 10 s, freeing must not wait for it */
+    g_assert_cmpint(write(session_fd, request, sizeof(request)), ==, sizeof(request));
+    g_usleep(50 * G_TIME_SPAN_MILLISECOND);
+    start = g_get_monotonic_time();
+    virt_viewer_relay_free(relay);
+    g_assert_cmpint(g_get_monotonic_time() - start, <, G_TIME_SPAN_SECOND);
+
+    close(fds[1]);
+    close(session_fd);
+}
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/virt-viewer-relay/plain", test_relay_plain);
+    g_test_add_func("/virt-viewer-relay/filter", test_relay_filter);
+    g_test_add_func("/virt-viewer-relay/not-socket", test_relay_not_socket);
+    g_test_add_func("/virt-viewer-relay/capture", test_relay_capture);
+    g_test_add_func("/virt-viewer-relay/capture-corrupt", test_relay_capture_corrupt);
+    g_test_add_func("/virt-viewer-relay/wan-profile", test_relay_wan_profile);
+    g_test_add_func("/virt-viewer-relay/wan-latency", test_relay_wan_latency);
+    g_test_add_func("/virt-viewer-relay/wan-pipelined", test_relay_wan_pipelined);
+    g_test_add_func("/virt-viewer-relay/stop-delayed", test_relay_stop_delayed);
+
+    return g_test_run();
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */
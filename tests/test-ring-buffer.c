@@ -0,0 +1,136 @@
+/* -*- Mode: C; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Virt Viewer: A virtual machine console viewer
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+
+#include "virt-viewer-ring-buffer.h"
+
+static void
+test_ring_buffer_fill(void)
+{
+    VirtViewerRingBuffer *ring = virt_viewer_ring_buffer_new(8);
+    const guint8 *data;
+    gsize len;
+
+    g_assert_cmpuint(virt_viewer_ring_buffer_get_space(ring), ==, 8);
+    g_assert_cmpuint(virt_viewer_ring_buffer_write(ring, (const guint8 *)"abcde", 5), ==, 5);
+    /* only what fits is stored */
+    g_assert_cmpuint(virt_viewer_ring_buffer_write(ring, (const guint8 *)"fghijk", 6), ==, 3);
+    g_assert_cmpuint(virt_viewer_ring_buffer_get_length(ring), ==, 8);
+    g_assert_cmpuint(virt_viewer_ring_buffer_get_space(ring), ==, 0);
+    g_assert_cmpuint(virt_viewer_ring_buffer_write(ring, (const guint8 *)"x", 1), ==, 0);
+
+    data = virt_viewer_ring_buffer_peek(ring, &len);
+    g_assert_cmpuint(len, ==, 8);
+    g_assert_true(memcmp(data, "abcdefgh", 8) == 0);
+
+    virt_viewer_ring_buffer_consume(ring, 8);
+    g_assert_cmpuint(virt_viewer_ring_buffer_get_length(ring), ==, 0);
+    data = virt_viewer_ring_buffer_peek(ring, &len);
+    g_assert_cmpuint(len, ==, 0);
+
+    virt_viewer_ring_buffer_free(ring);
+}
+
+static void
+test_ring_buffer_wrap(void)
+{
+    VirtViewerRingBuffer *ring = virt_viewer_ring_buffer_new(8);
+    const guint8 *data, *in_flight;
+    gsize len, in_flight_len;
+
+    virt_viewer_ring_buffer_write(ring, (const guint8 *)"abcdef", 6);
+    virt_viewer_ring_buffer_consume(ring, 4);
+
+    /* a write "in flight" keeps pointing to the same bytes while more data
+     * is appended and wraps around */
+    in_flight = virt_viewer_ring_buffer_peek(ring, &in_flight_len);
+    g_assert_cmpuint(in_flight_len, ==, 2);
+    g_assert_cmpuint(virt_viewer_ring_buffer_write(ring, (const guint8 *)"ghijklmn", 8), ==, 6);
+    g_assert_true(memcmp(in_flight, "ef", 2) == 0);
+
+    /* the data is returned in two runs */
+    data = virt_viewer_ring_buffer_peek(ring, &len);
+    g_assert_true(data == in_flight);
+    g_assert_cmpuint(len, ==, 4);
+    g_assert_true(memcmp(data, "efgh", 4) == 0);
+    virt_viewer_ring_buffer_consume(ring, len);
+
+    data = virt_viewer_ring_buffer_peek(ring, &len);
+    g_assert_cmpuint(len, ==, 4);
+    g_assert_true(memcmp(data, "ijkl", 4) == 0);
+    virt_viewer_ring_buffer_consume(ring, len);
+    g_assert_cmpuint(virt_viewer_ring_buffer_get_length(ring), ==, 0);
+
+    virt_viewer_ring_buffer_free(ring);
+}
+
+static void
+test_ring_buffer_stream(void)
+{
+    VirtViewerRingBuffer *ring = virt_viewer_ring_buffer_new(7);
+    GString *in = g_string_new(NULL);
+    GString *out = g_string_new(NULL);
+    gsize written = 0;
+    guint i;
+
+    for (i = 0; i < 1000; i++)
+        g_string_append_c(in, 'a' + i % 26);
+
+    /* odd-sized writes and reads exercise every wrap position */
+    while (out->len < in->len) {
+        const guint8 *data;
+        gsize len;
+
+        written += virt_viewer_ring_buffer_write(ring, (const guint8 *)in->str + written,
+                                                 MIN(5, in->len - written));
+        data = virt_viewer_ring_buffer_peek(ring, &len);
+        len = MIN(len, 3);
+        g_string_append_len(out, (const gchar *)data, len);
+        virt_viewer_ring_buffer_consume(ring, len);
+    }
+
+    g_assert_cmpstr(in->str, ==, out->str);
+
+    g_string_free(in, TRUE);
+    g_string_free(out, TRUE);
+    virt_viewer_ring_buffer_free(ring);
+}
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/virt-viewer-ring-buffer/fill", test_ring_buffer_fill);
+    g_test_add_func("/virt-viewer-ring-buffer/wrap", test_ring_buffer_wrap);
+    g_test_add_func("/virt-viewer-ring-buffer/stream", test_ring_buffer_stream);
+
+    return g_test_run();
+}
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ * End:
+ */